@@ -0,0 +1,125 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Synthetic game used by the savestate benchmark. It allocates a heap split
+ * into several mappings, starts idle threads, and modifies a fraction of its
+ * heap pages at each frame. Frame boundaries are triggered by sleeping, so
+ * that no window is needed.
+ *
+ * Usage: savestatebench-game heap_mb dirty_percent mappings threads
+ */
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t nextRandom()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static void* idleThread(void* arg)
+{
+    /* Sleeping from a secondary thread is not transferred to the
+     * deterministic timer, so this thread really sleeps.
+     */
+    struct timespec ts = {0, 1000000};
+    while (true)
+        nanosleep(&ts, nullptr);
+    return nullptr;
+}
+
+int main(int argc, char** argv)
+{
+    size_t heap_mb = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 256;
+    int dirty_percent = (argc > 2) ? atoi(argv[2]) : 10;
+    int mapping_count = (argc > 3) ? atoi(argv[3]) : 16;
+    int thread_count = (argc > 4) ? atoi(argv[4]) : 4;
+
+    if (mapping_count < 1)
+        mapping_count = 1;
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t mapping_pages = (heap_mb * 1024 * 1024) / (mapping_count * page_size);
+    if (mapping_pages == 0)
+        mapping_pages = 1;
+
+    /* Each mapping is followed by a guard page, so that the kernel does not
+     * merge adjacent mappings.
+     */
+    std::vector<uint64_t*> pages;
+    for (int m = 0; m < mapping_count; m++) {
+        size_t size = mapping_pages * page_size;
+        char* addr = static_cast<char*>(mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (addr == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        mprotect(addr + size, page_size, PROT_NONE);
+
+        for (size_t p = 0; p < mapping_pages; p++)
+            pages.push_back(reinterpret_cast<uint64_t*>(addr + p * page_size));
+    }
+
+    /* Fill the heap with random data, which is the worst case for
+     * compression and page sharing.
+     */
+    size_t words = page_size / sizeof(uint64_t);
+    for (uint64_t* page : pages)
+        for (size_t w = 0; w < words; w++)
+            page[w] = nextRandom();
+
+    for (int t = 0; t < thread_count; t++) {
+        pthread_t thread;
+        pthread_create(&thread, nullptr, idleThread, nullptr);
+        pthread_detach(thread);
+    }
+
+    size_t dirty_pages = (pages.size() * dirty_percent) / 100;
+    size_t cursor = 0;
+    struct timespec frame = {0, 17000000};
+
+    while (true) {
+        /* Modify one word in each dirty page */
+        for (size_t i = 0; i < dirty_pages; i++) {
+            uint64_t* page = pages[cursor];
+            page[nextRandom() % words] = nextRandom();
+            cursor = (cursor + 1) % pages.size();
+        }
+
+        /* Sleeping from the main thread advances the deterministic timer,
+         * which triggers a frame boundary.
+         */
+        nanosleep(&frame, nullptr);
+    }
+
+    return 0;
+}
@@ -0,0 +1,470 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Headless harness measuring the performance of savestates. It launches the
+ * synthetic benchmark game with libTAS, then alternates saving and loading
+ * a state at each frame boundary, using the same messages as linTAS. The
+ * game reports the duration of each checkpoint phase after every savestate
+ * and loadstate.
+ */
+
+#include "../shared/sockethelpers.h"
+#include "../shared/SharedConfig.h"
+#include "../shared/AllInputs.h"
+#include "../shared/messages.h"
+#include "../shared/CheckpointTimings.h"
+#include "../shared/AreaStats.h"
+#include "../shared/GameInfo.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <limits.h> // PATH_MAX
+#include <libgen.h> // dirname
+#include <signal.h> // kill
+#include <string.h>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+/* Number of frames to run before starting the measures */
+static const int WARMUP_FRAMES = 5;
+
+static void print_usage(void)
+{
+    std::cout << "Usage: savestatebench [options]" << std::endl;
+    std::cout << "Options are:" << std::endl;
+    std::cout << "  -l PATH     Path to libTAS.so (default: next to this executable)" << std::endl;
+    std::cout << "  -g PATH     Path to the benchmark game (default: next to this executable)" << std::endl;
+    std::cout << "  -m SIZE     Heap size of the game in MB (default: 256)" << std::endl;
+    std::cout << "  -d PERCENT  Percentage of heap pages modified at each frame (default: 10)" << std::endl;
+    std::cout << "  -n COUNT    Number of memory mappings of the heap (default: 16)" << std::endl;
+    std::cout << "  -t COUNT    Number of threads of the game (default: 4)" << std::endl;
+    std::cout << "  -c COUNT    Number of save/load cycles (default: 50)" << std::endl;
+    std::cout << "  -s LIST     Savestate settings, separated by commas, among:" << std::endl;
+    std::cout << "              ram, incremental, fork, lazy, dedup (default: none)" << std::endl;
+    std::cout << "  -z NAME     Savestate compression: none, lz4 or zstd (default: none)" << std::endl;
+    std::cout << "  -o DIR      Directory of savestates (default: /tmp)" << std::endl;
+    std::cout << "  -h          Show this message" << std::endl;
+}
+
+static double getTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Value at a percentile of a sorted list of durations */
+static double percentile(const std::vector<double>& values, double p)
+{
+    if (values.empty())
+        return 0;
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+struct Measures {
+    /* Duration of each phase reported by the game, in ms */
+    std::vector<double> signal;
+    std::vector<double> suspend;
+    std::vector<double> state;
+    std::vector<double> resume;
+    std::vector<double> total;
+
+    /* Duration measured by the harness, in ms */
+    std::vector<double> roundtrip;
+
+    void add(const CheckpointTimings& timings)
+    {
+        signal.push_back(timings.signal / 1000.0);
+        suspend.push_back(timings.suspend / 1000.0);
+        state.push_back(timings.state / 1000.0);
+        resume.push_back(timings.resume / 1000.0);
+        total.push_back((timings.signal + timings.suspend + timings.state + timings.resume) / 1000.0);
+    }
+
+    void sort()
+    {
+        for (auto v : {&signal, &suspend, &state, &resume, &total, &roundtrip})
+            std::sort(v->begin(), v->end());
+    }
+};
+
+static void printLatency(const char* name, const std::vector<double>& values)
+{
+    std::cout << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(2)
+        << std::setw(10) << percentile(values, 0.5)
+        << std::setw(10) << percentile(values, 0.9)
+        << std::setw(10) << percentile(values, 0.99)
+        << std::setw(10) << (values.empty() ? 0 : values.back()) << std::endl;
+}
+
+static void printMeasures(const char* name, Measures& m)
+{
+    m.sort();
+    std::string prefix(name);
+    printLatency((prefix + " total").c_str(), m.total);
+    printLatency("  signal", m.signal);
+    printLatency("  suspend", m.suspend);
+    printLatency((prefix == "save") ? "  write" : "  read", m.state);
+    printLatency("  resume", m.resume);
+    printLatency("  round-trip", m.roundtrip);
+}
+
+/* Wait for the next frame boundary, collecting the checkpoint timings sent
+ * by the game. Returns false if the game quit.
+ */
+static bool waitFrameBoundary(Measures& saves, Measures& loads)
+{
+    int message = receiveMessage();
+    while (message != MSGB_START_FRAMEBOUNDARY) {
+        switch (message) {
+        case MSGB_FRAMECOUNT_TIME:
+            {
+                unsigned long framecount;
+                struct timespec current_time;
+                receiveData(&framecount, sizeof(unsigned long));
+                receiveData(&current_time, sizeof(struct timespec));
+            }
+            break;
+        case MSGB_FPS:
+            {
+                float fps[2];
+                receiveData(fps, sizeof(fps));
+            }
+            break;
+        case MSGB_GAMEINFO:
+            {
+                GameInfo game_info;
+                receiveData(&game_info, sizeof(GameInfo));
+            }
+            break;
+        case MSGB_ALERT_MSG:
+            std::cerr << "Game alert: " << receiveString() << std::endl;
+            break;
+        case MSGB_CHECKPOINT_TIMINGS:
+            {
+                CheckpointTimings timings;
+                receiveData(&timings, sizeof(CheckpointTimings));
+                if (timings.restore)
+                    loads.add(timings);
+                else
+                    saves.add(timings);
+            }
+            break;
+        case MSGB_AREA_STATS:
+            {
+                bool restore;
+                int count;
+                receiveData(&restore, sizeof(bool));
+                receiveData(&count, sizeof(int));
+                std::vector<AreaStats> stats(count);
+                receiveData(stats.data(), count * sizeof(AreaStats));
+            }
+            break;
+        case MSGB_QUIT:
+        case -1:
+            return false;
+        default:
+            std::cerr << "Got unknown message " << message << std::endl;
+            return false;
+        }
+        message = receiveMessage();
+    }
+    return true;
+}
+
+/* End the frame boundary, letting the game run one frame */
+static void endFrameBoundary()
+{
+    AllInputs ai;
+    ai.emptyInputs();
+    sendMessage(MSGN_ALL_INPUTS);
+    sendData(&ai, sizeof(AllInputs));
+    sendMessage(MSGN_END_FRAMEBOUNDARY);
+}
+
+int main(int argc, char **argv)
+{
+    /* Default paths are next to this executable */
+    char buf[PATH_MAX];
+    std::string bindir = ".";
+    ssize_t len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (len != -1) {
+        buf[len] = '\0';
+        bindir = dirname(buf);
+    }
+    std::string libpath = bindir + "/libTAS.so";
+    std::string gamepath = bindir + "/savestatebench-game";
+    std::string statedir = "/tmp";
+
+    std::string heap_mb = "256";
+    std::string dirty_percent = "10";
+    std::string mapping_count = "16";
+    std::string thread_count = "4";
+    int cycles = 50;
+
+    SharedConfig sc;
+    std::string settings = "none";
+    std::string compression = "none";
+
+    int c;
+    while ((c = getopt (argc, argv, "l:g:m:d:n:t:c:s:z:o:h")) != -1)
+        switch (c) {
+            case 'l':
+                libpath = optarg;
+                break;
+            case 'g':
+                gamepath = optarg;
+                break;
+            case 'm':
+                heap_mb = optarg;
+                break;
+            case 'd':
+                dirty_percent = optarg;
+                break;
+            case 'n':
+                mapping_count = optarg;
+                break;
+            case 't':
+                thread_count = optarg;
+                break;
+            case 'c':
+                cycles = atoi(optarg);
+                break;
+            case 's':
+                {
+                    settings = optarg;
+                    std::istringstream iss(settings);
+                    std::string setting;
+                    while (std::getline(iss, setting, ',')) {
+                        if (setting == "ram")
+                            sc.savestate_settings |= SharedConfig::SS_RAM;
+                        else if (setting == "incremental")
+                            sc.savestate_settings |= SharedConfig::SS_INCREMENTAL;
+                        else if (setting == "fork")
+                            sc.savestate_settings |= SharedConfig::SS_FORK;
+                        else if (setting == "lazy")
+                            sc.savestate_settings |= SharedConfig::SS_LAZY;
+                        else if (setting == "dedup")
+                            sc.savestate_settings |= SharedConfig::SS_DEDUP;
+                        else {
+                            std::cerr << "Unknown savestate setting " << setting << std::endl;
+                            return -1;
+                        }
+                    }
+                }
+                break;
+            case 'z':
+                compression = optarg;
+                if (compression == "none")
+                    sc.savestate_compression = SharedConfig::COMPRESSION_NONE;
+                else if (compression == "lz4")
+                    sc.savestate_compression = SharedConfig::COMPRESSION_LZ4;
+                else if (compression == "zstd")
+                    sc.savestate_compression = SharedConfig::COMPRESSION_ZSTD;
+                else {
+                    std::cerr << "Unknown compression " << compression << std::endl;
+                    return -1;
+                }
+                break;
+            case 'o':
+                statedir = optarg;
+                break;
+            case '?':
+                std::cout << "Unknown option character" << std::endl;
+            case 'h':
+                print_usage();
+                return 0;
+            default:
+                return -1;
+        }
+
+    /* Run the game as fast as possible, without any window */
+    sc.running = true;
+    sc.fastforward = true;
+    sc.save_screenpixels = false;
+    sc.logging_status = SharedConfig::LOGGING_TO_CONSOLE;
+
+    std::string statepath = statedir + "/savestatebench.state1";
+    std::string basestatepath = statedir + "/savestatebench.state0";
+    std::string poolpath = statedir + "/savestatebench.pages";
+    unlink(statepath.c_str());
+    unlink(basestatepath.c_str());
+    unlink(poolpath.c_str());
+
+    removeSocket();
+
+    pid_t game_pid = fork();
+    if (game_pid == 0) {
+        setenv("LD_PRELOAD", libpath.c_str(), 1);
+        execl(gamepath.c_str(), gamepath.c_str(), heap_mb.c_str(), dirty_percent.c_str(),
+            mapping_count.c_str(), thread_count.c_str(), NULL);
+        std::cerr << "Could not execute " << gamepath << std::endl;
+        _exit(1);
+    }
+
+    if (!initSocketProgram()) {
+        std::cerr << "Could not connect to the game" << std::endl;
+        kill(game_pid, SIGKILL);
+        return 1;
+    }
+
+    /* Initialization messages, as sent by linTAS */
+    int message = receiveMessage();
+    while (message != MSGB_END_INIT) {
+        if (message != MSGB_PID) {
+            std::cerr << "Unexpected message during initialization" << std::endl;
+            kill(game_pid, SIGKILL);
+            return 1;
+        }
+        pid_t pid;
+        receiveData(&pid, sizeof(pid_t));
+        message = receiveMessage();
+    }
+
+    sendMessage(MSGN_CONFIG);
+    sendData(&sc, sizeof(SharedConfig));
+    sendMessage(MSGN_BASE_SAVESTATE_PATH);
+    sendString(basestatepath);
+    sendMessage(MSGN_PAGE_POOL_PATH);
+    sendString(poolpath);
+    sendMessage(MSGN_END_INIT);
+
+    std::cout << "Savestate benchmark: heap " << heap_mb << " MB, " << mapping_count << " mappings, "
+        << thread_count << " threads, " << dirty_percent << "% dirty pages per frame, settings "
+        << settings << ", compression " << compression << ", " << cycles << " cycles" << std::endl;
+
+    Measures saves, loads;
+    std::vector<double> sizes;
+    int slot = 1;
+    bool running = true;
+
+    for (int frame = 0; running && (frame < WARMUP_FRAMES); frame++) {
+        running = waitFrameBoundary(saves, loads);
+        if (running)
+            endFrameBoundary();
+    }
+
+    /* Each cycle saves a state, runs one frame, then loads the state and
+     * runs another frame, so that pages are modified in between.
+     */
+    for (int cycle = 0; running && (cycle < cycles); cycle++) {
+        running = waitFrameBoundary(saves, loads);
+        if (!running)
+            break;
+
+        double start = getTime();
+        sendMessage(MSGN_SAVESTATE_INDEX);
+        sendData(&slot, sizeof(int));
+        sendMessage(MSGN_SAVESTATE);
+        sendString(statepath);
+
+        /* The game answers after the savestate is complete, including
+         * when it is written in the background.
+         */
+        sendMessage(MSGN_SAVESTATE_STORAGE);
+        if (receiveMessage() != MSGB_SAVESTATE_STORAGE) {
+            std::cerr << "Got wrong message after saving" << std::endl;
+            break;
+        }
+        uint64_t storage;
+        receiveData(&storage, sizeof(uint64_t));
+        saves.roundtrip.push_back((getTime() - start) * 1000);
+
+        if (!(sc.savestate_settings & SharedConfig::SS_RAM)) {
+            struct stat sb;
+            if (stat(statepath.c_str(), &sb) == 0)
+                storage += static_cast<uint64_t>(sb.st_blocks) * 512;
+        }
+        sizes.push_back(storage / (1024.0 * 1024.0));
+
+        endFrameBoundary();
+
+        running = waitFrameBoundary(saves, loads);
+        if (!running)
+            break;
+
+        start = getTime();
+        sendMessage(MSGN_SAVESTATE_INDEX);
+        sendData(&slot, sizeof(int));
+        sendMessage(MSGN_LOADSTATE);
+        sendString(statepath);
+
+        message = receiveMessage();
+        if (message == MSGB_LOADING_SUCCEEDED) {
+            sendMessage(MSGN_CONFIG);
+            sendData(&sc, sizeof(SharedConfig));
+            message = receiveMessage();
+        }
+        else {
+            std::cerr << "Loading the savestate failed" << std::endl;
+        }
+        if (message != MSGB_FRAMECOUNT_TIME) {
+            std::cerr << "Got wrong message after loading" << std::endl;
+            break;
+        }
+        unsigned long framecount;
+        struct timespec current_time;
+        receiveData(&framecount, sizeof(unsigned long));
+        receiveData(&current_time, sizeof(struct timespec));
+        loads.roundtrip.push_back((getTime() - start) * 1000);
+
+        endFrameBoundary();
+    }
+
+    /* Get the timings of the last loadstate */
+    if (running && waitFrameBoundary(saves, loads))
+        endFrameBoundary();
+
+    kill(game_pid, SIGKILL);
+    waitpid(game_pid, nullptr, 0);
+    closeSocket();
+    removeSocket();
+    unlink(statepath.c_str());
+    unlink(basestatepath.c_str());
+    unlink(poolpath.c_str());
+
+    if (saves.total.empty() || loads.total.empty()) {
+        std::cerr << "No savestate was measured" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::endl << std::left << std::setw(18) << "Latency (ms)" << std::right
+        << std::setw(10) << "p50" << std::setw(10) << "p90"
+        << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+    printMeasures("save", saves);
+    printMeasures("load", loads);
+
+    std::sort(sizes.begin(), sizes.end());
+    double size = percentile(sizes, 0.5);
+    std::cout << std::endl << std::fixed << std::setprecision(1)
+        << "Savestate storage: " << size << " MB" << std::endl
+        << "Save throughput: " << (size * 1000 / percentile(saves.state, 0.5)) << " MB/s" << std::endl
+        << "Load throughput: " << (size * 1000 / percentile(loads.state, 0.5)) << " MB/s" << std::endl;
+
+    return 0;
+}
@@ -26,14 +26,25 @@ namespace libtas {
 
 EventQueue sdlEventQueue;
 
+/* SDL1 and SDL2 events are allocated with the same size, which is the
+ * largest one.
+ */
+static_assert(sizeof(SDL_Event) >= sizeof(SDL1::SDL_Event), "SDL1 events are larger than SDL2 events");
+
+static void* newEvent()
+{
+    return Arena::allocate(Arena::SAVED, sizeof(SDL_Event));
+}
+
+static void deleteEvent(void* ev)
+{
+    Arena::deallocate(Arena::SAVED, ev, sizeof(SDL_Event));
+}
+
 EventQueue::~EventQueue()
 {
-    for (auto ev: eventQueue) {
-        if (game_info.video & GameInfo::SDL1)
-            delete static_cast<SDL1::SDL_Event*>(ev);
-        if (game_info.video & GameInfo::SDL2)
-            delete static_cast<SDL_Event*>(ev);
-    }
+    for (auto ev: eventQueue)
+        deleteEvent(ev);
 }
 
 void EventQueue::init(void)
@@ -53,7 +64,7 @@ void EventQueue::disable(int type)
 
 void EventQueue::enable(int type)
 {
-    std::set<int>::iterator it = droppedEvents.find(type);
+    auto it = droppedEvents.find(type);
     if (it != droppedEvents.end())
         droppedEvents.erase(it);
 }
@@ -93,7 +104,7 @@ void EventQueue::insert(SDL_Event* event)
     /* TODO: Hmmm... creating and destroying objects that many times
      * does not seem like a good pattern...
      */
-    SDL_Event* ev = new SDL_Event;
+    SDL_Event* ev = static_cast<SDL_Event*>(newEvent());
     memcpy(ev, event, sizeof(SDL_Event));
 
     /* Push the event at the end of the queue */
@@ -119,7 +130,7 @@ void EventQueue::insert(SDL1::SDL_Event* event)
         debuglog(LCF_SDL | LCF_EVENTS, "We reached the limit of the event queue size!");
 
     /* Building a dynamically allocated event */
-    SDL1::SDL_Event* ev = new SDL1::SDL_Event;
+    SDL1::SDL_Event* ev = static_cast<SDL1::SDL_Event*>(newEvent());
     memcpy(ev, event, sizeof(SDL1::SDL_Event));
 
     /* Push the event at the end of the queue */
@@ -133,7 +144,7 @@ int EventQueue::pop(SDL_Event* events, int num, Uint32 minType, Uint32 maxType,
     if (num <= 0)
         return 0;
 
-    std::list<void*>::iterator it = eventQueue.begin();
+    EventList::iterator it = eventQueue.begin();
     while (it != eventQueue.end()) {
         SDL_Event* ev = static_cast<SDL_Event*>(*it);
 
@@ -146,7 +157,7 @@ int EventQueue::pop(SDL_Event* events, int num, Uint32 minType, Uint32 maxType,
 
             if (update) {
                 /* Deleting the object and removing it from the list */
-                delete ev;
+                deleteEvent(ev);
                 it = eventQueue.erase(it);
             }
             else
@@ -173,7 +184,7 @@ int EventQueue::pop(SDL1::SDL_Event* events, int num, Uint32 mask, bool update)
     if (num <= 0)
         return 0;
 
-    std::list<void*>::iterator it = eventQueue.begin();
+    EventList::iterator it = eventQueue.begin();
     while (it != eventQueue.end()) {
         SDL1::SDL_Event* ev = static_cast<SDL1::SDL_Event*>(*it);
 
@@ -186,7 +197,7 @@ int EventQueue::pop(SDL1::SDL_Event* events, int num, Uint32 mask, bool update)
 
             if (update) {
                 /* Deleting the object and removing it from the list */
-                delete ev;
+                deleteEvent(ev);
                 it = eventQueue.erase(it);
             }
             else
@@ -208,14 +219,14 @@ int EventQueue::pop(SDL1::SDL_Event* events, int num, Uint32 mask, bool update)
 
 void EventQueue::flush(Uint32 minType, Uint32 maxType)
 {
-    std::list<void*>::iterator it = eventQueue.begin();
+    EventList::iterator it = eventQueue.begin();
     while (it != eventQueue.end()) {
         SDL_Event* ev = static_cast<SDL_Event*>(*it);
 
         /* Check if event match the filter */
         if ((ev->type >= minType) && (ev->type <= maxType)) {
             /* Deleting the object and removing it from the list */
-            delete ev;
+            deleteEvent(ev);
             it = eventQueue.erase(it);
         }
         else {
@@ -226,14 +237,14 @@ void EventQueue::flush(Uint32 minType, Uint32 maxType)
 
 void EventQueue::flush(Uint32 mask)
 {
-    std::list<void*>::iterator it = eventQueue.begin();
+    EventList::iterator it = eventQueue.begin();
     while (it != eventQueue.end()) {
         SDL1::SDL_Event* ev = static_cast<SDL1::SDL_Event*>(*it);
 
         /* Check if event match the filter */
         if (mask & SDL1_EVENTMASK(ev->type)) {
             /* Deleting the object and removing it from the list */
-            delete ev;
+            deleteEvent(ev);
             it = eventQueue.erase(it);
         }
         else {
@@ -244,7 +255,7 @@ void EventQueue::flush(Uint32 mask)
 
 void EventQueue::applyFilter(SDL_EventFilter filter, void* userdata)
 {
-    std::list<void*>::iterator it = eventQueue.begin();
+    EventList::iterator it = eventQueue.begin();
     while (it != eventQueue.end()) {
         SDL_Event* ev = static_cast<SDL_Event*>(*it);
 
@@ -252,7 +263,7 @@ void EventQueue::applyFilter(SDL_EventFilter filter, void* userdata)
         int isKept = filter(userdata, ev);
         if (!isKept) {
             /* Deleting the object and removing it from the list */
-            delete ev;
+            deleteEvent(ev);
             it = eventQueue.erase(it);
         }
         else {
@@ -293,7 +304,7 @@ void EventQueue::addWatch(SDL_EventFilter filter, void* userdata)
 
 void EventQueue::delWatch(SDL_EventFilter filter, void* userdata)
 {
-    std::set<std::pair<SDL_EventFilter,void*>>::iterator it = watches.find(std::make_pair(filter, userdata));
+    auto it = watches.find(std::make_pair(filter, userdata));
     if (it != watches.end())
         watches.erase(it);
 }
@@ -25,6 +25,7 @@
 #include "../external/SDL1.h"
 #include <SDL2/SDL.h>
 #include "sdlevents.h" // SDL_EventFilter
+#include "checkpoint/Arena.h"
 
 namespace libtas {
 /* This is a replacement of the SDL event queue.
@@ -92,9 +93,15 @@ class EventQueue
         void delWatch(SDL_EventFilter filter, void* userdata);
 
     private:
-        std::list<void*> eventQueue;
-        std::set<int> droppedEvents;
-        std::set<std::pair<SDL_EventFilter,void*>> watches;
+        /* Events and containers are stored in our arena, so that the heap of
+         * the game is not modified.
+         */
+        typedef std::list<void*, ArenaAllocator<void*, Arena::SAVED>> EventList;
+        typedef std::pair<SDL_EventFilter,void*> Watch;
+
+        EventList eventQueue;
+        std::set<int, std::less<int>, ArenaAllocator<int, Arena::SAVED>> droppedEvents;
+        std::set<Watch, std::less<Watch>, ArenaAllocator<Watch, Arena::SAVED>> watches;
         SDL1::SDL_EventFilter filterFunc1 = nullptr;
         SDL_EventFilter filterFunc = nullptr;
         void* filterData = nullptr;
@@ -74,7 +74,7 @@ int AudioContext::createBuffer(void)
      * The next available id equals the size of the buffer list + 1
      * (ids must start by 1, because 0 is reserved for no buffer)
      */
-    auto newab = std::make_shared<AudioBuffer>();
+    auto newab = std::allocate_shared<AudioBuffer>(ArenaAllocator<AudioBuffer, Arena::SAVED>());
     newab->id = buffers.size() + 1;
     buffers.push_front(newab);
     return newab->id;
@@ -129,7 +129,7 @@ int AudioContext::createSource(void)
      * The next available id equals the size of the source list + 1
      * (ids must start by 1, because 0 is reserved for no source)
      */
-    auto newas = std::make_shared<AudioSource>();
+    auto newas = std::allocate_shared<AudioSource>(ArenaAllocator<AudioSource, Arena::SAVED>());
     newas->id = sources.size() + 1;
     sources.push_front(newas);
     return newas->id;
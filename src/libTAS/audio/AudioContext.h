@@ -26,6 +26,7 @@
 #include <mutex>
 #include "AudioBuffer.h"
 #include "AudioSource.h"
+#include "../checkpoint/Arena.h"
 
 namespace libtas {
 /* This class stores a set of audio sources and audio buffers, and
@@ -100,12 +101,18 @@ class AudioContext
         std::mutex mutex;
 
     private:
-        std::list<std::shared_ptr<AudioBuffer>> buffers;
-        std::list<std::shared_ptr<AudioSource>> sources;
+        /* Lists and objects are stored in our arena, so that the heap of the
+         * game is not modified. Samples are still stored on the heap.
+         */
+        typedef std::list<std::shared_ptr<AudioBuffer>, ArenaAllocator<std::shared_ptr<AudioBuffer>, Arena::SAVED>> BufferList;
+        typedef std::list<std::shared_ptr<AudioSource>, ArenaAllocator<std::shared_ptr<AudioSource>, Arena::SAVED>> SourceList;
+
+        BufferList buffers;
+        SourceList sources;
 
         /* Extra buffers and sources that have been deleted and can be recycled */
-        std::list<std::shared_ptr<AudioBuffer>> buffers_pool;
-        std::list<std::shared_ptr<AudioSource>> sources_pool;
+        BufferList buffers_pool;
+        SourceList sources_pool;
 };
 
 extern AudioContext audiocontext;
@@ -24,8 +24,6 @@
 #include "../logging.h"
 #include <csignal>
 
-#define ONE_MB 1024 * 1024
-
 namespace libtas {
 
 /* We keep track of the alternate stack that the game is using. Indeed some
@@ -45,8 +43,8 @@ void AltStack::prepareStack()
 {
     /* Setup an alternate signal stack using our reserved memory */
     stack_t ss;
-    ss.ss_sp = ReservedMemory::getAddr(ONE_MB);
-    ss.ss_size = ReservedMemory::getSize() - ONE_MB;
+    ss.ss_sp = ReservedMemory::getAddr(ReservedMemory::STACK_ADDR);
+    ss.ss_size = ReservedMemory::STACK_SIZE;
     ss.ss_flags = 0;
 
     int ret;
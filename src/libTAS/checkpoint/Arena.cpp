@@ -0,0 +1,183 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "Arena.h"
+#include "ReservedMemory.h"
+#include "../logging.h"
+#include <sys/mman.h>
+#include <sched.h>
+#include <cstdint>
+#include <cstdlib>
+
+namespace libtas {
+
+/* Smallest block is 16 bytes, largest is 1 MB */
+#define ARENA_MIN_SHIFT 4
+#define ARENA_CLASS_COUNT 17
+
+/* Size of the address space of the saved arena. Only the part that is used
+ * gets allocated by the kernel.
+ */
+#define SAVED_ARENA_SIZE (64 * 1024 * 1024)
+
+/* State of an arena, located at its beginning */
+struct ArenaState {
+    int lock;
+
+    /* Unused part of the arena */
+    char* next;
+    char* end;
+
+    /* Released blocks of each size */
+    void* free_lists[ARENA_CLASS_COUNT];
+
+    void* roots[Arena::ROOT_COUNT];
+};
+
+static char* arenas[Arena::KIND_COUNT];
+
+static ArenaState* getState(Arena::Kind kind)
+{
+    char* base = __atomic_load_n(&arenas[kind], __ATOMIC_ACQUIRE);
+    if (base)
+        return reinterpret_cast<ArenaState*>(base);
+
+    if (kind == Arena::UNSAVED) {
+        ReservedMemory::init();
+        base = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::ARENA_ADDR));
+        __atomic_store_n(&arenas[kind], base, __ATOMIC_RELEASE);
+        return reinterpret_cast<ArenaState*>(base);
+    }
+
+    void* addr = mmap(nullptr, SAVED_ARENA_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    MYASSERT(addr != MAP_FAILED)
+
+    char* expected = nullptr;
+    if (!__atomic_compare_exchange_n(&arenas[kind], &expected, static_cast<char*>(addr),
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* Another thread created the arena first */
+        munmap(addr, SAVED_ARENA_SIZE);
+        return reinterpret_cast<ArenaState*>(expected);
+    }
+    return static_cast<ArenaState*>(addr);
+}
+
+static size_t getArenaSize(Arena::Kind kind)
+{
+    return (kind == Arena::UNSAVED) ? ReservedMemory::ARENA_SIZE : SAVED_ARENA_SIZE;
+}
+
+static void lockArena(ArenaState* state)
+{
+    while (__atomic_exchange_n(&state->lock, 1, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+static void unlockArena(ArenaState* state)
+{
+    __atomic_store_n(&state->lock, 0, __ATOMIC_RELEASE);
+}
+
+/* Returns the size class of a block, or -1 if it is too large */
+static int getClass(size_t size)
+{
+    int c = 0;
+    while ((static_cast<size_t>(1) << (c + ARENA_MIN_SHIFT)) < size) {
+        c++;
+        if (c == ARENA_CLASS_COUNT)
+            return -1;
+    }
+    return c;
+}
+
+/* Allocate a block that does not fit in an arena */
+static void* heapAllocate(Arena::Kind kind, size_t size)
+{
+    /* Blocks of the UNSAVED arena would be restored with the heap */
+    if (kind == Arena::UNSAVED)
+        throw std::bad_alloc();
+
+    return malloc(size);
+}
+
+void* Arena::allocate(Kind kind, size_t size)
+{
+    int c = getClass(size);
+    if (c < 0)
+        return heapAllocate(kind, size);
+
+    ArenaState* state = getState(kind);
+    lockArena(state);
+
+    /* The arena memory is filled with zeros when created */
+    if (!state->end) {
+        char* base = reinterpret_cast<char*>(state);
+        state->next = base + ((sizeof(ArenaState) + 15) & ~static_cast<size_t>(15));
+        state->end = base + getArenaSize(kind);
+    }
+
+    void* ptr = state->free_lists[c];
+    if (ptr) {
+        state->free_lists[c] = *static_cast<void**>(ptr);
+    }
+    else {
+        size_t block_size = static_cast<size_t>(1) << (c + ARENA_MIN_SHIFT);
+        if (block_size <= static_cast<size_t>(state->end - state->next)) {
+            ptr = state->next;
+            state->next += block_size;
+        }
+    }
+
+    unlockArena(state);
+
+    if (!ptr) {
+        debuglogstdio(LCF_ERROR, "Arena %d is full", kind);
+        return heapAllocate(kind, size);
+    }
+    return ptr;
+}
+
+void** Arena::getRoot(Kind kind, Root root)
+{
+    return &getState(kind)->roots[root];
+}
+
+void Arena::deallocate(Kind kind, void* ptr, size_t size)
+{
+    if (!ptr)
+        return;
+
+    char* base = __atomic_load_n(&arenas[kind], __ATOMIC_ACQUIRE);
+    int c = getClass(size);
+    if ((c < 0) || !base || (static_cast<char*>(ptr) < base) ||
+        (static_cast<char*>(ptr) >= (base + getArenaSize(kind)))) {
+        free(ptr);
+        return;
+    }
+
+    ArenaState* state = reinterpret_cast<ArenaState*>(base);
+    lockArena(state);
+    *static_cast<void**>(ptr) = state->free_lists[c];
+    state->free_lists[c] = ptr;
+    unlockArena(state);
+}
+
+}
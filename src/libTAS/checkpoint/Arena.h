@@ -0,0 +1,119 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_ARENA_H
+#define LIBTAS_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <string>
+
+namespace libtas {
+/* Memory arenas holding the internal state of libTAS, so that it does not
+ * modify the heap of the game. Blocks are grouped by power-of-two sizes and
+ * recycled using a free list for each size. The state of each arena is
+ * stored inside it.
+ */
+namespace Arena
+{
+    enum Kind {
+        /* Saved and restored with savestates, for state that must follow the
+         * game, such as its pending events.
+         */
+        SAVED = 0,
+
+        /* Located in our reserved memory, so never saved nor restored, for
+         * state of libTAS itself that must not roll back when loading a
+         * savestate.
+         */
+        UNSAVED = 1,
+
+        KIND_COUNT
+    };
+
+    /* Pointers stored in the state of an arena, to find objects located in
+     * the arena again after a savestate was loaded.
+     */
+    enum Root {
+        ALERT_MESSAGES = 0,
+
+        ROOT_COUNT
+    };
+
+    /* Allocate a block of `size` bytes. Blocks too large for the SAVED arena
+     * are allocated on the heap. The UNSAVED arena never allocates on the
+     * heap, which is saved, and throws std::bad_alloc instead.
+     */
+    void* allocate(Kind kind, size_t size);
+
+    /* Release a block allocated with the same kind and size */
+    void deallocate(Kind kind, void* ptr, size_t size);
+
+    /* Returns the location of a root pointer of an arena */
+    void** getRoot(Kind kind, Root root);
+
+    /* Construct an object inside an arena */
+    template <typename T>
+    T* create(Kind kind)
+    {
+        return new (allocate(kind, sizeof(T))) T();
+    }
+}
+
+/* Allocator for standard containers using an arena. For UNSAVED arenas, the
+ * container itself must also be located in the arena, using Arena::create().
+ */
+template <typename T, Arena::Kind K>
+class ArenaAllocator
+{
+    public:
+        typedef T value_type;
+
+        template <typename U>
+        struct rebind { typedef ArenaAllocator<U, K> other; };
+
+        ArenaAllocator() {}
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U, K>&) {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(Arena::allocate(K, n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            Arena::deallocate(K, p, n * sizeof(T));
+        }
+};
+
+template <typename T, typename U, Arena::Kind K>
+bool operator==(const ArenaAllocator<T, K>&, const ArenaAllocator<U, K>&) { return true; }
+
+template <typename T, typename U, Arena::Kind K>
+bool operator!=(const ArenaAllocator<T, K>&, const ArenaAllocator<U, K>&) { return false; }
+
+/* Strings located in an arena */
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char, Arena::SAVED>> SavedString;
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char, Arena::UNSAVED>> UnsavedString;
+}
+
+#endif
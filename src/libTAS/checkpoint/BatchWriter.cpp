@@ -0,0 +1,94 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "BatchWriter.h"
+#include "ReservedMemory.h"
+#include "Utils.h"
+#include "../logging.h"
+#include <cstring>
+#include <unistd.h>
+
+namespace libtas {
+
+BatchWriter::BatchWriter(int f) : fd(f), pending(0), iov_count(0), buffer_len(0)
+{
+    offset = lseek(fd, 0, SEEK_CUR);
+    MYASSERT(offset != -1)
+    buffer = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::IO_ADDR));
+}
+
+void BatchWriter::write(const void* buf, size_t size)
+{
+    if (size == 0)
+        return;
+
+    /* Extend the last buffer if the data follows it */
+    if ((iov_count > 0) &&
+        ((static_cast<char*>(iov[iov_count-1].iov_base) + iov[iov_count-1].iov_len) == buf)) {
+        iov[iov_count-1].iov_len += size;
+        pending += size;
+        return;
+    }
+
+    if (iov_count == BATCH_IOV_COUNT)
+        flush();
+
+    iov[iov_count].iov_base = const_cast<void*>(buf);
+    iov[iov_count].iov_len = size;
+    iov_count++;
+    pending += size;
+}
+
+void BatchWriter::writeCopy(const void* buf, size_t size)
+{
+    if (size > ReservedMemory::IO_SIZE) {
+        flush();
+        Utils::writeAll(fd, buf, size);
+        offset += size;
+        return;
+    }
+
+    if ((buffer_len + size) > ReservedMemory::IO_SIZE)
+        flush();
+
+    memcpy(buffer + buffer_len, buf, size);
+    write(buffer + buffer_len, size);
+    buffer_len += size;
+}
+
+void BatchWriter::seek(off_t off)
+{
+    flush();
+    MYASSERT(lseek(fd, off, SEEK_SET) == off)
+    offset = off;
+}
+
+void BatchWriter::flush()
+{
+    if (iov_count > 0)
+        Utils::writevAll(fd, iov, iov_count);
+
+    offset += pending;
+    pending = 0;
+    iov_count = 0;
+    buffer_len = 0;
+}
+
+}
@@ -0,0 +1,79 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_BATCHWRITER_H
+#define LIBTAS_BATCHWRITER_H
+
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace libtas {
+
+/* Number of buffers written with a single system call */
+#define BATCH_IOV_COUNT 256
+
+/* Gather the pieces of a savestate, such as area headers, page statuses and
+ * page data, and write them with a single writev() call. Small pieces are
+ * copied into a buffer located in our reserved memory, so no memory is
+ * allocated.
+ */
+class BatchWriter
+{
+    public:
+        BatchWriter(int fd);
+
+        /* Queue `size` bytes at `buf`, which must stay unchanged and readable
+         * until the next flush().
+         */
+        void write(const void* buf, size_t size);
+
+        /* Copy `size` bytes into our buffer and queue them */
+        void writeCopy(const void* buf, size_t size);
+
+        /* Write all queued data and move to `offset`, which leaves a hole in
+         * the file if it is past the end.
+         */
+        void seek(off_t offset);
+
+        /* Offset in the file, including queued data */
+        off_t tell() const { return offset + pending; }
+
+        /* Write all queued data */
+        void flush();
+
+    private:
+        int fd;
+
+        /* File offset of the first queued byte */
+        off_t offset;
+
+        /* Size of queued data */
+        size_t pending;
+
+        struct iovec iov[BATCH_IOV_COUNT];
+        int iov_count;
+
+        char* buffer;
+        size_t buffer_len;
+};
+}
+
+#endif
@@ -24,25 +24,248 @@
 #include "../logging.h"
 #include "ProcMapsArea.h"
 #include "ProcSelfMaps.h"
+#include "ProcSelfPagemap.h"
 #include "StateHeader.h"
+#include "SaveStateManager.h"
+#include "DataStream.h"
+#include "BatchWriter.h"
+#include "LazyRestore.h"
+#include "PagePool.h"
+#include "MemoryRules.h"
+#include "StateStats.h"
+#include "HelperThreads.h"
 #include "Utils.h"
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <cstring>
+#include <cerrno>
 #include <csignal>
+#include <sys/syscall.h>
+#include <sys/auxv.h>
 #include <X11/Xlibint.h>
 #include <X11/Xlib-xcb.h>
 //#include "../../external/xcbint.h"
 //#include "../sdlwindows.h"
 #include "ReservedMemory.h"
 
-#define ONE_MB 1024 * 1024
-
 namespace libtas {
 
+/* Number of pages processed at once when looking at page entries */
+#define CHUNK_PAGES 512
+
+static_assert(CHUNK_PAGES * sizeof(uint64_t) <= ReservedMemory::PAGEMAP_SIZE, "Pagemap buffer is too small");
+
+/* Status of each page of an incremental area or of a private file mapping,
+ * which is stored in the savestate before the content of the pages.
+ */
+enum PageStatus {
+    PAGE_BASE = 0, /* Page was not modified since the base savestate */
+    PAGE_DATA = 1, /* Page content is stored */
+    PAGE_ZERO = 2, /* Page is not mapped yet, so it contains zeros */
+    PAGE_FILE = 3, /* Page has the content of the mapped file */
+};
+
+/* All we need while saving a savestate */
+struct SaveState {
+    /* All pieces of the savestate are written through this */
+    BatchWriter* out;
+
+    /* Page data is written through this, to be compressed */
+    DataWriter* writer;
+
+    /* Hashes of all stored pages, which are written at the end of the
+     * savestate.
+     */
+    uint64_t* hashes;
+    size_t hash_count;
+    size_t hash_capacity;
+
+    /* Checksum of the pages stored for the current area */
+    uint64_t checksum;
+
+    /* Table of contents, which is written at the end of the savestate. If
+     * there are too many areas, it is not written.
+     */
+    StateTocEntry* toc;
+    size_t toc_count;
+    size_t toc_capacity;
+
+    /* Compression algorithm of page data */
+    int compression;
+
+    /* Are pages that have a hash stored in the page pool */
+    bool pooled;
+
+    /* Size of the pages that were added to the page pool */
+    uint64_t pool_size;
+
+    /* Only store the pages of private file mappings that were written */
+    bool file_pages;
+};
+
+/* All we need while restoring a savestate. This is stored on our alternate
+ * stack, because static variables are overwritten while restoring.
+ */
+struct RestoreState {
+    ProcSelfPagemap* pagemap;
+
+    /* Page data is read through this, to be decompressed */
+    DataReader* reader;
+
+    /* Format version and compression algorithm of the savestate */
+    int version;
+    int compression;
+
+    /* Are fully stored anonymous areas restored lazily */
+    bool lazy;
+
+    /* Number of stored pages located in the page pool */
+    size_t pooled_count;
+
+    /* Pages that are not soft-dirty already hold the content of this
+     * savestate, because it was the last one to be saved or loaded.
+     */
+    bool tracked;
+
+    /* Hashes of stored pages, read by chunks from the end of the savestate */
+    int fd;
+    off_t hash_offset;
+    size_t hash_count;
+    size_t hash_index; /* Index of the next stored page */
+    uint64_t hashes[CHUNK_PAGES];
+    size_t hashes_start;
+    size_t hashes_len;
+
+    /* Status of the current chunk of pages */
+    unsigned char status[CHUNK_PAGES];
+    size_t status_count;
+    size_t status_index;
+
+    /* Current area of the base savestate, with its offset in the file. Areas
+     * are found using the table of contents, or by parsing the area
+     * descriptors if there is none.
+     */
+    int base_fd;
+    Area base_area;
+    off_t base_data_offset;
+    off_t base_next_offset;
+    off_t base_toc_offset;
+    size_t base_toc_count;
+    size_t base_toc_index;
+};
+
+/* Read the header of a savestate, converting it if it was written with the
+ * version 1 format.
+ */
+static bool readStateHeader(int fd, StateHeader *sh)
+{
+    if (Utils::readAll(fd, sh, sizeof(*sh)) != sizeof(*sh)) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not read the savestate header");
+        return false;
+    }
+
+    if (memcmp(sh->magic, STATE_MAGIC, STATE_MAGIC_SIZE) != 0) {
+        /* Version 1 savestates have no magic string */
+        StateHeaderV1 sh1;
+        memcpy(&sh1, sh, sizeof(sh1));
+
+        memset(sh, 0, sizeof(*sh));
+        sh->version = 1;
+        sh->thread_count = sh1.thread_count;
+        memcpy(sh->pthread_ids, sh1.pthread_ids, sizeof(sh->pthread_ids));
+        memcpy(sh->tids, sh1.tids, sizeof(sh->tids));
+        sh->compression = SharedConfig::COMPRESSION_NONE;
+        return true;
+    }
+
+    if (sh->version != STATE_VERSION) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Unsupported savestate version %d", sh->version);
+        return false;
+    }
+
+    return true;
+}
+
+/* Fill the identification of the current execution of the game. The page
+ * pool identifier is chosen at startup, so it differs between executions.
+ */
+static void getExecutionInfo(StateHeader *sh)
+{
+    sh->execution_id = PagePool::getId();
+
+    struct stat sb;
+    if (stat("/proc/self/exe", &sb) == 0) {
+        sh->exe_dev = sb.st_dev;
+        sh->exe_ino = sb.st_ino;
+    }
+
+    sh->exe_addr = getauxval(AT_PHDR);
+    sh->lib_addr = reinterpret_cast<uint64_t>(&Checkpoint::handler);
+    sh->stack_addr = getauxval(AT_RANDOM);
+}
+
+/* Returns if the data of an area starts at a page boundary. This is the case
+ * for uncompressed areas that are fully stored, so that their data can be
+ * accessed directly in the file.
+ */
+static bool hasAlignedData(const Area *area, int compression)
+{
+    return (compression == SharedConfig::COMPRESSION_NONE) &&
+        !(area->properties & (Area::ZERO_PAGE | Area::SKIP | Area::INCREMENTAL | Area::FILE_PAGES));
+}
+
+/* Read the area descriptor located at `offset`. Returns the offset of the
+ * area data, or -1 if the descriptor could not be read.
+ */
+static off_t preadAreaDescriptor(int fd, off_t offset, Area *area, int compression)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    /* Read the name along with the descriptor in a single call. It is
+     * followed by other data, or is at the end of the file.
+     */
+    AreaDescriptor ad;
+    struct iovec iov[2];
+    iov[0].iov_base = &ad;
+    iov[0].iov_len = sizeof(ad);
+    iov[1].iov_base = area->name;
+    iov[1].iov_len = FILENAMESIZE - 1;
+
+    ssize_t rc;
+    do {
+        rc = preadv(fd, iov, 2, offset);
+    } while ((rc == -1) && (errno == EINTR));
+
+    if ((rc < static_cast<ssize_t>(sizeof(ad))) || (ad.name_len >= FILENAMESIZE) ||
+        (rc < static_cast<ssize_t>(sizeof(ad) + ad.name_len)))
+        return -1;
+
+    area->addr = reinterpret_cast<void*>(ad.addr);
+    area->size = ad.size;
+    area->endAddr = reinterpret_cast<void*>(ad.addr + ad.size);
+    area->offset = ad.offset;
+    area->prot = ad.prot;
+    area->flags = ad.flags;
+    area->devmajor = ad.devmajor;
+    area->devminor = ad.devminor;
+    area->inodenum = ad.inodenum;
+    area->properties = ad.properties;
+
+    area->name[ad.name_len] = '\0';
+    offset += sizeof(ad) + ad.name_len;
+
+    if ((area->addr != nullptr) && hasAlignedData(area, compression))
+        offset = (offset + page_size - 1) & ~static_cast<off_t>(page_size - 1);
+
+    return offset;
+}
+
 static const char* savestatepath;
+static int savestateindex;
 
 void Checkpoint::setSavestatePath(const char* filepath)
 {
@@ -50,24 +273,68 @@ void Checkpoint::setSavestatePath(const char* filepath)
     savestatepath = filepath;
 }
 
-bool Checkpoint::checkRestore()
+void Checkpoint::setSavestateIndex(int index)
 {
-    /* Check that the savestate file exists */
-    struct stat sb;
-    if (stat(savestatepath, &sb) == -1)
-        return false;
+    savestateindex = index;
+}
 
-    int fd;
-    OWNCALL(fd = open(savestatepath, O_RDONLY));
+/* Keyframes and states of the savestate tree always share their pages, so
+ * that a state only stores the pages that differ from the states already
+ * saved, which are mostly the ones of the previous keyframe or of its parent.
+ */
+static bool usePagePool(int slot)
+{
+    return (shared_config.savestate_settings & SharedConfig::SS_DEDUP) || (slot >= SAVESTATE_KEYFRAME_SLOT);
+}
+
+bool Checkpoint::checkRestore()
+{
+    /* Check that the savestate exists */
+    int fd = SaveStateManager::openState(savestateindex, savestatepath, false);
     if (fd == -1)
         return false;
 
     /* Read the savestate header */
     StateHeader sh;
-    Utils::readAll(fd, &sh, sizeof(sh));
-    close(fd);
+    bool valid = readStateHeader(fd, &sh);
+    SaveStateManager::closeState(fd, false);
+    if (!valid)
+        return false;
+
+    if ((sh.pool_id != 0) && (sh.pool_id != PagePool::getId())) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR | LCF_ALERT, "Loading this state is not supported because its pages were shared with savestates of another execution, sorry");
+        return false;
+    }
+
+    /* A savestate of another execution of the game can only be loaded if
+     * everything is mapped at the same place, which requires the game to be
+     * launched without address space randomization.
+     */
+    bool other_execution = (sh.execution_id != 0) && (sh.execution_id != PagePool::getId());
+    if (other_execution) {
+        StateHeader current;
+        memset(&current, 0, sizeof(current));
+        getExecutionInfo(&current);
+
+        if ((sh.exe_dev != current.exe_dev) || (sh.exe_ino != current.exe_ino)) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR | LCF_ALERT, "Loading this state is not supported because it was saved by another game executable, sorry");
+            return false;
+        }
 
-    /* Check that the thread list is identical */
+        if ((sh.exe_addr != current.exe_addr) || (sh.lib_addr != current.lib_addr) || (sh.stack_addr != current.stack_addr)) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR | LCF_ALERT, "Loading this state is not supported because the memory layout of the game has changed since its execution, sorry");
+            return false;
+        }
+
+        if (sh.incremental) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR | LCF_ALERT, "Loading this state is not supported because it is based on a savestate of another execution, sorry");
+            return false;
+        }
+    }
+
+    /* Check that the thread list is identical. Threads of another execution
+     * have different tids, which are updated after loading the savestate.
+     */
     int n=0;
     for (ThreadInfo *thread = ThreadManager::thread_list; thread != nullptr; thread = thread->next) {
         if (thread->state != ThreadInfo::ST_RUNNING)
@@ -75,7 +342,7 @@ bool Checkpoint::checkRestore()
 
         int t;
         for (t=0; t<sh.thread_count; t++) {
-            if (sh.pthread_ids[t] == thread->pthread_id && (sh.tids[t] == thread->tid)) {
+            if (sh.pthread_ids[t] == thread->pthread_id && (other_execution || (sh.tids[t] == thread->tid))) {
                 n++;
                 break;
             }
@@ -96,7 +363,10 @@ bool Checkpoint::checkRestore()
     return true;
 }
 
-static bool skipArea(Area *area)
+/* Returns if an area must not be saved nor restored. If `audit` is true, the
+ * size of the area is added to each exclusion rule of the user matching it.
+ */
+static bool skipArea(Area *area, bool audit = false)
 {
     /* If it's readable, but it's VDSO, it will be dangerous to restore it.
     * In 32-bit mode later Red Hat RHEL Linux 2.6.9 releases use 0xffffe000,
@@ -132,7 +402,9 @@ static bool skipArea(Area *area)
         return true;
     }
 
-    if ((area->addr == ReservedMemory::getAddr(0)) && (area->size == ReservedMemory::getSize())) {
+    /* Our reserved memory must stay untouched */
+    if ((area->addr >= ReservedMemory::getAddr(0)) &&
+        (area->endAddr <= ReservedMemory::getAddr(ReservedMemory::getSize()))) {
         return true;
     }
 
@@ -158,78 +430,423 @@ static bool skipArea(Area *area)
         return true;
     }
 
-    return false;
+    return MemoryRules::exclude(area, audit);
 }
 
-/* This function returns a range of zero or non-zero pages. If the first page
- * is non-zero, it searches for all contiguous non-zero pages and returns them.
- * If the first page is all-zero, it searches for contiguous zero pages and
- * returns them.
+/* Current position when looking for zero pages in an area */
+struct PageScanner {
+    ProcSelfPagemap* pagemap;
+    char* endAddr;
+
+    /* Pages that are not mapped read as zeros, which is not true for shared
+     * mappings, where they may be present in other processes.
+     */
+    bool is_private;
+
+    /* Ranges are split at multiples of this size, which is the size of huge
+     * pages for areas backed by them, so that they are not split on restore.
+     */
+    size_t unit_size;
+
+    /* Page entries of the current chunk */
+    const uint64_t* entries;
+    char* chunk;
+    size_t chunk_count;
+};
+
+/* Returns if a page contains only zeros. We look at its page entry first,
+ * so that pages that are not mapped are never read, which would allocate
+ * them.
  */
-static void getNextPageRange(Area &area, size_t &size, bool &is_zero)
+static bool isZeroPageAt(PageScanner *ps, char* page)
 {
     static const size_t page_size = sysconf(_SC_PAGESIZE);
-    static const size_t block_size = 25 * page_size; // Arbitrary, about 100 KB
 
-    if (area.size < block_size) {
-        size = area.size;
-        is_zero = false;
-        return;
+    if ((page < ps->chunk) || (page >= (ps->chunk + ps->chunk_count * page_size))) {
+        ps->chunk = page;
+        ps->chunk_count = (ps->endAddr - page) / page_size;
+        if (ps->chunk_count > CHUNK_PAGES)
+            ps->chunk_count = CHUNK_PAGES;
+        ps->entries = ps->pagemap->getEntries(page, ps->chunk_count);
     }
 
-    intptr_t endAddrInt = reinterpret_cast<intptr_t>(area.endAddr);
+    if (ps->entries) {
+        uint64_t entry = ps->entries[(page - ps->chunk) / page_size];
 
-    size = block_size;
-    is_zero = Utils::areZeroPages(area.addr, block_size / page_size);
+        if (ps->is_private && !ProcSelfPagemap::isPresent(entry) && !ProcSelfPagemap::isSwapped(entry))
+            return true;
 
-    // prevAddr = area.addr;
-    for (intptr_t curAddrInt = reinterpret_cast<intptr_t>(area.addr) + block_size;
-    curAddrInt < endAddrInt;
-    curAddrInt += block_size) {
+        if (ps->pagemap->isZeroPage(entry))
+            return true;
+    }
+
+    return Utils::areZeroPages(page, 1);
+}
+
+/* Returns the end of the unit starting at `addr` */
+static char* getUnitEnd(PageScanner *ps, char* addr)
+{
+    uintptr_t next = (reinterpret_cast<uintptr_t>(addr) + ps->unit_size) & ~(ps->unit_size - 1);
+    char* unitEnd = reinterpret_cast<char*>(next);
+    return (unitEnd < ps->endAddr) ? unitEnd : ps->endAddr;
+}
+
+/* Returns if the unit starting at `addr` only contains zero pages */
+static bool isZeroUnitAt(PageScanner *ps, char* addr)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    char* unitEnd = getUnitEnd(ps, addr);
+    for (; addr < unitEnd; addr += page_size) {
+        if (!isZeroPageAt(ps, addr))
+            return false;
+    }
+    return true;
+}
+
+/* Count the size of contiguous zero units starting at `addr`, until it
+ * reaches `max` bytes.
+ */
+static size_t countZeroUnits(PageScanner *ps, char* addr, size_t max)
+{
+    char* curAddr = addr;
+    while ((static_cast<size_t>(curAddr - addr) < max) && (curAddr < ps->endAddr) && isZeroUnitAt(ps, curAddr))
+        curAddr = getUnitEnd(ps, curAddr);
+    return curAddr - addr;
+}
+
+/* This function returns a range of zero or non-zero pages. If the range
+ * starts with enough zero pages, it searches for all contiguous zero pages
+ * and returns them. Otherwise, it returns all following pages until a large
+ * enough range of zero pages is found, because each range is stored with
+ * its own area header. Ranges are made of whole units.
+ */
+static void getNextPageRange(PageScanner *ps, char* addr, size_t &size, bool &is_zero)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    static const size_t min_zero_pages = 25; // Arbitrary, about 100 KB
 
-        size_t minsize = ((endAddrInt-curAddrInt)<block_size)?(endAddrInt-curAddrInt):block_size;
-        if (is_zero != Utils::areZeroPages(reinterpret_cast<void*>(curAddrInt), minsize / page_size)) {
-            break;
+    /* A single zero huge page is worth its own range */
+    size_t min_zero_size = min_zero_pages * page_size;
+    if (ps->unit_size > min_zero_size)
+        min_zero_size = ps->unit_size;
+
+    char* curAddr = addr;
+    size_t zeros = countZeroUnits(ps, curAddr, min_zero_size);
+    curAddr += zeros;
+
+    is_zero = (zeros >= min_zero_size) || ((zeros > 0) && (curAddr == ps->endAddr));
+
+    if (is_zero) {
+        while ((curAddr < ps->endAddr) && isZeroUnitAt(ps, curAddr))
+            curAddr = getUnitEnd(ps, curAddr);
+    }
+    else {
+        while (curAddr < ps->endAddr) {
+            if (!isZeroUnitAt(ps, curAddr)) {
+                curAddr = getUnitEnd(ps, curAddr);
+                continue;
+            }
+
+            /* Include small ranges of zero units */
+            zeros = countZeroUnits(ps, curAddr, min_zero_size);
+            if (zeros >= min_zero_size)
+                break;
+            curAddr += zeros;
         }
-        size += minsize;
     }
 
-    /* If we are near the end and processing non-zero memory, we can return
-     * the entire section.
-     */
-    if (((area.size - size) < block_size) && !is_zero)
-        size = area.size;
+    size = curAddr - addr;
+}
+
+/* Pages hashed by each task of the helper threads */
+#define HASH_TASK_PAGES 64
+
+/* Pages to hash, split between the helper threads */
+struct HashTasks {
+    char* addr;
+    size_t page_size;
+    size_t count;
+    uint64_t* hashes;
+
+    /* Only hash pages that have this flag set, if not null */
+    const bool* selected;
+};
+
+static void hashTask(int task, int worker, void* arg)
+{
+    HashTasks* ht = static_cast<HashTasks*>(arg);
+    size_t end = (task + 1) * HASH_TASK_PAGES;
+    if (end > ht->count)
+        end = ht->count;
+    for (size_t i = task * HASH_TASK_PAGES; i < end; i++) {
+        if (!ht->selected || ht->selected[i])
+            ht->hashes[i] = Utils::hashPage(ht->addr + i * ht->page_size);
+    }
+}
+
+/* Hash `count` pages starting at `addr` using the helper threads */
+static void hashPages(char* addr, size_t count, uint64_t* hashes, const bool* selected)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    HashTasks ht;
+    ht.addr = addr;
+    ht.page_size = page_size;
+    ht.count = count;
+    ht.hashes = hashes;
+    ht.selected = selected;
+    HelperThreads::run(hashTask, &ht, (count + HASH_TASK_PAGES - 1) / HASH_TASK_PAGES);
 }
 
-static void writeAnAreaWithZeroPages(int fd, Area *orig_area)
+/* Write the content of pages and record their hash. When using the page
+ * pool, pages that have a hash are stored in the pool instead.
+ */
+static void writePages(SaveState *ss, void* addr, size_t size)
 {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    /* Hash the pages in parallel when they all fit in the hash table */
+    size_t count = size / page_size;
+    bool hashed = (ss->hash_count + count) <= ss->hash_capacity;
+    if (hashed)
+        hashPages(static_cast<char*>(addr), count, ss->hashes + ss->hash_count, nullptr);
+
+    char* page = static_cast<char*>(addr);
+    size_t pooled_size = 0;
+    for (size_t i = 0; i < count; i++, page += page_size) {
+        uint64_t hash = hashed ? ss->hashes[ss->hash_count] : Utils::hashPage(page);
+        if (ss->hash_count < ss->hash_capacity) {
+            ss->hashes[ss->hash_count] = hash;
+            if (ss->pooled) {
+                bool added;
+                MYASSERT(PagePool::addPage(&ss->hashes[ss->hash_count], page, &added))
+                pooled_size += page_size;
+                if (added)
+                    ss->pool_size += page_size;
+            }
+        }
+        ss->hash_count++;
+        ss->checksum = Utils::combineHash(ss->checksum, hash);
+    }
+
+    if (pooled_size < size)
+        ss->writer->write(static_cast<char*>(addr) + pooled_size, size - pooled_size);
+
+    StateStats::addData(size);
+}
+
+/* Fill the size and checksum of the table of contents entry of the last
+ * written area.
+ */
+static void endAreaEntry(SaveState *ss)
+{
+    if ((ss->toc_count == 0) || (ss->toc_count > ss->toc_capacity))
+        return;
+
+    StateTocEntry *entry = &ss->toc[ss->toc_count - 1];
+    entry->data_size = ss->out->tell() - entry->data_offset;
+    entry->checksum = ss->checksum;
+}
+
+/* Write the descriptor of an area, followed by the padding up to the area
+ * data if it must be aligned, and add the area to the table of contents.
+ */
+static void writeAreaHeader(Area *area, SaveState *ss)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    endAreaEntry(ss);
+
+    off_t header_offset = ss->out->tell();
+
+    AreaDescriptor ad;
+    ad.addr = reinterpret_cast<uintptr_t>(area->addr);
+    ad.size = area->size;
+    ad.offset = area->offset;
+    ad.devmajor = area->devmajor;
+    ad.devminor = area->devminor;
+    ad.inodenum = area->inodenum;
+    ad.prot = area->prot;
+    ad.flags = area->flags;
+    ad.properties = area->properties;
+    ad.name_len = strnlen(area->name, FILENAMESIZE - 1);
+    ss->out->writeCopy(&ad, sizeof(ad));
+    ss->out->writeCopy(area->name, ad.name_len);
+
+    /* End of areas */
+    if (area->addr == nullptr)
+        return;
+
+    off_t data_offset = header_offset + sizeof(ad) + ad.name_len;
+    if (hasAlignedData(area, ss->compression)) {
+        /* The padding is left as a hole in the file */
+        data_offset = (data_offset + page_size - 1) & ~static_cast<off_t>(page_size - 1);
+        ss->out->seek(data_offset);
+    }
+
+    if (ss->toc_count < ss->toc_capacity) {
+        StateTocEntry *entry = &ss->toc[ss->toc_count];
+        entry->addr = ad.addr;
+        entry->size = ad.size;
+        entry->properties = ad.properties;
+        entry->_reserved = 0;
+        entry->header_offset = header_offset;
+        entry->data_offset = data_offset;
+        entry->data_size = 0;
+        entry->checksum = 0;
+    }
+    ss->toc_count++;
+    ss->checksum = 0;
+}
+
+static void writeAnAreaWithZeroPages(Area *orig_area, ProcSelfPagemap &pagemap, SaveState *ss)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
     Area area = *orig_area;
 
+    PageScanner ps;
+    ps.pagemap = &pagemap;
+    ps.endAddr = static_cast<char*>(area.endAddr);
+    ps.is_private = area.flags & MAP_PRIVATE;
+    ps.unit_size = page_size;
+    if ((area.properties & Area::HUGE_PAGES) && ProcSelfMaps::hugePageSize())
+        ps.unit_size = ProcSelfMaps::hugePageSize();
+    ps.entries = nullptr;
+    ps.chunk = nullptr;
+    ps.chunk_count = 0;
+
     while (area.size > 0) {
         size_t size;
         bool is_zero;
         Area a = area;
-        getNextPageRange(a, size, is_zero);
+        if (ss->toc_count < (ss->toc_capacity / 2)) {
+            getNextPageRange(&ps, static_cast<char*>(area.addr), size, is_zero);
+        }
+        else {
+            /* Stop splitting areas, so that there is enough room left in
+             * the table of contents for the remaining areas.
+             */
+            size = area.size;
+            is_zero = false;
+        }
 
-        a.properties = is_zero ? Area::ZERO_PAGE : Area::NONE;
+        a.properties = (area.properties & Area::HUGE_PAGES) | (is_zero ? Area::ZERO_PAGE : Area::NONE);
         a.size = size;
         void* endAddr = reinterpret_cast<void*>(reinterpret_cast<intptr_t>(area.addr) + size);
         a.endAddr = endAddr;
 
-        Utils::writeAll(fd, &a, sizeof(a));
+        writeAreaHeader(&a, ss);
         if (!is_zero) {
             debuglogstdio(LCF_CHECKPOINT, "Found non zero pages starting %p of size %d", a.addr, a.size);
-            Utils::writeAll(fd, a.addr, a.size);
+            writePages(ss, a.addr, a.size);
         }
         else {
             debuglogstdio(LCF_CHECKPOINT, "Found zero pages starting %p of size %d", a.addr, a.size);
+            StateStats::addZero(a.size);
         }
         area.addr = endAddr;
         area.size -= size;
     }
 }
 
-static void writeAnArea(int fd, Area *area)
+/* Pages that are not mapped read as zeros in anonymous areas, and as the
+ * file content in file-backed areas.
+ */
+static bool isAnonymousArea(Area *area)
+{
+    return (area->flags & MAP_ANONYMOUS) || (area->name[0] == '[');
+}
+
+static unsigned char getPageStatus(uint64_t entry, bool anonymous)
+{
+    if (!ProcSelfPagemap::isPresent(entry) && !ProcSelfPagemap::isSwapped(entry)) {
+        /* We don't know if the page was discarded since the base savestate,
+         * so we cannot refer to it.
+         */
+        return anonymous ? PAGE_ZERO : PAGE_DATA;
+    }
+
+    if (ProcSelfPagemap::isSoftDirty(entry))
+        return PAGE_DATA;
+
+    return PAGE_BASE;
+}
+
+/* Pages of a private file mapping that were never written still have the
+ * content of the file, and can be mapped again from it. Written pages were
+ * copied, and are not file pages anymore.
+ */
+static unsigned char getFilePageStatus(uint64_t entry)
+{
+    if (ProcSelfPagemap::isSwapped(entry))
+        return PAGE_DATA;
+
+    if (ProcSelfPagemap::isPresent(entry) && !ProcSelfPagemap::isFilePage(entry))
+        return PAGE_DATA;
+
+    return PAGE_FILE;
+}
+
+/* Write an area by only storing some of its pages, which are the pages
+ * modified since the base savestate for INCREMENTAL areas, or the pages that
+ * were written for FILE_PAGES areas. Pages are processed by chunks: the status
+ * of each page of the chunk is written, followed by the content of the stored
+ * pages.
+ */
+static void writeAnAreaWithStatus(Area *area, ProcSelfPagemap &pagemap, int property, SaveState *ss)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    area->properties |= property;
+    writeAreaHeader(area, ss);
+
+    bool anonymous = isAnonymousArea(area);
+    char* addr = static_cast<char*>(area->addr);
+    char* endAddr = static_cast<char*>(area->endAddr);
+    size_t stored_pages = 0;
+
+    while (addr < endAddr) {
+        size_t count = (endAddr - addr) / page_size;
+        if (count > CHUNK_PAGES)
+            count = CHUNK_PAGES;
+
+        unsigned char status[CHUNK_PAGES];
+        const uint64_t* entries = pagemap.getEntries(addr, count);
+        for (size_t i = 0; i < count; i++) {
+            /* If we could not read the page entries, store everything */
+            if (!entries)
+                status[i] = PAGE_DATA;
+            else if (property == Area::INCREMENTAL)
+                status[i] = getPageStatus(entries[i], anonymous);
+            else
+                status[i] = getFilePageStatus(entries[i]);
+        }
+        ss->out->writeCopy(status, count);
+
+        /* Write contiguous stored pages at once */
+        for (size_t i = 0; i < count;) {
+            size_t j = i + 1;
+            while ((j < count) && (status[j] == status[i]))
+                j++;
+            if (status[i] == PAGE_DATA) {
+                writePages(ss, addr + i * page_size, (j - i) * page_size);
+                stored_pages += j - i;
+            }
+            else if (status[i] == PAGE_ZERO) {
+                StateStats::addZero((j - i) * page_size);
+            }
+            i = j;
+        }
+
+        addr += count * page_size;
+    }
+
+    debuglogstdio(LCF_CHECKPOINT, "Stored %d pages out of %d", stored_pages, area->size / page_size);
+}
+
+static void writeAnArea(Area *area, ProcSelfPagemap &pagemap, bool incremental, SaveState *ss)
 {
     area->print("Save");
 
@@ -237,30 +854,91 @@ static void writeAnArea(int fd, Area *area)
         MYASSERT(mprotect(area->addr, area->size, area->prot | PROT_READ) == 0)
     }
 
-    if (area->flags & MAP_ANONYMOUS) {
+    if (incremental && !(area->flags & MAP_SHARED)) {
+        /* Shared areas can be modified by other processes, which is not
+         * tracked by the soft-dirty bits, so they are always fully stored.
+         */
+        writeAnAreaWithStatus(area, pagemap, Area::INCREMENTAL, ss);
+    }
+    else if (area->flags & MAP_ANONYMOUS) {
         /* We look for zero pages in anonymous sections and skip saving them */
-        writeAnAreaWithZeroPages(fd, area);
+        writeAnAreaWithZeroPages(area, pagemap, ss);
+    }
+    else if (ss->file_pages && (area->flags & MAP_PRIVATE) && (area->name[0] == '/')) {
+        /* Pages of private file mappings that were not written, such as most
+         * of the data sections of libraries, are mapped again from the file.
+         */
+        writeAnAreaWithStatus(area, pagemap, Area::FILE_PAGES, ss);
     }
     else {
-        Utils::writeAll(fd, area, sizeof(*area));
-        Utils::writeAll(fd, area->addr, area->size);
+        writeAreaHeader(area, ss);
+        writePages(ss, area->addr, area->size);
     }
 
     if ((area->prot & PROT_READ) == 0) {
+        /* Queued pages must be written while they are readable */
+        ss->out->flush();
         MYASSERT(mprotect(area->addr, area->size, area->prot) == 0)
     }
 }
 
-static void writeAllAreas()
+/* Write a savestate. If `base` is true, this is the base savestate of
+ * incremental savestates. If `forked` is true, we are in a child process
+ * created by the checkpoint handler.
+ */
+static void writeAllAreas(bool base, bool incremental, ProcSelfMaps &procSelfMaps, bool forked)
 {
-    debuglogstdio(LCF_CHECKPOINT, "Performing checkpoint in %s", savestatepath);
     int fd;
-    unlink(savestatepath);
-    OWNCALL(fd = creat(savestatepath, 0644));
+    if (base) {
+        debuglogstdio(LCF_CHECKPOINT, "Performing base checkpoint");
+        fd = SaveStateManager::openBaseState(true);
+    }
+    else {
+        debuglogstdio(LCF_CHECKPOINT, "Performing checkpoint in %s", savestatepath);
+        SaveStateManager::releasePages(savestateindex, savestatepath);
+        fd = SaveStateManager::openState(savestateindex, savestatepath, true);
+    }
     MYASSERT(fd != -1)
 
+    ProcSelfPagemap pagemap(ReservedMemory::getAddr(ReservedMemory::PAGEMAP_ADDR), ReservedMemory::PAGEMAP_SIZE);
+    pagemap.findZeroPage();
+
+    /* The base savestate is read at random locations, so it is never
+     * compressed.
+     */
+    BatchWriter out(fd);
+    DataWriter writer(&out, base ? SharedConfig::COMPRESSION_NONE : shared_config.savestate_compression);
+
+    SaveState ss;
+    ss.out = &out;
+    ss.writer = &writer;
+    ss.hashes = static_cast<uint64_t*>(ReservedMemory::getAddr(ReservedMemory::HASH_ADDR));
+    ss.hash_count = 0;
+    ss.hash_capacity = ReservedMemory::HASH_SIZE / sizeof(uint64_t);
+    ss.checksum = 0;
+    ss.toc = static_cast<StateTocEntry*>(ReservedMemory::getAddr(ReservedMemory::TOC_ADDR));
+    ss.toc_count = 0;
+    ss.toc_capacity = ReservedMemory::TOC_SIZE / sizeof(StateTocEntry);
+    ss.compression = writer.getCompression();
+
+    /* The base savestate must hold its pages, because it is read directly */
+    ss.pooled = !base && usePagePool(savestateindex);
+    ss.pool_size = 0;
+
+    /* The base savestate must hold all pages, because other savestates
+     * refer to them.
+     */
+    ss.file_pages = !base;
+    if (ss.pooled && !PagePool::hasRoom(ss.hash_capacity)) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "The page pool is full, pages are stored in the savestate");
+        ss.pooled = false;
+    }
+
     /* Saving the savestate header */
     StateHeader sh;
+    memset(&sh, 0, sizeof(sh));
+    memcpy(sh.magic, STATE_MAGIC, STATE_MAGIC_SIZE);
+    sh.version = STATE_VERSION;
     int n=0;
     for (ThreadInfo *thread = ThreadManager::thread_list; thread != nullptr; thread = thread->next) {
         if (thread->state == ThreadInfo::ST_SUSPENDED) {
@@ -269,36 +947,578 @@ static void writeAllAreas()
         }
     }
     sh.thread_count = n;
-    Utils::writeAll(fd, &sh, sizeof(sh));
+    sh.compression = writer.getCompression();
+    sh.pool_id = ss.pooled ? PagePool::getId() : 0;
+    sh.incremental = !base && incremental;
+    getExecutionInfo(&sh);
+    out.writeCopy(&sh, sizeof(sh));
 
-    /* Parse the content of /proc/self/maps into memory.
-     * We don't allocate memory here, we are using our special allocated
-     * memory section that won't be saved in the savestate.
-     */
-    ProcSelfMaps procSelfMaps(ReservedMemory::getAddr(0), ONE_MB);
+    StateStats::begin(false);
+
+    procSelfMaps.reset();
 
     Area area;
     while (procSelfMaps.getNextArea(&area)) {
 
-        if (skipArea(&area)) {
+        /* Areas marked with MADV_DONTFORK are not mapped in a child process.
+         * We still save them as skipped, so that they are not deallocated
+         * when loading the savestate.
+         */
+        if (skipArea(&area) || (forked && (msync(area.addr, area.size, MS_ASYNC) != 0))) {
             area.properties |= Area::SKIP;
-            Utils::writeAll(fd, &area, sizeof(area));
+            writeAreaHeader(&area, &ss);
             continue;
         }
 
-        writeAnArea(fd, &area);
+        StateStats::startArea(&area);
+        writeAnArea(&area, pagemap, !base && incremental, &ss);
     }
 
+    StateStats::end();
+
     area.addr = nullptr; // End of data
     area.size = 0; // End of data
-    Utils::writeAll(fd, &area, sizeof(area));
+    area.properties = Area::NONE;
+    area.name[0] = '\0';
+    writeAreaHeader(&area, &ss);
+
+    /* Write the page hashes, and update the header with their location. If
+     * we stored too many pages, the remaining ones don't have a hash.
+     */
+    sh.hash_offset = out.tell();
+    sh.hash_count = (ss.hash_count < ss.hash_capacity) ? ss.hash_count : ss.hash_capacity;
+    out.write(ss.hashes, sh.hash_count * sizeof(uint64_t));
+
+    /* Write the table of contents */
+    sh.toc_offset = out.tell();
+    if (ss.toc_count <= ss.toc_capacity) {
+        sh.toc_count = ss.toc_count;
+        out.write(ss.toc, sh.toc_count * sizeof(StateTocEntry));
+    }
+    else {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Too many areas to write the table of contents");
+        sh.toc_count = 0;
+    }
+
+    sh.pool_size = ss.pool_size;
+
+    out.flush();
+    MYASSERT(pwrite(fd, &sh, sizeof(sh), 0) == sizeof(sh))
 
     /* That's all folks */
-    MYASSERT(close(fd) == 0);
+    SaveStateManager::closeState(fd, true);
 }
 
 
-static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
+/* Read the header of the next area of the base savestate */
+static void readNextBaseArea(RestoreState *rs)
+{
+    if (rs->base_toc_count > 0) {
+        StateTocEntry entry;
+        if ((rs->base_toc_index >= rs->base_toc_count) ||
+            (Utils::preadAll(rs->base_fd, &entry, sizeof(entry), rs->base_toc_offset + rs->base_toc_index * sizeof(entry)) != sizeof(entry))) {
+            rs->base_area.addr = nullptr;
+            return;
+        }
+
+        rs->base_toc_index++;
+        rs->base_area.addr = reinterpret_cast<void*>(entry.addr);
+        rs->base_area.size = entry.size;
+        rs->base_area.endAddr = reinterpret_cast<void*>(entry.addr + entry.size);
+        rs->base_area.properties = entry.properties;
+        rs->base_data_offset = entry.data_offset;
+        return;
+    }
+
+    /* The base savestate is never compressed */
+    off_t data_offset = preadAreaDescriptor(rs->base_fd, rs->base_next_offset, &rs->base_area, SharedConfig::COMPRESSION_NONE);
+    if ((data_offset == -1) || (rs->base_area.addr == nullptr)) {
+        rs->base_area.addr = nullptr;
+        return;
+    }
+
+    rs->base_data_offset = data_offset;
+    rs->base_next_offset = data_offset;
+    if (!(rs->base_area.properties & (Area::ZERO_PAGE | Area::SKIP)))
+        rs->base_next_offset += rs->base_area.size;
+}
+
+/* Copy memory from the base savestate */
+static void restoreFromBase(RestoreState *rs, char* addr, size_t size)
+{
+    if (rs->base_fd == -1) {
+        rs->base_fd = SaveStateManager::openBaseState(false);
+        if (rs->base_fd == -1) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not open the base savestate");
+            return;
+        }
+
+        StateHeader sh;
+        if (!readStateHeader(rs->base_fd, &sh) || (sh.version != STATE_VERSION)) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Invalid base savestate");
+            SaveStateManager::closeState(rs->base_fd, false);
+            rs->base_fd = -1;
+            return;
+        }
+        rs->base_toc_offset = sh.toc_offset;
+        rs->base_toc_count = sh.toc_count;
+        rs->base_area.addr = nullptr;
+    }
+
+    while (size > 0) {
+        if ((rs->base_area.addr == nullptr) || (addr < rs->base_area.addr)) {
+            /* Start again from the beginning of the base savestate */
+            rs->base_next_offset = sizeof(StateHeader);
+            rs->base_toc_index = 0;
+            readNextBaseArea(rs);
+        }
+
+        while ((rs->base_area.addr != nullptr) && (rs->base_area.endAddr <= addr)) {
+            readNextBaseArea(rs);
+        }
+
+        if ((rs->base_area.addr == nullptr) || (addr < rs->base_area.addr) ||
+            (rs->base_area.properties & Area::SKIP)) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not find %p in the base savestate", addr);
+            return;
+        }
+
+        char* baseAddr = static_cast<char*>(rs->base_area.addr);
+        size_t copy_size = static_cast<char*>(rs->base_area.endAddr) - addr;
+        if (copy_size > size)
+            copy_size = size;
+
+        if (rs->base_area.properties & Area::ZERO_PAGE) {
+            memset(addr, 0, copy_size);
+            StateStats::addZero(copy_size);
+        }
+        else {
+            Utils::preadAll(rs->base_fd, addr, copy_size, rs->base_data_offset + (addr - baseAddr));
+            StateStats::addData(copy_size);
+        }
+
+        addr += copy_size;
+        size -= copy_size;
+    }
+}
+
+static bool isPageModified(uint64_t entry)
+{
+    return ProcSelfPagemap::isSoftDirty(entry) ||
+        (!ProcSelfPagemap::isPresent(entry) && !ProcSelfPagemap::isSwapped(entry));
+}
+
+/* Restore pages that have the same content as in the base savestate. Only the
+ * pages that were modified since the base savestate need to be copied.
+ */
+static void restoreBasePages(RestoreState *rs, char* addr, size_t count)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    const uint64_t* entries = rs->pagemap->getEntries(addr, count);
+
+    for (size_t i = 0; i < count;) {
+        bool modified = entries ? isPageModified(entries[i]) : true;
+        size_t j = i + 1;
+        while ((j < count) && ((entries ? isPageModified(entries[j]) : true) == modified))
+            j++;
+        if (modified)
+            restoreFromBase(rs, addr + i * page_size, (j - i) * page_size);
+        i = j;
+    }
+}
+
+/* Get the hash of a stored page that was computed when saving */
+static bool getStoredHash(RestoreState *rs, size_t index, uint64_t *hash)
+{
+    if (index >= rs->hash_count)
+        return false;
+
+    if ((index < rs->hashes_start) || (index >= (rs->hashes_start + rs->hashes_len))) {
+        /* Read the next chunk of hashes */
+        size_t len = rs->hash_count - index;
+        if (len > CHUNK_PAGES)
+            len = CHUNK_PAGES;
+        ssize_t size = len * sizeof(uint64_t);
+        if (Utils::preadAll(rs->fd, rs->hashes, size, rs->hash_offset + index * sizeof(uint64_t)) != size) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not read page hashes");
+            rs->hash_count = 0;
+            return false;
+        }
+        rs->hashes_start = index;
+        rs->hashes_len = len;
+    }
+
+    *hash = rs->hashes[index - rs->hashes_start];
+    return true;
+}
+
+/* Read `count` stored pages starting with the stored page of index `index`,
+ * or skip them. Pages with a hash are read from the page pool if it is used,
+ * and the others from the savestate.
+ */
+static void readStoredPages(RestoreState *rs, char* addr, size_t index, size_t count, bool skip)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    for (; (count > 0) && (index < rs->pooled_count); addr += page_size, index++, count--) {
+        if (skip)
+            continue;
+
+        uint64_t hash;
+        if (!getStoredHash(rs, index, &hash) || !PagePool::readPage(hash, addr)) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not find page %p in the page pool", addr);
+        }
+        StateStats::addData(page_size);
+    }
+
+    if (count == 0)
+        return;
+
+    if (skip) {
+        rs->reader->skip(count * page_size);
+    }
+    else {
+        rs->reader->read(addr, count * page_size);
+        StateStats::addData(count * page_size);
+    }
+}
+
+/* Read stored pages into memory. Pages that already have the right content
+ * are skipped, either because they were not modified since this savestate
+ * was last saved or loaded, or because they have the same hash as when they
+ * were saved. This avoids copying them, and keeps them clean for the
+ * soft-dirty tracking.
+ */
+static void readPages(RestoreState *rs, char* addr, size_t count, bool skip)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    if (skip) {
+        readStoredPages(rs, addr, rs->hash_index, count, true);
+        rs->hash_index += count;
+        return;
+    }
+
+    while (count > 0) {
+        size_t n = (count < CHUNK_PAGES) ? count : CHUNK_PAGES;
+        const uint64_t* entries = rs->pagemap->getEntries(addr, n);
+
+        bool same[CHUNK_PAGES];
+        bool compare[CHUNK_PAGES];
+        uint64_t stored[CHUNK_PAGES];
+        for (size_t i = 0; i < n; i++) {
+            same[i] = false;
+            compare[i] = false;
+            if (!entries)
+                continue;
+
+            if (rs->tracked && !isPageModified(entries[i])) {
+                same[i] = true;
+                continue;
+            }
+
+            /* Don't look at pages that are not mapped, because reading them
+             * would needlessly allocate them.
+             */
+            if (!ProcSelfPagemap::isPresent(entries[i]) && !ProcSelfPagemap::isSwapped(entries[i]))
+                continue;
+
+            compare[i] = getStoredHash(rs, rs->hash_index + i, &stored[i]);
+        }
+
+        /* Hash the current content of pages in parallel */
+        uint64_t current[CHUNK_PAGES];
+        hashPages(addr, n, current, compare);
+        for (size_t i = 0; i < n; i++) {
+            if (compare[i])
+                same[i] = (current[i] == stored[i]);
+        }
+
+        for (size_t i = 0; i < n;) {
+            size_t j = i + 1;
+            while ((j < n) && (same[j] == same[i]))
+                j++;
+            readStoredPages(rs, addr + i * page_size, rs->hash_index + i, j - i, same[i]);
+            i = j;
+        }
+
+        addr += n * page_size;
+        count -= n;
+        rs->hash_index += n;
+    }
+}
+
+/* Returns if a page must be filled with zeros */
+static bool mustZeroPage(RestoreState *rs, uint64_t entry, bool is_private)
+{
+    /* Pages of private mappings that are not mapped already read as zeros,
+     * and writing to them would allocate them.
+     */
+    if (is_private && !ProcSelfPagemap::isPresent(entry) && !ProcSelfPagemap::isSwapped(entry))
+        return false;
+
+    if (rs->tracked && !isPageModified(entry))
+        return false;
+
+    return true;
+}
+
+/* Restore pages lazily. The region is registered for the pages to be filled
+ * from the savestate when they are accessed, and pages that don't already
+ * have the right content are unmapped.
+ */
+static void lazyPages(RestoreState *rs, char* addr, size_t count)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    /* Data of fully stored areas is not compressed, so this is its location */
+    off_t offset = lseek(rs->fd, 0, SEEK_CUR);
+    if ((offset == -1) || !LazyRestore::addRegion(addr, count * page_size, offset)) {
+        readPages(rs, addr, count, false);
+        return;
+    }
+
+    char* chunk = addr;
+    size_t remaining = count;
+    while (remaining > 0) {
+        size_t n = (remaining < CHUNK_PAGES) ? remaining : CHUNK_PAGES;
+        const uint64_t* entries = rs->pagemap->getEntries(chunk, n);
+
+        bool drop[CHUNK_PAGES];
+        for (size_t i = 0; i < n; i++) {
+            if (!entries) {
+                drop[i] = true;
+                continue;
+            }
+
+            /* Pages that are not mapped are already filled when accessed */
+            bool mapped = ProcSelfPagemap::isPresent(entries[i]) || ProcSelfPagemap::isSwapped(entries[i]);
+            drop[i] = mapped && !(rs->tracked && !isPageModified(entries[i]));
+        }
+
+        for (size_t i = 0; i < n;) {
+            size_t j = i + 1;
+            while ((j < n) && (drop[j] == drop[i]))
+                j++;
+            if (drop[i]) {
+                MYASSERT(madvise(chunk + i * page_size, (j - i) * page_size, MADV_DONTNEED) == 0)
+            }
+            i = j;
+        }
+
+        chunk += n * page_size;
+        remaining -= n;
+    }
+
+    rs->reader->skip(count * page_size);
+    rs->hash_index += count;
+}
+
+/* Fill pages with zeros, skipping pages that were not modified since this
+ * savestate was last saved or loaded, and pages that are not mapped.
+ */
+static void zeroPages(RestoreState *rs, char* addr, size_t count, bool is_private)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    while (count > 0) {
+        size_t n = (count < CHUNK_PAGES) ? count : CHUNK_PAGES;
+        const uint64_t* entries = rs->pagemap->getEntries(addr, n);
+
+        for (size_t i = 0; i < n;) {
+            bool zero = entries ? mustZeroPage(rs, entries[i], is_private) : true;
+            size_t j = i + 1;
+            while ((j < n) && ((entries ? mustZeroPage(rs, entries[j], is_private) : true) == zero))
+                j++;
+            if (zero) {
+                memset(addr + i * page_size, 0, (j - i) * page_size);
+                StateStats::addZero((j - i) * page_size);
+            }
+            i = j;
+        }
+
+        addr += n * page_size;
+        count -= n;
+    }
+}
+
+/* Restore pages of a private file mapping that have the content of the file.
+ * Pages that were written since are mapped again from the file, which drops
+ * their copy.
+ */
+static void restoreFilePages(RestoreState *rs, Area *saved_area, char* addr, size_t count)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    /* The file could not be mapped when the area was created */
+    if (saved_area->flags & MAP_ANONYMOUS) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Pages of %s are not restored", saved_area->name);
+        return;
+    }
+
+    int imagefd = -1;
+    char* chunk = addr;
+    while (count > 0) {
+        size_t n = (count < CHUNK_PAGES) ? count : CHUNK_PAGES;
+        const uint64_t* entries = rs->pagemap->getEntries(chunk, n);
+
+        bool remap[CHUNK_PAGES];
+        for (size_t i = 0; i < n; i++)
+            remap[i] = entries ? (getFilePageStatus(entries[i]) == PAGE_DATA) : true;
+
+        for (size_t i = 0; i < n;) {
+            size_t j = i + 1;
+            while ((j < n) && (remap[j] == remap[i]))
+                j++;
+
+            if (remap[i]) {
+                if (imagefd == -1) {
+                    imagefd = open(saved_area->name, O_RDONLY, 0);
+
+                    /* Make sure that this is still the same file */
+                    struct stat st;
+                    if ((imagefd >= 0) && ((fstat(imagefd, &st) != 0) ||
+                        (st.st_ino != saved_area->inodenum) ||
+                        (major(st.st_dev) != saved_area->devmajor) ||
+                        (minor(st.st_dev) != saved_area->devminor))) {
+                        close(imagefd);
+                        imagefd = -1;
+                    }
+                    if (imagefd < 0) {
+                        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not map pages of %s again", saved_area->name);
+                        return;
+                    }
+                }
+
+                char* pages = chunk + i * page_size;
+                off_t offset = saved_area->offset + (pages - static_cast<char*>(saved_area->addr));
+                void* mmappedat = mmap(pages, (j - i) * page_size, saved_area->prot | PROT_READ | PROT_WRITE,
+                    saved_area->flags, imagefd, offset);
+                MYASSERT(mmappedat == pages)
+            }
+            i = j;
+        }
+
+        chunk += n * page_size;
+        count -= n;
+    }
+
+    if (imagefd >= 0)
+        close(imagefd);
+}
+
+/* Read the header of the next saved area */
+static void readAreaHeader(int fd, Area *saved_area, RestoreState *rs)
+{
+    if (rs->version == 1) {
+        Utils::readAll(fd, saved_area, sizeof(*saved_area));
+    }
+    else {
+        off_t offset = preadAreaDescriptor(fd, lseek(fd, 0, SEEK_CUR), saved_area, rs->compression);
+        if (offset == -1) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not read the next area of the savestate");
+            saved_area->addr = nullptr;
+            saved_area->size = 0;
+        }
+        else {
+            MYASSERT(lseek(fd, offset, SEEK_SET) == offset)
+        }
+    }
+    rs->status_count = 0;
+    rs->status_index = 0;
+
+    if ((saved_area->addr != nullptr) && !(saved_area->properties & Area::SKIP))
+        StateStats::startArea(saved_area);
+}
+
+/* Restore `size` bytes of memory starting at the beginning of the saved area,
+ * or skip them in the savestate if `skip` is true.
+ */
+static void readAreaData(int fd, Area *saved_area, size_t size, RestoreState *rs, bool skip)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    char* addr = static_cast<char*>(saved_area->addr);
+    char* endAddr = static_cast<char*>(saved_area->endAddr);
+    size_t count = size / page_size;
+
+    bool is_private = saved_area->flags & MAP_PRIVATE;
+
+    if (saved_area->properties & Area::ZERO_PAGE) {
+        if (!skip)
+            zeroPages(rs, addr, count, is_private);
+        return;
+    }
+
+    if (!(saved_area->properties & (Area::INCREMENTAL | Area::FILE_PAGES))) {
+        /* Only private anonymous memory can be filled using userfaultfd.
+         * Pages are filled one at a time, which would split huge pages.
+         */
+        if (!skip && rs->lazy && is_private && (saved_area->flags & MAP_ANONYMOUS) &&
+            !(saved_area->properties & Area::HUGE_PAGES))
+            lazyPages(rs, addr, count);
+        else
+            readPages(rs, addr, count, skip);
+        return;
+    }
+
+    while (count > 0) {
+        if (rs->status_index == rs->status_count) {
+            /* Read the status of the next chunk of pages */
+            rs->status_count = (endAddr - addr) / page_size;
+            if (rs->status_count > CHUNK_PAGES)
+                rs->status_count = CHUNK_PAGES;
+            rs->status_index = 0;
+            Utils::readAll(fd, rs->status, rs->status_count);
+        }
+
+        /* Process contiguous pages with the same status at once */
+        unsigned char status = rs->status[rs->status_index];
+        size_t n = 1;
+        while ((n < count) && ((rs->status_index + n) < rs->status_count) &&
+            (rs->status[rs->status_index + n] == status))
+            n++;
+
+        switch (status) {
+            case PAGE_DATA:
+                readPages(rs, addr, n, skip);
+                break;
+            case PAGE_ZERO:
+                if (!skip)
+                    zeroPages(rs, addr, n, is_private);
+                break;
+            case PAGE_BASE:
+                if (!skip)
+                    restoreBasePages(rs, addr, n);
+                break;
+            case PAGE_FILE:
+                if (!skip)
+                    restoreFilePages(rs, saved_area, addr, n);
+                break;
+        }
+
+        addr += n * page_size;
+        count -= n;
+        rs->status_index += n;
+    }
+}
+
+/* If the saved area was backed by transparent huge pages, advise the kernel
+ * to use them for the restored region, so that it keeps its layout and is not
+ * faulted in one small page at a time.
+ */
+static void adviseHugePages(const Area *saved_area, void* addr, size_t size)
+{
+    if (!(saved_area->properties & Area::HUGE_PAGES) || !ProcSelfMaps::hugePageSize())
+        return;
+
+    /* This fails on mappings that cannot use huge pages, which is harmless */
+    if (madvise(addr, size, MADV_HUGEPAGE) != 0)
+        debuglogstdio(LCF_CHECKPOINT, "Could not use huge pages for %p", addr);
+}
+
+static int readAndCompAreas(int fd, Area *saved_area, Area *current_area, RestoreState *rs)
 {
     /* Do Areas start on the same address? */
     if ((saved_area->addr != nullptr) && (current_area->addr != nullptr) &&
@@ -327,13 +1547,13 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
 
                 if (newAddr == MAP_FAILED) {
                     debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Resizing failed");
-                    lseek(fd, saved_area->size, SEEK_CUR);
+                    readAreaData(fd, saved_area, saved_area->size, rs, true);
                     return 0;
                 }
 
                 if (newAddr != saved_area->addr) {
                     debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "mremap relocated the area");
-                    lseek(fd, saved_area->size, SEEK_CUR);
+                    readAreaData(fd, saved_area, saved_area->size, rs, true);
                     return 0;
                 }
 
@@ -348,7 +1568,7 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
 
                 if (ret < 0) {
                     debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "brk failed");
-                    lseek(fd, saved_area->size, SEEK_CUR);
+                    readAreaData(fd, saved_area, saved_area->size, rs, true);
                     return 0;
                 }
 
@@ -356,21 +1576,21 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
             }
         }
 
-        /* Now copy the data */
-        if (!(current_area->prot & PROT_WRITE)) {
-            MYASSERT(mprotect(current_area->addr, copy_size, current_area->prot | PROT_WRITE) == 0)
+        /* Now copy the data. Memory must also be readable, because we compare
+         * its content with the savestate.
+         */
+        bool rw = ((current_area->prot & (PROT_READ | PROT_WRITE)) == (PROT_READ | PROT_WRITE));
+        if (!rw) {
+            MYASSERT(mprotect(current_area->addr, copy_size, current_area->prot | PROT_READ | PROT_WRITE) == 0)
         }
 
-        if (saved_area->properties & Area::ZERO_PAGE) {
-            debuglogstdio(LCF_CHECKPOINT, "Writing %d zero bytes to memory!", copy_size);
-            memset(saved_area->addr, 0, copy_size);
-        }
-        else {
-            debuglogstdio(LCF_CHECKPOINT, "Writing %d bytes to memory!", copy_size);
-            Utils::readAll(fd, saved_area->addr, copy_size);
-        }
+        if (!(current_area->properties & Area::HUGE_PAGES))
+            adviseHugePages(saved_area, current_area->addr, copy_size);
+
+        debuglogstdio(LCF_CHECKPOINT, "Writing %d bytes to memory!", copy_size);
+        readAreaData(fd, saved_area, copy_size, rs, false);
 
-        if (!(current_area->prot & PROT_WRITE)) {
+        if (!rw) {
             MYASSERT(mprotect(current_area->addr, copy_size, current_area->prot) == 0)
         }
 
@@ -387,6 +1607,8 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
              */
             saved_area->addr = current_area->endAddr;
             saved_area->size -= copy_size;
+            if (!(saved_area->flags & MAP_ANONYMOUS))
+                saved_area->offset += copy_size;
             return 1;
         }
 
@@ -414,7 +1636,7 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
             /* We call this function again with the rest of the area */
             current_area->addr = saved_area->addr;
             current_area->size -= unmap_size;
-            return readAndCompAreas(fd, saved_area, current_area);
+            return readAndCompAreas(fd, saved_area, current_area, rs);
         }
         else {
             /* Areas are not overlapping, we unmap the whole area */
@@ -477,17 +1699,17 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
 
         /* Create the memory area */
 
-        void *mmappedat = mmap(saved_area->addr, map_size, saved_area->prot | PROT_WRITE,
+        void *mmappedat = mmap(saved_area->addr, map_size, saved_area->prot | PROT_READ | PROT_WRITE,
             saved_area->flags, imagefd, saved_area->offset);
 
         if (mmappedat == MAP_FAILED) {
             debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Mapping %d bytes at %p failed", saved_area->size, saved_area->addr);
-            lseek(fd, map_size, SEEK_CUR);
+            readAreaData(fd, saved_area, saved_area->size, rs, true);
             return -1;
         }
         if (mmappedat != saved_area->addr) {
             debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Area at %p got mmapped to %p", saved_area->addr, mmappedat);
-            lseek(fd, map_size, SEEK_CUR);
+            readAreaData(fd, saved_area, saved_area->size, rs, true);
             return -1;
         }
 
@@ -496,14 +1718,10 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
             close(imagefd);
         }
 
-        if (saved_area->properties & Area::ZERO_PAGE) {
-            memset(saved_area->addr, 0, map_size);
-        }
-        else {
-            Utils::readAll(fd, saved_area->addr, map_size);
-        }
+        adviseHugePages(saved_area, saved_area->addr, map_size);
+        readAreaData(fd, saved_area, map_size, rs, false);
 
-        if (!(saved_area->prot & PROT_WRITE)) {
+        if ((saved_area->prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE)) {
             MYASSERT(mprotect(saved_area->addr, map_size, saved_area->prot) == 0)
         }
 
@@ -511,7 +1729,9 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
             /* If areas were overlapping, we must deal with the rest of the area */
             saved_area->addr = current_area->addr;
             saved_area->size -= map_size;
-            return readAndCompAreas(fd, saved_area, current_area);
+            if (!(saved_area->flags & MAP_ANONYMOUS))
+                saved_area->offset += map_size;
+            return readAndCompAreas(fd, saved_area, current_area, rs);
         }
 
         return -1;
@@ -524,13 +1744,22 @@ static int readAndCompAreas(int fd, Area *saved_area, Area *current_area)
 
 static void readAllAreas()
 {
-    int fd;
-    OWNCALL(fd = open(savestatepath, O_RDONLY));
+    /* Static variables will be overwritten, so we keep a copy of them */
+    int index = savestateindex;
+    bool incremental = shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL;
+    bool lazy = shared_config.savestate_settings & SharedConfig::SS_LAZY;
+
+    /* Pages that were not filled yet by a previous lazy restore are all
+     * overwritten by this restore.
+     */
+    LazyRestore::cancel();
+
+    int fd = SaveStateManager::openState(index, savestatepath, false);
     MYASSERT(fd != -1)
 
     /* Read the savestate header */
     StateHeader sh;
-    Utils::readAll(fd, &sh, sizeof(sh));
+    MYASSERT(readStateHeader(fd, &sh))
 
     Area current_area;
     Area saved_area;
@@ -538,10 +1767,34 @@ static void readAllAreas()
     debuglogstdio(LCF_CHECKPOINT, "Performing restore.");
 
     /* Read the memory mapping */
-    ProcSelfMaps procSelfMaps(ReservedMemory::getAddr(0), ONE_MB);
+    ProcSelfMaps procSelfMaps(ReservedMemory::getAddr(ReservedMemory::PSM_ADDR), ReservedMemory::PSM_SIZE);
+
+    ProcSelfPagemap pagemap(ReservedMemory::getAddr(ReservedMemory::PAGEMAP_ADDR), ReservedMemory::PAGEMAP_SIZE);
+    DataReader reader(fd, sh.compression);
+
+    RestoreState rs;
+    rs.pagemap = &pagemap;
+    rs.reader = &reader;
+    rs.version = sh.version;
+    rs.compression = sh.compression;
+    rs.pooled_count = (sh.pool_id != 0) ? sh.hash_count : 0;
+    rs.lazy = lazy && (sh.version == STATE_VERSION) && (sh.pool_id == 0) &&
+        (sh.compression == SharedConfig::COMPRESSION_NONE) && LazyRestore::begin(fd);
+    rs.tracked = (SaveStateManager::getTrackedSlot() == index);
+    rs.fd = fd;
+    rs.hash_offset = sh.hash_offset;
+    rs.hash_count = sh.hash_count;
+    rs.hash_index = 0;
+    rs.hashes_start = 0;
+    rs.hashes_len = 0;
+    rs.base_fd = -1;
+    rs.base_toc_count = 0;
+    rs.base_toc_index = 0;
+
+    StateStats::begin(true);
 
     /* Read the first saved area */
-    Utils::readAll(fd, &saved_area, sizeof saved_area);
+    readAreaHeader(fd, &saved_area, &rs);
 
     /* Read the first current area */
     bool not_eof = procSelfMaps.getNextArea(&current_area);
@@ -549,10 +1802,10 @@ static void readAllAreas()
     while ((saved_area.addr != nullptr) || not_eof) {
 
         /* Check for matching areas */
-        int cmp = readAndCompAreas(fd, &saved_area, &current_area);
+        int cmp = readAndCompAreas(fd, &saved_area, &current_area, &rs);
         if (cmp == 0) {
             /* Areas matched, we advance both areas */
-            Utils::readAll(fd, &saved_area, sizeof saved_area);
+            readAreaHeader(fd, &saved_area, &rs);
             not_eof = procSelfMaps.getNextArea(&current_area);
         }
         if (cmp > 0) {
@@ -561,12 +1814,49 @@ static void readAllAreas()
         }
         if (cmp < 0) {
             /* Saved area is smaller, advance saved area */
-            Utils::readAll(fd, &saved_area, sizeof saved_area);
+            readAreaHeader(fd, &saved_area, &rs);
         }
     }
 
+    StateStats::end();
+
     /* That's all folks */
-    MYASSERT(close(fd) == 0);
+    SaveStateManager::closeState(fd, false);
+    if (rs.base_fd != -1)
+        SaveStateManager::closeState(rs.base_fd, false);
+
+    /* Memory now holds the content of this savestate, start tracking the
+     * pages that will be modified. Incremental savestates already use the
+     * soft-dirty bits to track the pages modified since the base savestate.
+     */
+    if (!incremental) {
+        bool tracked = ProcSelfPagemap::clearSoftDirty(ReservedMemory::getAddr(ReservedMemory::PAGEMAP_ADDR));
+        SaveStateManager::setTrackedSlot(tracked ? index : -1);
+    }
+}
+
+/* Count the size of the areas matched by each exclusion rule of the user,
+ * among the areas that would be saved otherwise.
+ */
+static void auditRules(ProcSelfMaps &procSelfMaps)
+{
+    MemoryRules::beginAudit();
+
+    procSelfMaps.reset();
+
+    Area area;
+    while (procSelfMaps.getNextArea(&area))
+        skipArea(&area, true);
+
+    MemoryRules::endAudit();
+}
+
+/* Write the base savestate if needed, then the savestate */
+static void writeSavestates(bool write_base, bool incremental, ProcSelfMaps &procSelfMaps, bool forked)
+{
+    if (write_base)
+        writeAllAreas(true, false, procSelfMaps, forked);
+    writeAllAreas(false, incremental, procSelfMaps, forked);
 }
 
 void Checkpoint::handler(int signum)
@@ -609,10 +1899,24 @@ void Checkpoint::handler(int signum)
         // xcb_connection_t *cur_xcb_conn = XGetXCBConnection(display);
         // memcpy(&xcb_conn, cur_xcb_conn, sizeof(xcb_connection_t));
 
+        /* The thread list is overwritten too, so we keep the tid of each
+         * thread, which differs if the savestate comes from another execution
+         * of the game.
+         */
+        pthread_t pthread_ids[STATEMAXTHREADS];
+        pid_t tids[STATEMAXTHREADS];
+        int thread_count = 0;
+        for (ThreadInfo *thread = ThreadManager::thread_list; (thread != nullptr) && (thread_count < STATEMAXTHREADS); thread = thread->next) {
+            pthread_ids[thread_count] = thread->pthread_id;
+            tids[thread_count++] = thread->tid;
+        }
+
         readAllAreas();
         /* restoreInProgress was overwritten, putting the right value again */
         ThreadManager::restoreInProgress = true;
 
+        ThreadManager::updateTids(pthread_ids, tids, thread_count);
+
         /* Restoring the display values */
 #ifdef X_DPY_SET_LAST_REQUEST_READ
         X_DPY_SET_LAST_REQUEST_READ(display, last_request_read);
@@ -626,7 +1930,100 @@ void Checkpoint::handler(int signum)
         // memcpy(cur_xcb_conn, &xcb_conn, sizeof(xcb_connection_t));
     }
     else {
-        writeAllAreas();
+        /* Memory must hold its whole content to be saved */
+        LazyRestore::finish();
+
+        if (usePagePool(savestateindex)) {
+            /* Only one process may add pages to the page pool at a time. The
+             * pool file must be opened here, so that it is shared with a
+             * forked process.
+             */
+            SaveStateManager::waitForAllForks();
+            PagePool::open();
+            PagePool::compact();
+        }
+
+        bool incremental = shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL;
+        bool write_base = false;
+        if (incremental && !SaveStateManager::hasBaseState()) {
+            /* Incremental savestates need a full savestate to refer to.
+             * Soft-dirty bits are cleared before writing it, so that pages
+             * modified during the checkpoint are still tracked.
+             */
+            write_base = ProcSelfPagemap::clearSoftDirty(ReservedMemory::getAddr(ReservedMemory::PAGEMAP_ADDR));
+        }
+        else if (!incremental) {
+            /* Track the pages modified after this savestate, so that loading
+             * it again only restores those. Soft-dirty bits are cleared
+             * before writing the savestate for the same reason as above.
+             */
+            bool tracked = ProcSelfPagemap::clearSoftDirty(ReservedMemory::getAddr(ReservedMemory::PAGEMAP_ADDR));
+            SaveStateManager::setTrackedSlot(tracked ? savestateindex : -1);
+        }
+
+        /* If we have a base savestate, we only store the modified pages */
+        incremental = incremental && (write_base || SaveStateManager::hasBaseState());
+
+        /* Read the content of /proc/self/maps by chunks.
+         * We don't allocate memory here, we are using our special allocated
+         * memory section that won't be saved in the savestate.
+         * When forking, we need the flags of the areas, so that the ones
+         * marked with MADV_DONTFORK are not merged with other areas.
+         */
+        bool fork_state = (shared_config.savestate_settings & SharedConfig::SS_FORK);
+        ProcSelfMaps procSelfMaps(ReservedMemory::getAddr(ReservedMemory::PSM_ADDR), ReservedMemory::PSM_SIZE, fork_state);
+
+        /* A child process cannot read our mappings from its own
+         * /proc/self/maps, because areas marked with MADV_DONTFORK are
+         * missing, so they must all be read beforehand.
+         */
+        if (fork_state && !procSelfMaps.snapshot()) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Too many memory areas, writing the savestate directly");
+            fork_state = false;
+        }
+
+        if (shared_config.savestate_settings & SharedConfig::SS_AUDIT_RULES)
+            auditRules(procSelfMaps);
+
+        if (fork_state) {
+            /* The previous savestate of this slot must be fully written */
+            SaveStateManager::waitForFork(savestateindex);
+
+            /* In-memory savestates must be created before forking, so that
+             * we share their file descriptors with the child process.
+             */
+            SaveStateManager::prepareState(savestateindex);
+            if (write_base)
+                SaveStateManager::prepareState(SAVESTATE_BASE_SLOT);
+
+            /* Write the savestate from a child process, which gets a
+             * copy-on-write image of our memory, so that the game can resume
+             * right away. We call the clone syscall directly, with no signal
+             * sent on exit, so that libc fork handlers are not executed and
+             * the game does not notice the child process.
+             */
+            pid_t pid = syscall(SYS_clone, 0, 0, 0, 0, 0);
+            if (pid == 0) {
+                writeSavestates(write_base, incremental, procSelfMaps, true);
+                syscall(SYS_exit, 0);
+            }
+
+            if (pid == -1) {
+                debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not fork, writing the savestate directly");
+                writeSavestates(write_base, incremental, procSelfMaps, false);
+            }
+            else {
+                SaveStateManager::setForkPid(savestateindex, pid);
+                if (write_base)
+                    SaveStateManager::setForkPid(SAVESTATE_BASE_SLOT, pid);
+            }
+        }
+        else {
+            writeSavestates(write_base, incremental, procSelfMaps, false);
+        }
+
+        if (write_base)
+            SaveStateManager::setBaseState(true);
     }
     debuglogstdio(LCF_CHECKPOINT, "End restore.");
 }
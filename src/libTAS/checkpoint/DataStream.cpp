@@ -0,0 +1,340 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DataStream.h"
+#include "ReservedMemory.h"
+#include "Utils.h"
+#include "HelperThreads.h"
+#include "BatchWriter.h"
+#include "../logging.h"
+#include "../../shared/SharedConfig.h"
+#include <cstring>
+#include <unistd.h>
+
+#ifdef LIBTAS_ENABLE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef LIBTAS_ENABLE_ZSTD
+/* Needed for using a preallocated context */
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#endif
+
+namespace libtas {
+
+#ifdef LIBTAS_ENABLE_ZSTD
+/* Favor compression speed, this is already much smaller than lz4 */
+#define ZSTD_LEVEL 3
+#endif
+
+static_assert(DATA_BLOCK_SIZE <= ReservedMemory::BLOCK_SIZE, "Block buffer is too small");
+static_assert(DATA_BLOCK_SIZE + DATA_BLOCK_SIZE / 64 <= ReservedMemory::ZBUF_SIZE, "Compression buffer is too small");
+
+DataWriter::DataWriter(BatchWriter* o, int c) : out(o), compression(c)
+{
+    zbuf = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::ZBUF_ADDR));
+    worker_count = HelperThreads::workerCount();
+
+    for (int w = 0; w < ReservedMemory::WORKER_COUNT; w++)
+        cctx[w] = nullptr;
+
+    switch (compression) {
+        case SharedConfig::COMPRESSION_NONE:
+            return;
+#ifdef LIBTAS_ENABLE_LZ4
+        case SharedConfig::COMPRESSION_LZ4:
+            if (LZ4_sizeofState() <= ReservedMemory::CODEC_SIZE) {
+                for (int w = 0; w < worker_count; w++)
+                    cctx[w] = ReservedMemory::getAddr(ReservedMemory::CODEC_ADDR + w * ReservedMemory::CODEC_SIZE);
+                return;
+            }
+            break;
+#endif
+#ifdef LIBTAS_ENABLE_ZSTD
+        case SharedConfig::COMPRESSION_ZSTD:
+            {
+                ZSTD_compressionParameters params = ZSTD_getCParams(ZSTD_LEVEL, DATA_BLOCK_SIZE, 0);
+                if (ZSTD_estimateCCtxSize_usingCParams(params) <= ReservedMemory::CODEC_SIZE) {
+                    int w;
+                    for (w = 0; w < worker_count; w++) {
+                        cctx[w] = ZSTD_initStaticCCtx(ReservedMemory::getAddr(ReservedMemory::CODEC_ADDR + w * ReservedMemory::CODEC_SIZE), ReservedMemory::CODEC_SIZE);
+                        if (!cctx[w])
+                            break;
+                    }
+                    if (w == worker_count)
+                        return;
+                }
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+
+    debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Compression %d is not available, savestate will not be compressed", compression);
+    compression = SharedConfig::COMPRESSION_NONE;
+}
+
+size_t DataWriter::compressBlock(const char* src, size_t size, char* dst, int worker)
+{
+    /* We only accept compressed data if it is smaller than the raw data,
+     * otherwise the block is stored uncompressed.
+     */
+    switch (compression) {
+#ifdef LIBTAS_ENABLE_LZ4
+        case SharedConfig::COMPRESSION_LZ4:
+            {
+                int ret = LZ4_compress_fast_extState(cctx[worker], src, dst, size, size - 1, 1);
+                if (ret > 0)
+                    return ret;
+            }
+            break;
+#endif
+#ifdef LIBTAS_ENABLE_ZSTD
+        case SharedConfig::COMPRESSION_ZSTD:
+            {
+                size_t ret = ZSTD_compressCCtx(static_cast<ZSTD_CCtx*>(cctx[worker]), dst, size - 1, src, size, ZSTD_LEVEL);
+                if (!ZSTD_isError(ret))
+                    return ret;
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+    return 0;
+}
+
+void DataWriter::compressTask(int task, int worker, void* arg)
+{
+    DataWriter* writer = static_cast<DataWriter*>(arg);
+    writer->block_compressed[task] = writer->compressBlock(writer->block_src[task],
+        writer->block_size[task], writer->zbuf + task * ReservedMemory::ZBUF_SIZE, worker);
+}
+
+void DataWriter::write(const void* buf, size_t size)
+{
+    if (compression == SharedConfig::COMPRESSION_NONE) {
+        out->write(buf, size);
+        return;
+    }
+
+    const char* src = static_cast<const char*>(buf);
+    while (size > 0) {
+        /* Compress one block for each worker */
+        int n = 0;
+        for (; (size > 0) && (n < worker_count); n++) {
+            block_src[n] = src;
+            block_size[n] = (size < DATA_BLOCK_SIZE) ? size : DATA_BLOCK_SIZE;
+            src += block_size[n];
+            size -= block_size[n];
+        }
+
+        HelperThreads::run(compressTask, this, n);
+
+        for (int i = 0; i < n; i++) {
+            DataBlockHeader bh;
+            bh.raw_size = block_size[i];
+            if (block_compressed[i] > 0) {
+                bh.compressed_size = block_compressed[i];
+                out->writeCopy(&bh, sizeof(bh));
+                out->write(zbuf + i * ReservedMemory::ZBUF_SIZE, bh.compressed_size);
+            }
+            else {
+                bh.compressed_size = bh.raw_size;
+                out->writeCopy(&bh, sizeof(bh));
+                out->write(block_src[i], bh.raw_size);
+            }
+        }
+
+        /* Compression buffers are reused by the next blocks */
+        out->flush();
+    }
+}
+
+DataReader::DataReader(int f, int c) : fd(f), compression(c), block_len(0), block_pos(0)
+{
+    zbuf = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::ZBUF_ADDR));
+    block = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::BLOCK_ADDR));
+    worker_count = HelperThreads::workerCount();
+
+    for (int w = 0; w < ReservedMemory::WORKER_COUNT; w++)
+        dctx[w] = nullptr;
+
+#ifdef LIBTAS_ENABLE_ZSTD
+    if (compression == SharedConfig::COMPRESSION_ZSTD) {
+        MYASSERT(ZSTD_estimateDCtxSize() <= ReservedMemory::CODEC_SIZE)
+        for (int w = 0; w < worker_count; w++) {
+            dctx[w] = ZSTD_initStaticDCtx(ReservedMemory::getAddr(ReservedMemory::CODEC_ADDR + w * ReservedMemory::CODEC_SIZE), ReservedMemory::CODEC_SIZE);
+            MYASSERT(dctx[w] != nullptr)
+        }
+    }
+#endif
+}
+
+bool DataReader::decompressBlock(const char* src, const DataBlockHeader& bh, char* dst, int worker)
+{
+    switch (compression) {
+#ifdef LIBTAS_ENABLE_LZ4
+        case SharedConfig::COMPRESSION_LZ4:
+            return LZ4_decompress_safe(src, dst, bh.compressed_size, bh.raw_size) == static_cast<int>(bh.raw_size);
+#endif
+#ifdef LIBTAS_ENABLE_ZSTD
+        case SharedConfig::COMPRESSION_ZSTD:
+            return ZSTD_decompressDCtx(static_cast<ZSTD_DCtx*>(dctx[worker]), dst, bh.raw_size, src, bh.compressed_size) == bh.raw_size;
+#endif
+        default:
+            return false;
+    }
+}
+
+void DataReader::decompressTask(int task, int worker, void* arg)
+{
+    DataReader* reader = static_cast<DataReader*>(arg);
+    reader->block_ok[task] = reader->decompressBlock(reader->zbuf + task * ReservedMemory::ZBUF_SIZE,
+        reader->block_header[task], reader->block_dst[task], worker);
+}
+
+bool DataReader::readBlock(const DataBlockHeader& bh, char* dst)
+{
+    if (bh.compressed_size == bh.raw_size) {
+        /* Uncompressed block */
+        return Utils::readAll(fd, dst, bh.raw_size) == static_cast<ssize_t>(bh.raw_size);
+    }
+
+    if (bh.compressed_size > ReservedMemory::ZBUF_SIZE)
+        return false;
+
+    if (Utils::readAll(fd, zbuf, bh.compressed_size) != static_cast<ssize_t>(bh.compressed_size))
+        return false;
+
+    return decompressBlock(zbuf, bh, dst, 0);
+}
+
+bool DataReader::loadBlock(const DataBlockHeader& bh)
+{
+    MYASSERT(bh.raw_size <= ReservedMemory::BLOCK_SIZE)
+
+    block_pos = 0;
+    block_len = 0;
+    if (!readBlock(bh, block)) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not decompress savestate data");
+        return false;
+    }
+    block_len = bh.raw_size;
+    return true;
+}
+
+void DataReader::read(void* buf, size_t size)
+{
+    if (compression == SharedConfig::COMPRESSION_NONE) {
+        Utils::readAll(fd, buf, size);
+        return;
+    }
+
+    char* dst = static_cast<char*>(buf);
+    while (size > 0) {
+        if (block_pos < block_len) {
+            /* Use the remaining data of the current block */
+            size_t n = block_len - block_pos;
+            if (n > size)
+                n = size;
+            memcpy(dst, block + block_pos, n);
+            block_pos += n;
+            dst += n;
+            size -= n;
+            continue;
+        }
+
+        /* Read the following blocks that are wholly requested, and
+         * decompress them in parallel directly into place.
+         */
+        DataBlockHeader bh;
+        bool partial = false;
+        int n = 0;
+        while ((size > 0) && (n < worker_count)) {
+            Utils::readAll(fd, &bh, sizeof(bh));
+
+            if (bh.raw_size > size) {
+                partial = true;
+                break;
+            }
+
+            if (bh.compressed_size == bh.raw_size) {
+                /* Uncompressed block */
+                Utils::readAll(fd, dst, bh.raw_size);
+            }
+            else if ((bh.compressed_size > ReservedMemory::ZBUF_SIZE) ||
+                (Utils::readAll(fd, zbuf + n * ReservedMemory::ZBUF_SIZE, bh.compressed_size) != static_cast<ssize_t>(bh.compressed_size))) {
+                debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not decompress savestate data");
+            }
+            else {
+                block_header[n] = bh;
+                block_dst[n] = dst;
+                n++;
+            }
+            dst += bh.raw_size;
+            size -= bh.raw_size;
+        }
+
+        HelperThreads::run(decompressTask, this, n);
+
+        for (int i = 0; i < n; i++) {
+            if (!block_ok[i])
+                debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not decompress savestate data");
+        }
+
+        if (partial && !loadBlock(bh))
+            return;
+    }
+}
+
+void DataReader::skip(size_t size)
+{
+    if (compression == SharedConfig::COMPRESSION_NONE) {
+        lseek(fd, size, SEEK_CUR);
+        return;
+    }
+
+    while (size > 0) {
+        if (block_pos < block_len) {
+            size_t n = block_len - block_pos;
+            if (n > size)
+                n = size;
+            block_pos += n;
+            size -= n;
+            continue;
+        }
+
+        DataBlockHeader bh;
+        Utils::readAll(fd, &bh, sizeof(bh));
+
+        if (bh.raw_size <= size) {
+            /* Skip the whole block without decompressing it */
+            lseek(fd, bh.compressed_size, SEEK_CUR);
+            size -= bh.raw_size;
+        }
+        else if (!loadBlock(bh)) {
+            return;
+        }
+    }
+}
+
+}
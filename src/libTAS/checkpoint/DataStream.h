@@ -0,0 +1,124 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBTAS_DATASTREAM_H
+#define LIBTAS_DATASTREAM_H
+
+#include "ReservedMemory.h" // WORKER_COUNT
+#include <cstddef>
+#include <cstdint>
+
+namespace libtas {
+
+class BatchWriter;
+
+/* Page data in savestates can be compressed. Data is split into blocks of
+ * at most DATA_BLOCK_SIZE bytes that are compressed independently, each one
+ * preceded by a DataBlockHeader. Blocks that don't compress well are stored
+ * uncompressed.
+ */
+#define DATA_BLOCK_SIZE (256 * 1024)
+
+struct DataBlockHeader {
+    uint32_t compressed_size; /* Equal to raw_size if stored uncompressed */
+    uint32_t raw_size;
+};
+
+/* Write page data into a savestate. Compression buffers are located in our
+ * reserved memory, so no memory is allocated. Consecutive blocks are
+ * compressed in parallel by the checkpoint helper threads. Data is written
+ * through a BatchWriter, so uncompressed data must stay unchanged until it
+ * is flushed.
+ */
+class DataWriter
+{
+    public:
+        /* If the compression algorithm is not available, data is stored
+         * uncompressed, and getCompression() returns the algorithm used.
+         */
+        DataWriter(BatchWriter* out, int compression);
+
+        void write(const void* buf, size_t size);
+
+        int getCompression() const { return compression; }
+
+    private:
+        /* Compress a block into `dst` using the workspace of a worker.
+         * Returns the compressed size, or 0 if the block must be stored
+         * uncompressed.
+         */
+        size_t compressBlock(const char* src, size_t size, char* dst, int worker);
+
+        static void compressTask(int task, int worker, void* arg);
+
+        BatchWriter* out;
+        int compression;
+        int worker_count;
+        char* zbuf;
+        void* cctx[ReservedMemory::WORKER_COUNT];
+
+        /* Blocks being compressed in parallel, one for each task */
+        const char* block_src[ReservedMemory::WORKER_COUNT];
+        size_t block_size[ReservedMemory::WORKER_COUNT];
+        size_t block_compressed[ReservedMemory::WORKER_COUNT];
+};
+
+/* Read page data from a savestate, decompressing it directly into the
+ * destination when a whole block is requested. Consecutive whole blocks are
+ * decompressed in parallel by the checkpoint helper threads.
+ */
+class DataReader
+{
+    public:
+        DataReader(int fd, int compression);
+
+        void read(void* buf, size_t size);
+        void skip(size_t size);
+
+    private:
+        /* Read a block into our buffer */
+        bool loadBlock(const DataBlockHeader& bh);
+
+        /* Read the next block into the given buffer */
+        bool readBlock(const DataBlockHeader& bh, char* dst);
+
+        /* Decompress a block using the workspace of a worker */
+        bool decompressBlock(const char* src, const DataBlockHeader& bh, char* dst, int worker);
+
+        static void decompressTask(int task, int worker, void* arg);
+
+        int fd;
+        int compression;
+        int worker_count;
+        char* zbuf;
+        void* dctx[ReservedMemory::WORKER_COUNT];
+
+        /* Blocks being decompressed in parallel, one for each task */
+        DataBlockHeader block_header[ReservedMemory::WORKER_COUNT];
+        char* block_dst[ReservedMemory::WORKER_COUNT];
+        bool block_ok[ReservedMemory::WORKER_COUNT];
+
+        /* Remaining data of a block that was only partially read */
+        char* block;
+        size_t block_len;
+        size_t block_pos;
+};
+}
+
+#endif
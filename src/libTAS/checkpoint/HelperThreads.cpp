@@ -0,0 +1,152 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "HelperThreads.h"
+#include "ThreadBarrier.h"
+#include "ReservedMemory.h"
+#include "../logging.h"
+#include "../GlobalState.h"
+#include <algorithm>
+#include <pthread.h>
+#include <csignal>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace libtas {
+
+struct HelperState {
+    /* Helper threads wait on this barrier for tasks to execute, and arrive
+     * at it again when they are done.
+     */
+    ThreadBarrier barrier;
+
+    /* Process of the helper threads */
+    pid_t pid;
+    int helper_count;
+
+    /* Current tasks */
+    HelperThreads::TaskFunc func;
+    void* arg;
+    int task_count;
+    int next_task;
+};
+
+static_assert(sizeof(HelperState) <= ReservedMemory::HELPER_SIZE, "Helper state does not fit in reserved memory");
+
+static HelperState* getState()
+{
+    return static_cast<HelperState*>(ReservedMemory::getAddr(ReservedMemory::HELPER_ADDR));
+}
+
+/* Execute tasks until there is none left */
+static void work(HelperState* st, int worker)
+{
+    int task;
+    while ((task = __atomic_fetch_add(&st->next_task, 1, __ATOMIC_ACQ_REL)) < st->task_count)
+        st->func(task, worker, st->arg);
+}
+
+static void* helperMain(void* arg)
+{
+    int worker = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+    HelperState* st = getState();
+
+    while (true) {
+        int gen = st->barrier.arrive();
+        st->barrier.wait(gen);
+        work(st, worker);
+    }
+    return nullptr;
+}
+
+void HelperThreads::init()
+{
+    HelperState* st = getState();
+    st->barrier.init();
+    st->pid = syscall(SYS_getpid);
+    st->helper_count = 0;
+    st->task_count = 0;
+    st->next_task = 0;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = std::min<long>(cpus, ReservedMemory::WORKER_COUNT);
+
+    /* Signals must be handled by game threads, so we block all of them
+     * while creating the helper threads, which inherit our signal mask.
+     */
+    sigset_t mask, oldmask;
+    sigfillset(&mask);
+    NATIVECALL(pthread_sigmask(SIG_SETMASK, &mask, &oldmask));
+
+    for (int i = 1; i < count; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        char* stack = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::HELPER_STACK_ADDR));
+        pthread_attr_setstack(&attr, stack + (i-1) * ReservedMemory::HELPER_STACK_SIZE, ReservedMemory::HELPER_STACK_SIZE);
+
+        /* This thread is not registered by our pthread_create wrapper */
+        pthread_t thread;
+        int ret;
+        NATIVECALL(ret = pthread_create(&thread, &attr, helperMain, reinterpret_cast<void*>(static_cast<intptr_t>(i))));
+        pthread_attr_destroy(&attr);
+
+        if (ret != 0) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create checkpoint helper thread %d", i);
+            break;
+        }
+        NATIVECALL(pthread_detach(thread));
+        st->helper_count++;
+    }
+
+    NATIVECALL(pthread_sigmask(SIG_SETMASK, &oldmask, nullptr));
+}
+
+int HelperThreads::workerCount()
+{
+    HelperState* st = getState();
+    if (st->pid != syscall(SYS_getpid))
+        return 1;
+    return st->helper_count + 1;
+}
+
+void HelperThreads::run(TaskFunc func, void* arg, int task_count)
+{
+    HelperState* st = getState();
+
+    if ((task_count == 1) || (workerCount() == 1)) {
+        for (int task = 0; task < task_count; task++)
+            func(task, 0, arg);
+        return;
+    }
+
+    /* Wait for all helper threads to be done with the previous tasks */
+    st->barrier.waitArrivals(st->helper_count, 0);
+
+    st->func = func;
+    st->arg = arg;
+    st->task_count = task_count;
+    __atomic_store_n(&st->next_task, 0, __ATOMIC_RELEASE);
+
+    st->barrier.release();
+    work(st, 0);
+    st->barrier.waitArrivals(st->helper_count, 0);
+}
+
+}
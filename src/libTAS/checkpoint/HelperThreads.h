@@ -0,0 +1,55 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_HELPERTHREADS_H
+#define LIBTAS_HELPERTHREADS_H
+
+namespace libtas {
+/* Threads helping the checkpoint thread to write and read savestates, by
+ * hashing, compressing and decompressing memory pages in parallel. They are
+ * created once, outside of the list of game threads, so they are never
+ * suspended nor saved, and their stacks live in our reserved memory.
+ */
+namespace HelperThreads
+{
+    /* Function executing a task. `worker` is 0 for the calling thread and
+     * between 1 and workerCount()-1 for helper threads, and can be used to
+     * access a per-worker buffer. Tasks must not allocate memory nor log
+     * anything.
+     */
+    typedef void (*TaskFunc)(int task, int worker, void* arg);
+
+    /* Create the helper threads. Must be called after ReservedMemory::init() */
+    void init();
+
+    /* Number of threads executing tasks, including the calling thread. This
+     * is 1 in a process forked to write a savestate, which does not have
+     * the helper threads.
+     */
+    int workerCount();
+
+    /* Execute all tasks from 0 to `task_count`-1 on the helper threads and
+     * the calling thread, and wait for all of them to complete.
+     */
+    void run(TaskFunc func, void* arg, int task_count);
+}
+}
+
+#endif
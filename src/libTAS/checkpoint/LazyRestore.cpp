@@ -0,0 +1,347 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "LazyRestore.h"
+#include "ReservedMemory.h"
+#include "Utils.h"
+#include "../logging.h"
+#include "../GlobalState.h" // NATIVECALL
+#include <linux/userfaultfd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace libtas {
+
+/* Number of pages filled at once by the helper thread, so that accessing
+ * memory sequentially does not fault on each page.
+ */
+#define HELPER_PAGES 16
+
+struct LazyRegion {
+    char* addr;
+    size_t size;
+    off_t offset;
+};
+
+/* State of the lazy restore, stored in our reserved memory because it must
+ * not be modified when loading a savestate.
+ */
+struct LazyState {
+    /* userfaultfd file descriptor, or -1 */
+    int uffd;
+
+    /* Did we fail to setup userfaultfd */
+    bool unsupported;
+
+    /* Savestate being restored, or -1 */
+    int fd;
+
+    /* Number of pages that the helper thread could not read */
+    size_t failed_pages;
+
+    /* Registered regions, sorted by address, which are stored after this
+     * structure.
+     */
+    LazyRegion* regions;
+    size_t region_count;
+    size_t region_capacity;
+};
+
+static_assert(HELPER_PAGES * 4096 <= ReservedMemory::LAZY_HELPER_BUFFER_SIZE, "Helper buffer is too small");
+
+static LazyState* getState()
+{
+    return static_cast<LazyState*>(ReservedMemory::getAddr(ReservedMemory::LAZY_ADDR));
+}
+
+/* We don't use the ioctl() function, because it is hooked */
+static int uffdIoctl(int uffd, unsigned long request, void* arg)
+{
+    return syscall(SYS_ioctl, uffd, request, arg);
+}
+
+static LazyRegion* findRegion(LazyState* st, char* addr)
+{
+    size_t low = 0;
+    size_t high = st->region_count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        LazyRegion* region = &st->regions[mid];
+        if (addr < region->addr)
+            high = mid;
+        else if (addr >= (region->addr + region->size))
+            low = mid + 1;
+        else
+            return region;
+    }
+    return nullptr;
+}
+
+/* Copy pages from the savestate into a region. Pages that are already mapped
+ * are left untouched. Returns false if the pages could not be filled.
+ */
+static bool fillPages(LazyState* st, LazyRegion* region, char* addr, size_t size, char* buffer)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    off_t offset = region->offset + (addr - region->addr);
+    if (Utils::preadAll(st->fd, buffer, size, offset) != static_cast<ssize_t>(size))
+        return false;
+
+    size_t done = 0;
+    while (done < size) {
+        struct uffdio_copy copy;
+        copy.dst = reinterpret_cast<uintptr_t>(addr + done);
+        copy.src = reinterpret_cast<uintptr_t>(buffer + done);
+        copy.len = size - done;
+        copy.mode = 0;
+        copy.copy = 0;
+
+        if (uffdIoctl(st->uffd, UFFDIO_COPY, &copy) == 0)
+            break;
+
+        if (copy.copy > 0) {
+            /* Only part of the pages were copied */
+            done += copy.copy;
+        }
+        else if (errno == EEXIST) {
+            /* The page is already mapped */
+            done += page_size;
+        }
+        else if (errno != EAGAIN) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Main function of the helper thread */
+static void* helperMain(void*)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    LazyState* st = getState();
+    char* buffer = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::LAZY_HELPER_BUFFER_ADDR));
+
+    while (true) {
+        struct uffd_msg msg;
+        if (read(st->uffd, &msg, sizeof(msg)) != sizeof(msg))
+            continue;
+
+        if (msg.event != UFFD_EVENT_PAGEFAULT)
+            continue;
+
+        char* addr = reinterpret_cast<char*>(msg.arg.pagefault.address & ~static_cast<uint64_t>(page_size - 1));
+
+        LazyRegion* region = findRegion(st, addr);
+        if (region) {
+            /* Also fill the following pages of the region */
+            size_t size = (region->addr + region->size) - addr;
+            if (size > HELPER_PAGES * page_size)
+                size = HELPER_PAGES * page_size;
+
+            if (fillPages(st, region, addr, size, buffer))
+                continue;
+
+            st->failed_pages++;
+        }
+
+        /* We must not leave the faulting thread waiting */
+        struct uffdio_zeropage zero;
+        zero.range.start = reinterpret_cast<uintptr_t>(addr);
+        zero.range.len = page_size;
+        zero.mode = 0;
+        uffdIoctl(st->uffd, UFFDIO_ZEROPAGE, &zero);
+    }
+
+    return nullptr;
+}
+
+/* Create the userfaultfd object and the helper thread */
+static bool setup(LazyState* st)
+{
+    st->uffd = syscall(SYS_userfaultfd, O_CLOEXEC);
+    if (st->uffd == -1) {
+        debuglogstdio(LCF_CHECKPOINT, "userfaultfd is not available, savestates will be loaded entirely");
+        return false;
+    }
+
+    struct uffdio_api api;
+    api.api = UFFD_API;
+    api.features = 0;
+    if (uffdIoctl(st->uffd, UFFDIO_API, &api) != 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "userfaultfd handshake failed");
+        close(st->uffd);
+        st->uffd = -1;
+        return false;
+    }
+
+    /* The helper thread is a native thread, so that it has its own
+     * thread-local storage such as errno. Signals must be handled by game
+     * threads, so we block all of them while creating it, and it inherits
+     * our signal mask.
+     */
+    sigset_t mask, oldmask;
+    sigfillset(&mask);
+    NATIVECALL(pthread_sigmask(SIG_SETMASK, &mask, &oldmask));
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, ReservedMemory::getAddr(ReservedMemory::LAZY_STACK_ADDR), ReservedMemory::LAZY_STACK_SIZE);
+
+    /* This thread is not registered by our pthread_create wrapper */
+    pthread_t thread;
+    int ret;
+    NATIVECALL(ret = pthread_create(&thread, &attr, helperMain, nullptr));
+    pthread_attr_destroy(&attr);
+    NATIVECALL(pthread_sigmask(SIG_SETMASK, &oldmask, nullptr));
+
+    if (ret != 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create the thread filling lazily restored memory");
+        close(st->uffd);
+        st->uffd = -1;
+        return false;
+    }
+    NATIVECALL(pthread_detach(thread));
+
+    return true;
+}
+
+void LazyRestore::init()
+{
+    LazyState* st = getState();
+    st->uffd = -1;
+    st->fd = -1;
+    st->failed_pages = 0;
+    st->regions = reinterpret_cast<LazyRegion*>(st + 1);
+    st->region_count = 0;
+    st->region_capacity = (ReservedMemory::LAZY_SIZE - sizeof(LazyState)) / sizeof(LazyRegion);
+
+    /* The helper thread is created now, because creating a thread while the
+     * other threads are suspended could deadlock on a lock of libc.
+     */
+    st->unsupported = !setup(st);
+}
+
+bool LazyRestore::begin(int fd)
+{
+    LazyState* st = getState();
+
+    if (st->unsupported)
+        return false;
+
+    cancel();
+
+    st->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (st->fd == -1) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not duplicate the savestate file descriptor");
+        return false;
+    }
+    st->failed_pages = 0;
+    return true;
+}
+
+bool LazyRestore::addRegion(void* addr, size_t size, off_t offset)
+{
+    LazyState* st = getState();
+
+    if ((st->fd == -1) || (st->region_count == st->region_capacity))
+        return false;
+
+    /* Regions must be added in increasing order */
+    if ((st->region_count > 0) &&
+        (static_cast<char*>(addr) < (st->regions[st->region_count-1].addr + st->regions[st->region_count-1].size)))
+        return false;
+
+    /* The region must be visible to the helper thread before any fault */
+    LazyRegion* region = &st->regions[st->region_count];
+    region->addr = static_cast<char*>(addr);
+    region->size = size;
+    region->offset = offset;
+    st->region_count++;
+
+    struct uffdio_register reg;
+    reg.range.start = reinterpret_cast<uintptr_t>(addr);
+    reg.range.len = size;
+    reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+    if (uffdIoctl(st->uffd, UFFDIO_REGISTER, &reg) != 0) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not register %p for lazy restore", addr);
+        st->region_count--;
+        return false;
+    }
+
+    return true;
+}
+
+void LazyRestore::finish()
+{
+    LazyState* st = getState();
+
+    if (st->fd == -1)
+        return;
+
+    char* buffer = static_cast<char*>(ReservedMemory::getAddr(ReservedMemory::LAZY_BUFFER_ADDR));
+    size_t missing = 0;
+
+    for (size_t r = 0; r < st->region_count; r++) {
+        LazyRegion* region = &st->regions[r];
+        for (size_t done = 0; done < region->size; done += ReservedMemory::LAZY_BUFFER_SIZE) {
+            size_t size = region->size - done;
+            if (size > ReservedMemory::LAZY_BUFFER_SIZE)
+                size = ReservedMemory::LAZY_BUFFER_SIZE;
+            if (!fillPages(st, region, region->addr + done, size, buffer))
+                missing += size;
+        }
+    }
+
+    if (missing > 0)
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not read %d bytes of the savestate", missing);
+
+    cancel();
+}
+
+void LazyRestore::cancel()
+{
+    LazyState* st = getState();
+
+    if (st->fd == -1)
+        return;
+
+    if (st->failed_pages > 0)
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not read %d pages of the savestate", st->failed_pages);
+
+    for (size_t r = 0; r < st->region_count; r++) {
+        struct uffdio_range range;
+        range.start = reinterpret_cast<uintptr_t>(st->regions[r].addr);
+        range.len = st->regions[r].size;
+        uffdIoctl(st->uffd, UFFDIO_UNREGISTER, &range);
+    }
+
+    st->region_count = 0;
+    close(st->fd);
+    st->fd = -1;
+}
+
+}
@@ -0,0 +1,68 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_LAZYRESTORE_H
+#define LIBTAS_LAZYRESTORE_H
+
+#include <cstddef>
+#include <sys/types.h>
+
+namespace libtas {
+/* Restore the memory of a savestate lazily. Memory regions are registered
+ * with userfaultfd, and a helper thread fills each page from the savestate
+ * when it is first accessed. The helper thread is not registered in our
+ * thread list, so it is never suspended. Its stack and all the state used
+ * here live in our reserved memory.
+ */
+namespace LazyRestore
+{
+    /* Initialize the state and create the helper thread. Must be called
+     * after ReservedMemory::init()
+     */
+    void init();
+
+    /* Start restoring memory lazily from a savestate, whose file descriptor
+     * is duplicated. Returns false if userfaultfd is not available.
+     */
+    bool begin(int fd);
+
+    /* Register `size` bytes of memory starting at `addr`, whose content is
+     * stored uncompressed at `offset` in the savestate. Pages of this region
+     * that are not mapped are filled when they are first accessed. Returns
+     * false if the region could not be registered.
+     */
+    bool addRegion(void* addr, size_t size, off_t offset);
+
+    /* Fill all the pages that were not accessed yet, then stop the lazy
+     * restore. This must be done before saving a savestate, because the
+     * savestate code looks at pages that are not mapped, and because a
+     * forked process does not get the userfaultfd registration.
+     */
+    void finish();
+
+    /* Stop the lazy restore, leaving the pages that were not accessed yet
+     * unmapped. This must only be done before loading another savestate,
+     * which overwrites all the pages that are not mapped.
+     */
+    void cancel();
+}
+}
+
+#endif
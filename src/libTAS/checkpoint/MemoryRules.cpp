@@ -0,0 +1,125 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "MemoryRules.h"
+#include "ReservedMemory.h"
+#include <fnmatch.h>
+#include <cstring>
+
+namespace libtas {
+
+struct RulesState {
+    int count;
+    MemoryRule rules[MEMORY_RULES_MAX];
+
+    /* Size of the areas matched by each rule during the last audit */
+    uint64_t sizes[MEMORY_RULES_MAX];
+    bool audit_ready;
+};
+
+static_assert(sizeof(RulesState) <= ReservedMemory::RULES_SIZE, "Memory rules do not fit in reserved memory");
+
+static RulesState* getState()
+{
+    return static_cast<RulesState*>(ReservedMemory::getAddr(ReservedMemory::RULES_ADDR));
+}
+
+static bool match(const MemoryRule *rule, const Area *area)
+{
+    if ((rule->pattern[0] != '\0') && (fnmatch(rule->pattern, area->name, 0) != 0))
+        return false;
+
+    uintptr_t addr = reinterpret_cast<uintptr_t>(area->addr);
+    uintptr_t endAddr = reinterpret_cast<uintptr_t>(area->endAddr);
+    if ((rule->end != 0) && ((addr < rule->start) || (endAddr > rule->end)))
+        return false;
+
+    return area->size >= rule->min_size;
+}
+
+MemoryRule* MemoryRules::getBuffer()
+{
+    return getState()->rules;
+}
+
+void MemoryRules::setCount(int count)
+{
+    RulesState* state = getState();
+    if (count < 0)
+        count = 0;
+    if (count > MEMORY_RULES_MAX)
+        count = MEMORY_RULES_MAX;
+
+    for (int r = 0; r < count; r++)
+        state->rules[r].pattern[MEMORY_RULE_PATTERN_SIZE-1] = '\0';
+
+    state->count = count;
+}
+
+bool MemoryRules::exclude(const Area *area, bool audit)
+{
+    RulesState* state = getState();
+    bool excluded = false;
+
+    for (int r = 0; r < state->count; r++) {
+        const MemoryRule* rule = &state->rules[r];
+
+        /* Disabled rules are only checked when counting */
+        if (!audit && !rule->enabled)
+            continue;
+
+        if (!match(rule, area))
+            continue;
+
+        if (!audit)
+            return true;
+
+        state->sizes[r] += area->size;
+        excluded = excluded || rule->enabled;
+    }
+
+    return excluded;
+}
+
+void MemoryRules::beginAudit()
+{
+    RulesState* state = getState();
+    memset(state->sizes, 0, sizeof(state->sizes));
+    state->audit_ready = false;
+}
+
+void MemoryRules::endAudit()
+{
+    getState()->audit_ready = true;
+}
+
+bool MemoryRules::getAudit(const uint64_t** sizes, int* count)
+{
+    RulesState* state = getState();
+    if (!state->audit_ready)
+        return false;
+
+    state->audit_ready = false;
+    *sizes = state->sizes;
+    *count = state->count;
+    return true;
+}
+
+}
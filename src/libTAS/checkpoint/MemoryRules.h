@@ -0,0 +1,58 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_MEMORYRULES_H
+#define LIBTAS_MEMORYRULES_H
+
+#include "ProcMapsArea.h"
+#include "../../shared/MemoryRule.h"
+
+namespace libtas {
+/* Rules defined by the user to exclude memory areas from savestates. Rules
+ * are stored in our reserved memory, so that they are not modified when
+ * loading a savestate.
+ */
+namespace MemoryRules
+{
+    /* Buffer receiving the rules sent by the program, which can hold
+     * MEMORY_RULES_MAX rules.
+     */
+    MemoryRule* getBuffer();
+
+    /* Use the first `count` rules of the buffer */
+    void setCount(int count);
+
+    /* Returns if the area is excluded by an enabled rule. If `audit` is
+     * true, the size of the area is added to each rule that matches it.
+     */
+    bool exclude(const Area *area, bool audit);
+
+    /* Start and end counting the size of the areas matched by each rule */
+    void beginAudit();
+    void endAudit();
+
+    /* Get the size of the areas matched by each rule during the last audit.
+     * Returns false if there is no new audit since the last call.
+     */
+    bool getAudit(const uint64_t** sizes, int* count);
+}
+}
+
+#endif
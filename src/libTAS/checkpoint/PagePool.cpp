@@ -0,0 +1,334 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "PagePool.h"
+#include "ReservedMemory.h"
+#include "Utils.h"
+#include "../logging.h"
+#include "../global.h" // shared_config
+#include <fcntl.h>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <sys/mman.h> // MFD_CLOEXEC
+#include <sys/syscall.h>
+
+namespace libtas {
+
+/* Number of entries of the hash table, which must be a power of two */
+#define POOL_TABLE_SIZE (8 * 1024 * 1024)
+
+/* Maximum number of used entries, to keep probe sequences short */
+#define POOL_TABLE_MAX (POOL_TABLE_SIZE / 4 * 3)
+
+/* Number of unreferenced pages that we remember for reuse */
+#define POOL_FREE_SIZE (4 * 1024 * 1024)
+
+/* Number of deleted entries above which the table is compacted */
+#define POOL_DELETED_MAX (POOL_TABLE_SIZE / 8)
+
+/* Values of PoolEntry::slot. Other values are the page index plus one, so
+ * that zeroed memory is an empty table.
+ */
+#define SLOT_EMPTY 0
+#define SLOT_DELETED 0xffffffff
+
+struct PoolEntry {
+    uint64_t hash;
+    uint32_t slot;
+    uint32_t refcount;
+};
+
+struct PoolHeader {
+    uint64_t id;
+
+    /* File holding the pages, or -1 */
+    int fd;
+    char path[1024];
+
+    /* Number of pages in the file */
+    uint32_t page_count;
+
+    /* Number of pages that are referenced */
+    uint32_t live_count;
+
+    /* Number of entries that are not empty, including deleted ones */
+    size_t used_count;
+
+    /* Number of deleted entries */
+    size_t deleted_count;
+
+    /* Entries of unreferenced pages, whose space can be reused */
+    size_t free_count;
+};
+
+static_assert(sizeof(PoolHeader) <= 4096, "Pool header is too big");
+static_assert(4096 + POOL_TABLE_SIZE * sizeof(PoolEntry) + POOL_FREE_SIZE * sizeof(uint32_t) <= ReservedMemory::POOL_SIZE, "Page pool does not fit in reserved memory");
+
+static PoolHeader* getHeader()
+{
+    return static_cast<PoolHeader*>(ReservedMemory::getAddr(ReservedMemory::POOL_ADDR));
+}
+
+static PoolEntry* getTable()
+{
+    return static_cast<PoolEntry*>(ReservedMemory::getAddr(ReservedMemory::POOL_ADDR + 4096));
+}
+
+static uint32_t* getFreeList()
+{
+    return reinterpret_cast<uint32_t*>(getTable() + POOL_TABLE_SIZE);
+}
+
+/* Returns the entry of a page, or nullptr */
+static PoolEntry* findEntry(uint64_t hash)
+{
+    PoolEntry* table = getTable();
+    for (size_t i = hash & (POOL_TABLE_SIZE - 1); ; i = (i + 1) & (POOL_TABLE_SIZE - 1)) {
+        PoolEntry* entry = &table[i];
+        if (entry->slot == SLOT_EMPTY)
+            return nullptr;
+        if ((entry->slot != SLOT_DELETED) && (entry->hash == hash))
+            return entry;
+    }
+}
+
+/* Returns the index of a page of the file that can be written */
+static uint32_t allocatePage(PoolHeader* ph)
+{
+    PoolEntry* table = getTable();
+    uint32_t* free_list = getFreeList();
+
+    while (ph->free_count > 0) {
+        PoolEntry* entry = &table[free_list[--ph->free_count]];
+
+        /* The page may have been referenced again, or already reused */
+        if ((entry->slot != SLOT_EMPTY) && (entry->slot != SLOT_DELETED) && (entry->refcount == 0)) {
+            uint32_t page = entry->slot - 1;
+            entry->slot = SLOT_DELETED;
+            ph->deleted_count++;
+            return page;
+        }
+    }
+
+    return ph->page_count++;
+}
+
+void PagePool::init()
+{
+    PoolHeader* ph = getHeader();
+
+    ph->id = 0;
+    if (syscall(SYS_getrandom, &ph->id, sizeof(ph->id), 0) != sizeof(ph->id))
+        ph->id = (static_cast<uint64_t>(time(nullptr)) << 32) ^ getpid();
+    if (ph->id == 0)
+        ph->id = 1;
+
+    ph->fd = -1;
+    ph->path[0] = '\0';
+    ph->page_count = 0;
+    ph->live_count = 0;
+    ph->used_count = 0;
+    ph->deleted_count = 0;
+    ph->free_count = 0;
+}
+
+void PagePool::setPath(const char* path)
+{
+    PoolHeader* ph = getHeader();
+    strncpy(ph->path, path, sizeof(ph->path) - 1);
+    ph->path[sizeof(ph->path) - 1] = '\0';
+}
+
+bool PagePool::open()
+{
+    PoolHeader* ph = getHeader();
+    if (ph->fd != -1)
+        return true;
+
+    if (shared_config.savestate_settings & SharedConfig::SS_RAM) {
+        ph->fd = syscall(SYS_memfd_create, "libtas_pages", MFD_CLOEXEC);
+    }
+    else {
+        /* Pages of a previous execution cannot be used */
+        OWNCALL(ph->fd = ::open(ph->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    }
+
+    if (ph->fd == -1) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create the page pool");
+        return false;
+    }
+    return true;
+}
+
+uint64_t PagePool::getId()
+{
+    return getHeader()->id;
+}
+
+bool PagePool::hasRoom(size_t count)
+{
+    PoolHeader* ph = getHeader();
+    return (ph->fd != -1) && ((ph->used_count + count) <= POOL_TABLE_MAX);
+}
+
+void PagePool::compact()
+{
+    PoolHeader* ph = getHeader();
+    if (ph->deleted_count < POOL_DELETED_MAX)
+        return;
+
+    PoolEntry* table = getTable();
+
+    /* Start after an empty entry, which no probe sequence goes through */
+    size_t start = 0;
+    while (table[start].slot != SLOT_EMPTY)
+        start++;
+
+    for (size_t i = 0; i < POOL_TABLE_SIZE; i++) {
+        if (table[i].slot == SLOT_DELETED)
+            table[i].slot = SLOT_EMPTY;
+    }
+
+    /* Move each entry to the first empty entry of its probe sequence. Entries
+     * are processed in the order of probe sequences, so that the entries that
+     * were already moved stay reachable.
+     */
+    ph->used_count = 0;
+    ph->free_count = 0;
+    uint32_t* free_list = getFreeList();
+    for (size_t n = 1; n <= POOL_TABLE_SIZE; n++) {
+        size_t i = (start + n) & (POOL_TABLE_SIZE - 1);
+        if (table[i].slot == SLOT_EMPTY)
+            continue;
+
+        size_t j = table[i].hash & (POOL_TABLE_SIZE - 1);
+        while ((j != i) && (table[j].slot != SLOT_EMPTY))
+            j = (j + 1) & (POOL_TABLE_SIZE - 1);
+        if (j != i) {
+            table[j] = table[i];
+            table[i].slot = SLOT_EMPTY;
+        }
+
+        ph->used_count++;
+
+        /* Indices of the free list have changed */
+        if ((table[j].refcount == 0) && (ph->free_count < POOL_FREE_SIZE))
+            free_list[ph->free_count++] = j;
+    }
+
+    debuglogstdio(LCF_CHECKPOINT, "Removed %d deleted entries of the page pool", ph->deleted_count);
+    ph->deleted_count = 0;
+}
+
+bool PagePool::addPage(uint64_t* hash, const void* page, bool* added)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    PoolHeader* ph = getHeader();
+
+    /* A different page with the same hash would be silently substituted, so
+     * we compare their content. The page is then stored with another key.
+     */
+    PoolEntry* entry;
+    char stored[4096];
+    while ((entry = findEntry(*hash))) {
+        off_t offset = static_cast<off_t>(entry->slot - 1) * page_size;
+        if ((page_size > sizeof(stored)) ||
+            (Utils::preadAll(ph->fd, stored, page_size, offset) != static_cast<ssize_t>(page_size)))
+            return false;
+        if (memcmp(stored, page, page_size) == 0)
+            break;
+        (*hash)++;
+    }
+
+    *added = !entry || (entry->refcount == 0);
+    if (entry) {
+        if (entry->refcount++ == 0)
+            ph->live_count++;
+        return true;
+    }
+
+    if (ph->used_count >= POOL_TABLE_MAX)
+        return false;
+
+    uint32_t index = allocatePage(ph);
+    off_t offset = static_cast<off_t>(index) * page_size;
+    if (pwrite(ph->fd, page, page_size, offset) != static_cast<ssize_t>(page_size))
+        return false;
+
+    /* Take the first deleted or empty entry. We already know that the page
+     * is not present further.
+     */
+    PoolEntry* table = getTable();
+    size_t i = *hash & (POOL_TABLE_SIZE - 1);
+    while ((table[i].slot != SLOT_EMPTY) && (table[i].slot != SLOT_DELETED))
+        i = (i + 1) & (POOL_TABLE_SIZE - 1);
+
+    if (table[i].slot == SLOT_EMPTY)
+        ph->used_count++;
+    else
+        ph->deleted_count--;
+
+    /* The game process may look for pages while a forked process is adding
+     * some, so the entry must be complete when it becomes valid.
+     */
+    table[i].hash = *hash;
+    table[i].refcount = 1;
+    __sync_synchronize();
+    table[i].slot = index + 1;
+    ph->live_count++;
+    return true;
+}
+
+void PagePool::releasePage(uint64_t hash)
+{
+    PoolEntry* entry = findEntry(hash);
+    if (!entry || (entry->refcount == 0))
+        return;
+
+    if (--entry->refcount > 0)
+        return;
+
+    PoolHeader* ph = getHeader();
+    ph->live_count--;
+    if (ph->free_count < POOL_FREE_SIZE)
+        getFreeList()[ph->free_count++] = entry - getTable();
+}
+
+bool PagePool::readPage(uint64_t hash, void* page)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    PoolEntry* entry = findEntry(hash);
+    if (!entry)
+        return false;
+
+    off_t offset = static_cast<off_t>(entry->slot - 1) * page_size;
+    return Utils::preadAll(getHeader()->fd, page, page_size, offset) == static_cast<ssize_t>(page_size);
+}
+
+uint64_t PagePool::getUsedSize()
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    return static_cast<uint64_t>(getHeader()->live_count) * page_size;
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_PAGEPOOL_H
+#define LIBTAS_PAGEPOOL_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace libtas {
+/* Store of memory pages shared by all savestates. Each page is stored once,
+ * identified by its hash, and savestates only keep the list of hashes of
+ * their pages. Pages are reference counted, so that the pages of a
+ * savestate that is overwritten can be reused.
+ *
+ * The index of the pool is located in a part of our reserved memory that is
+ * shared with the processes writing savestates in the background, so that
+ * they can add pages.
+ */
+namespace PagePool
+{
+    /* Initialize the pool. Must be called after ReservedMemory::init() */
+    void init();
+
+    /* Set the file path of the pool when stored on disk */
+    void setPath(const char* path);
+
+    /* Create the pool file if needed, in memory or on disk */
+    bool open();
+
+    /* Identifier of the pool, stored in savestates that use it. The pool
+     * only lives as long as the game, so savestates of another execution
+     * cannot be loaded.
+     */
+    uint64_t getId();
+
+    /* Returns if `count` more pages can be added to the pool */
+    bool hasRoom(size_t count);
+
+    /* Remove the deleted entries of the index when there are too many of
+     * them. No other process may use the pool meanwhile.
+     */
+    void compact();
+
+    /* Add a reference to a page, storing its content if it is not already
+     * in the pool. If a different page has the same hash, `hash` is changed
+     * to the key under which the page is stored. `added` is set if the page
+     * was not referenced before. Returns false if the page could not be
+     * stored.
+     */
+    bool addPage(uint64_t* hash, const void* page, bool* added);
+
+    /* Remove a reference to a page. Unreferenced pages stay in the pool until
+     * their space is reused, so that they can be referenced again for free.
+     */
+    void releasePage(uint64_t hash);
+
+    /* Read the content of a page. Returns false if it is not in the pool. */
+    bool readPage(uint64_t hash, void* page);
+
+    /* Number of bytes of the pages that are referenced by savestates */
+    uint64_t getUsedSize();
+}
+}
+
+#endif
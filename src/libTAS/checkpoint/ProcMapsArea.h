@@ -49,7 +49,12 @@ union Area {
     enum ProcMapsAreaProperties {
         NONE = 0x00,
         ZERO_PAGE = 0x01,
-        SKIP = 0x02
+        SKIP = 0x02,
+        INCREMENTAL = 0x04, /* Only pages modified since the base savestate are stored */
+        HUGE_PAGES = 0x08, /* Backed by transparent huge pages */
+        FILE_PAGES = 0x10, /* Only pages of a private file mapping that were written are stored */
+        DONT_COPY = 0x20, /* Advised with MADV_DONTFORK, only known when reading smaps */
+        DONT_DUMP = 0x40, /* Advised with MADV_DONTDUMP, only known when reading smaps */
     };
 
     struct {
@@ -25,33 +25,264 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include "Utils.h"
+#include "ReservedMemory.h"
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <sys/ioctl.h>
+#include <sys/syscall.h> // SYS_ioctl, because ioctl() is hooked
+#include <linux/fs.h>
+
+/* Query the areas of a process with an ioctl, available since Linux 6.11.
+ * Older system headers don't define it, but the interface is stable.
+ */
+#ifndef PROCMAP_QUERY
+struct procmap_query {
+    uint64_t size;
+    uint64_t query_flags;
+    uint64_t query_addr;
+    uint64_t vma_start;
+    uint64_t vma_end;
+    uint64_t vma_flags;
+    uint64_t vma_page_size;
+    uint64_t vma_offset;
+    uint64_t inode;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t vma_name_size;
+    uint32_t build_id_size;
+    uint64_t vma_name_addr;
+    uint64_t build_id_addr;
+};
+
+enum procmap_query_flags {
+    PROCMAP_QUERY_VMA_READABLE = 0x01,
+    PROCMAP_QUERY_VMA_WRITABLE = 0x02,
+    PROCMAP_QUERY_VMA_EXECUTABLE = 0x04,
+    PROCMAP_QUERY_VMA_SHARED = 0x08,
+    PROCMAP_QUERY_COVERING_OR_NEXT_VMA = 0x10,
+    PROCMAP_QUERY_FILE_BACKED_VMA = 0x20,
+};
+
+#define PROCMAP_QUERY _IOWR('f', 17, struct procmap_query)
+#endif
+
+/* Scan the pages of a process with an ioctl on its pagemap, available since
+ * Linux 6.7.
+ */
+#ifndef PAGEMAP_SCAN
+struct page_region {
+    uint64_t start;
+    uint64_t end;
+    uint64_t categories;
+};
+
+struct pm_scan_arg {
+    uint64_t size;
+    uint64_t flags;
+    uint64_t start;
+    uint64_t end;
+    uint64_t walk_end;
+    uint64_t vec;
+    uint64_t vec_len;
+    uint64_t max_pages;
+    uint64_t category_inverted;
+    uint64_t category_mask;
+    uint64_t category_anyof_mask;
+    uint64_t return_mask;
+};
+
+#define PAGE_IS_HUGE (1 << 6)
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#endif
 
 namespace libtas {
 
-ProcSelfMaps::ProcSelfMaps(void* restoreAddr, size_t restoreLength)
-    : dataIdx(0),
-    numAreas(0),
-    numBytes(0)
+ProcSelfMaps::ProcSelfMaps(void* restoreAddr, size_t restoreLength, bool vmFlags)
+    : data(static_cast<char*>(restoreAddr)),
+    dataLength(restoreLength),
+    dataIdx(0),
+    numBytes(0),
+    eof(false),
+    useQuery(false),
+    queryAddr(0),
+    pagemapFd(-1),
+    hasPending(false),
+    lastEndAddr(nullptr)
 {
-    int fd = open("/proc/self/maps", O_RDONLY);
+    /* When transparent huge pages are enabled, we look for the areas that
+     * are backed by huge pages by scanning their pages. /proc/self/smaps
+     * gives the same information, but it is much slower to produce and to
+     * parse, so we only read it on kernels without the scan ioctl.
+     */
+    smaps = vmFlags;
+    if (!smaps && (hugePageSize() != 0)) {
+        pagemapFd = open("/proc/self/pagemap", O_RDONLY);
+        if ((pagemapFd == -1) || !scanHugePages(nullptr, 0)) {
+            if (pagemapFd != -1)
+                close(pagemapFd);
+            pagemapFd = -1;
+            smaps = true;
+        }
+    }
+
+    fd = open(smaps ? "/proc/self/smaps" : "/proc/self/maps", O_RDONLY);
     MYASSERT(fd != -1);
 
-    data = static_cast<char*>(restoreAddr);
+    /* The ioctl gives the same information without formatting and parsing
+     * text, but not the huge pages.
+     */
+    if (!smaps) {
+        Area area;
+        useQuery = queryArea(&area);
+        queryAddr = 0;
+    }
+}
 
-    numBytes = Utils::readAll(fd, data, restoreLength);
-    MYASSERT(numBytes > 0)
-    MYASSERT(numBytes < restoreLength)
+ProcSelfMaps::~ProcSelfMaps()
+{
+    if (fd != -1)
+        close(fd);
+    if (pagemapFd != -1)
+        close(pagemapFd);
+}
+
+bool ProcSelfMaps::scanHugePages(void* addr, size_t size)
+{
+    struct page_region region;
+    struct pm_scan_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.size = sizeof(arg);
+    arg.start = reinterpret_cast<uintptr_t>(addr);
+    arg.end = arg.start + size;
+    arg.vec = reinterpret_cast<uintptr_t>(&region);
+    arg.vec_len = 1;
+    arg.max_pages = 1;
+    arg.category_mask = PAGE_IS_HUGE;
+    arg.return_mask = PAGE_IS_HUGE;
+
+    /* With an empty range, this only checks that the ioctl is supported */
+    int ret = syscall(SYS_ioctl, pagemapFd, PAGEMAP_SCAN, &arg);
+    if (size == 0)
+        return ret != -1;
+    return ret > 0;
+}
 
+bool ProcSelfMaps::snapshot()
+{
+    useQuery = false;
+    hasPending = false;
+    lastEndAddr = nullptr;
+    dataIdx = 0;
+    MYASSERT(lseek(fd, 0, SEEK_SET) == 0)
+
+    ssize_t ret = Utils::readAll(fd, data, dataLength);
+    if ((ret <= 0) || (static_cast<size_t>(ret) == dataLength)) {
+        /* The file does not fit in our buffer */
+        numBytes = 0;
+        eof = false;
+        MYASSERT(lseek(fd, 0, SEEK_SET) == 0)
+        return false;
+    }
+
+    numBytes = ret;
+    eof = true;
     close(fd);
+    fd = -1;
+    return true;
+}
 
-    for (size_t i = 0; i < numBytes; i++) {
-        if (data[i] == '\n') {
-            numAreas++;
+void ProcSelfMaps::reset()
+{
+    hasPending = false;
+    lastEndAddr = nullptr;
+    queryAddr = 0;
+    dataIdx = 0;
+
+    /* A snapshot is kept in our buffer */
+    if (fd == -1)
+        return;
+
+    numBytes = 0;
+    eof = false;
+    MYASSERT(lseek(fd, 0, SEEK_SET) == 0)
+}
+
+bool ProcSelfMaps::ensureLine()
+{
+    while (true) {
+        if ((dataIdx < numBytes) && memchr(data + dataIdx, '\n', numBytes - dataIdx))
+            return true;
+
+        if (eof)
+            return false;
+
+        /* Move the partial line to the beginning of the buffer, and read
+         * the following data after it.
+         */
+        numBytes -= dataIdx;
+        memmove(data, data + dataIdx, numBytes);
+        dataIdx = 0;
+
+        /* Lines are always much smaller than our buffer */
+        MYASSERT(numBytes < dataLength)
+
+        ssize_t ret = read(fd, data + numBytes, dataLength - numBytes);
+        if (ret == -1) {
+            if ((errno == EINTR) || (errno == EAGAIN))
+                continue;
+            MYASSERT(false)
         }
+        if (ret == 0)
+            eof = true;
+        numBytes += ret;
     }
 }
 
+/* Settings of transparent huge pages */
+static size_t huge_page_size = -1;
+
+static void readHugePageSettings()
+{
+    if (huge_page_size != static_cast<size_t>(-1))
+        return;
+
+    huge_page_size = 0;
+
+    char buf[128];
+    int fd = open("/sys/kernel/mm/transparent_hugepage/enabled", O_RDONLY);
+    if (fd == -1)
+        return;
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return;
+    buf[len] = '\0';
+    if (strstr(buf, "[never]"))
+        return;
+
+    /* Older kernels don't expose the size, use the one of x86 */
+    huge_page_size = 2 * 1024 * 1024;
+    fd = open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", O_RDONLY);
+    if (fd == -1)
+        return;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len > 0) {
+        buf[len] = '\0';
+        size_t size = strtoul(buf, nullptr, 10);
+        if (size > 0)
+            huge_page_size = size;
+    }
+}
+
+size_t ProcSelfMaps::hugePageSize()
+{
+    readHugePageSettings();
+    return huge_page_size;
+}
+
 intptr_t ProcSelfMaps::readDec()
 {
     intptr_t v = 0;
@@ -90,13 +321,55 @@ intptr_t ProcSelfMaps::readHex()
     return v;
 }
 
-bool ProcSelfMaps::getNextArea(Area *area)
+void ProcSelfMaps::readSmapsFields(Area *area)
 {
-    if (dataIdx >= numBytes || data[dataIdx] == 0) {
-        area->addr = nullptr;
-        area->size = 0;
-        return false;
+    /* Field names start with an uppercase letter, while the next area starts
+     * with its address in lowercase hexadecimal.
+     */
+    while (ensureLine() && (data[dataIdx] >= 'A') && (data[dataIdx] <= 'Z')) {
+        const char* field = &data[dataIdx];
+        while ((dataIdx < numBytes) && (data[dataIdx] != ':') && (data[dataIdx] != '\n'))
+            dataIdx++;
+        MYASSERT(data[dataIdx++] == ':')
+
+        while (data[dataIdx] == ' ') {
+            dataIdx++;
+        }
+
+        if (strncmp(field, "AnonHugePages:", 14) == 0) {
+            if (readDec() > 0)
+                area->properties |= Area::HUGE_PAGES;
+        }
+        else if (strncmp(field, "VmFlags:", 8) == 0) {
+            /* Each flag is made of two letters */
+            while (data[dataIdx] != '\n') {
+                if ((data[dataIdx+2] == ' ') || (data[dataIdx+2] == '\n')) {
+                    /* Area advised with MADV_HUGEPAGE */
+                    if ((data[dataIdx] == 'h') && (data[dataIdx+1] == 'g'))
+                        area->properties |= Area::HUGE_PAGES;
+                    if ((data[dataIdx] == 'd') && (data[dataIdx+1] == 'c'))
+                        area->properties |= Area::DONT_COPY;
+                    if ((data[dataIdx] == 'd') && (data[dataIdx+1] == 'd'))
+                        area->properties |= Area::DONT_DUMP;
+                }
+                while ((data[dataIdx] != ' ') && (data[dataIdx] != '\n'))
+                    dataIdx++;
+                while (data[dataIdx] == ' ')
+                    dataIdx++;
+            }
+        }
+
+        while (data[dataIdx] != '\n') {
+            dataIdx++;
+        }
+        dataIdx++;
     }
+}
+
+bool ProcSelfMaps::parseArea(Area *area)
+{
+    if (!ensureLine())
+        return false;
 
     intptr_t addr = readHex();
     MYASSERT(addr != 0)
@@ -179,27 +452,181 @@ bool ProcSelfMaps::getNextArea(Area *area)
 
     area->properties = 0;
 
-    /* Somtetimes the [heap] is split into several contiguous segments, such as
+    readSmapsFields(area);
+
+    return true;
+}
+
+bool ProcSelfMaps::queryArea(Area *area)
+{
+    struct procmap_query query;
+    memset(&query, 0, sizeof(query));
+    query.size = sizeof(query);
+    query.query_flags = PROCMAP_QUERY_COVERING_OR_NEXT_VMA;
+    query.query_addr = queryAddr;
+    query.vma_name_addr = reinterpret_cast<uintptr_t>(area->name);
+    query.vma_name_size = sizeof(area->name);
+
+    if (syscall(SYS_ioctl, fd, PROCMAP_QUERY, &query) == -1) {
+        /* ENOENT means that there is no area left, and ENOTTY that the
+         * ioctl is not supported.
+         */
+        MYASSERT(useQuery == false || errno == ENOENT)
+        return false;
+    }
+
+    area->addr = reinterpret_cast<void*>(query.vma_start);
+    area->endAddr = reinterpret_cast<void*>(query.vma_end);
+    area->size = query.vma_end - query.vma_start;
+    area->offset = query.vma_offset;
+    area->devmajor = query.dev_major;
+    area->devminor = query.dev_minor;
+    area->inodenum = query.inode;
+    if (query.vma_name_size == 0)
+        area->name[0] = '\0';
+
+    area->prot = 0;
+    if (query.vma_flags & PROCMAP_QUERY_VMA_READABLE)
+        area->prot |= PROT_READ;
+    if (query.vma_flags & PROCMAP_QUERY_VMA_WRITABLE)
+        area->prot |= PROT_WRITE;
+    if (query.vma_flags & PROCMAP_QUERY_VMA_EXECUTABLE)
+        area->prot |= PROT_EXEC;
+
+    area->flags = MAP_FIXED;
+    area->flags |= (query.vma_flags & PROCMAP_QUERY_VMA_SHARED) ? MAP_SHARED : MAP_PRIVATE;
+    if (area->name[0] == '\0')
+        area->flags |= MAP_ANONYMOUS;
+
+    area->properties = 0;
+
+    queryAddr = query.vma_end;
+    return true;
+}
+
+bool ProcSelfMaps::readArea(Area *area)
+{
+    while (true) {
+        bool valid = useQuery ? queryArea(area) : parseArea(area);
+        if (!valid)
+            return false;
+
+        /* Mappings can be modified while we read them, when restoring a
+         * savestate or changing the protection of an area. An area that was
+         * merged with one we already read can start before it, so we only
+         * keep its new part.
+         */
+        if (area->endAddr <= lastEndAddr)
+            continue;
+
+        if (area->addr < lastEndAddr) {
+            size_t skipped = static_cast<char*>(lastEndAddr) - static_cast<char*>(area->addr);
+            area->addr = lastEndAddr;
+            area->size -= skipped;
+            if (!(area->flags & MAP_ANONYMOUS))
+                area->offset += skipped;
+        }
+
+        lastEndAddr = area->endAddr;
+        return true;
+    }
+}
+
+/* Returns if the area overlaps our reserved memory, which must stay a
+ * separate area so that it is recognized and skipped.
+ */
+static bool isReserved(const Area *area)
+{
+    return (area->endAddr > ReservedMemory::getAddr(0)) &&
+        (area->addr < ReservedMemory::getAddr(ReservedMemory::getSize()));
+}
+
+/* Returns if `next_area` can be appended to `area` */
+static bool canMerge(const Area *area, const Area *next_area)
+{
+    if (area->endAddr != next_area->addr)
+        return false;
+
+    if ((area->prot != next_area->prot) || (area->flags != next_area->flags))
+        return false;
+
+    if (strcmp(area->name, next_area->name) != 0)
+        return false;
+
+    /* Areas that are missing in a child process must stay separate, so
+     * that the rest of the range can be saved by a forked process.
+     */
+    if ((area->properties ^ next_area->properties) & (Area::DONT_COPY | Area::DONT_DUMP))
+        return false;
+
+    /* Special sections other than the heap are kept as is */
+    if ((area->name[0] == '[') && (strcmp(area->name, "[heap]") != 0))
+        return false;
+
+    /* File-backed areas must map contiguous parts of the same file */
+    if (area->name[0] == '/') {
+        if ((area->devmajor != next_area->devmajor) ||
+            (area->devminor != next_area->devminor) ||
+            (area->inodenum != next_area->inodenum) ||
+            (next_area->offset != static_cast<off_t>(area->offset + area->size)))
+            return false;
+    }
+
+    if (isReserved(area) || isReserved(next_area))
+        return false;
+
+    return true;
+}
+
+bool ProcSelfMaps::getNextArea(Area *area)
+{
+    if (hasPending) {
+        *area = pending;
+        hasPending = false;
+    }
+    else if (!readArea(area)) {
+        area->addr = nullptr;
+        area->size = 0;
+        return false;
+    }
+
+    /* The kernel often keeps adjacent mappings with the same protection and
+     * backing as separate areas (different anon_vma, soft-dirty or userfaultfd
+     * state, etc.). We coalesce them, so that saving and restoring issue a
+     * single set of syscalls (mmap, mprotect, msync...) for the whole range.
+     *
+     * Somtetimes the [heap] is split into several contiguous segments, such as
      * after a dumping was made (but why...?). This can screw up our code for
      * loading and remapping the [heap] using brk, so we always read the [heap]
      * as one single segment.
+     *
+     * The following area is kept for the next call if it cannot be merged.
      */
-    if (strcmp(area->name, "[heap]") == 0) {
-        Area next_area;
-        size_t curDataIdx = dataIdx;
-        bool valid = getNextArea(&next_area); // recursive call
-        if (valid && (strcmp(next_area.name, "[heap]") == 0)) {
-            MYASSERT(area->endAddr == next_area.addr)
-            MYASSERT(area->prot == next_area.prot)
-            MYASSERT(area->flags == next_area.flags)
-            area->endAddr = next_area.endAddr;
-            area->size += next_area.size;
+    while (readArea(&pending)) {
+        if ((strcmp(area->name, "[heap]") == 0) && (strcmp(pending.name, "[heap]") == 0)) {
+            MYASSERT(area->endAddr == pending.addr)
+            MYASSERT(area->prot == pending.prot)
+            MYASSERT(area->flags == pending.flags)
         }
-        else {
-            dataIdx = curDataIdx;
+
+        if (!canMerge(area, &pending)) {
+            hasPending = true;
+            break;
         }
+
+        area->endAddr = pending.endAddr;
+        area->size += pending.size;
+        area->properties |= pending.properties;
     }
 
+    /* Only writable areas that are not backed by a file can hold enough
+     * modified memory to be worth looking for huge pages.
+     */
+    if ((pagemapFd != -1) && (area->prot & PROT_WRITE) && (area->flags & MAP_PRIVATE) &&
+        (area->name[0] != '/') && (area->size >= hugePageSize()) &&
+        !isReserved(area) && scanHugePages(area->addr, area->size))
+        area->properties |= Area::HUGE_PAGES;
+
     return true;
 }
 
@@ -25,21 +25,84 @@
 #include "ProcMapsArea.h"
 
 namespace libtas {
+/* Read the memory areas of our process. The file is read by chunks into the
+ * given buffer, or areas are queried with an ioctl when available, so that
+ * any number of areas can be read without allocating memory.
+ */
 class ProcSelfMaps
 {
     public:
-        ProcSelfMaps(void* restoreAddr, size_t restoreLength);
+        /* If `vmFlags` is true, /proc/self/smaps is read to know which areas
+         * are not copied into a child process.
+         */
+        ProcSelfMaps(void* restoreAddr, size_t restoreLength, bool vmFlags = false);
+        ~ProcSelfMaps();
 
+        /* Read the next area, coalesced with the following contiguous
+         * areas that share the same protection, flags and backing.
+         */
         bool getNextArea(Area *area);
 
+        /* Go back to the first area */
+        void reset();
+
+        /* Read all areas into our buffer, so that they can be read after the
+         * mappings changed, such as from a forked process. Returns false if
+         * they don't fit, in which case areas are still read by chunks.
+         */
+        bool snapshot();
+
+        /* Size of transparent huge pages, or 0 if they are disabled */
+        static size_t hugePageSize();
+
     private:
+        /* Read the next area, skipping what was already read */
+        bool readArea(Area *area);
+
+        /* Parse the next area of the file */
+        bool parseArea(Area *area);
+
+        /* Query the next area using the PROCMAP_QUERY ioctl */
+        bool queryArea(Area *area);
+
+        /* Make sure that the buffer holds a whole line at the current
+         * position. Returns false at the end of the file.
+         */
+        bool ensureLine();
+
         intptr_t readDec();
         intptr_t readHex();
 
+        /* Read the fields of /proc/self/smaps that follow an area */
+        void readSmapsFields(Area *area);
+
+        /* Returns if a range holds a transparent huge page, using the
+         * PAGEMAP_SCAN ioctl. With an empty range, returns if the ioctl is
+         * supported.
+         */
+        bool scanHugePages(void* addr, size_t size);
+
+        int fd;
+        bool smaps;
+
         char *data;
+        size_t dataLength;
         size_t dataIdx;
-        size_t numAreas;
         size_t numBytes;
+        bool eof;
+
+        bool useQuery;
+        uintptr_t queryAddr;
+
+        /* /proc/self/pagemap, to look for huge pages, or -1 */
+        int pagemapFd;
+
+        /* Area read after the last returned one, which could not be merged */
+        Area pending;
+        bool hasPending;
+
+        /* End of the last area that was read */
+        void* lastEndAddr;
 };
 }
 
@@ -0,0 +1,114 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ProcSelfPagemap.h"
+#include "StateStats.h"
+#include "../logging.h"
+#include "Utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace libtas {
+
+ProcSelfPagemap::ProcSelfPagemap(void* restoreAddr, size_t restoreLength)
+{
+    fd = open("/proc/self/pagemap", O_RDONLY);
+    MYASSERT(fd != -1);
+
+    entries = static_cast<uint64_t*>(restoreAddr);
+    numEntries = restoreLength / sizeof(uint64_t);
+    zeroPfn = 0;
+}
+
+ProcSelfPagemap::~ProcSelfPagemap()
+{
+    close(fd);
+}
+
+const uint64_t* ProcSelfPagemap::getEntries(const void* addr, size_t count)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    MYASSERT(count <= numEntries)
+
+    off_t offset = (reinterpret_cast<uintptr_t>(addr) / page_size) * sizeof(uint64_t);
+    ssize_t size = count * sizeof(uint64_t);
+
+    if (Utils::preadAll(fd, entries, size, offset) != size) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not read pagemap entries at %p", addr);
+        return nullptr;
+    }
+
+    StateStats::addPages(count);
+    return entries;
+}
+
+bool ProcSelfPagemap::findZeroPage()
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    zeroPfn = 0;
+
+    /* Reading a fresh private anonymous page maps it to the zero page */
+    void* addr = mmap(nullptr, page_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return false;
+
+    MYASSERT(static_cast<volatile char*>(addr)[0] == 0)
+
+    const uint64_t* entry = getEntries(addr, 1);
+    if (entry && isPresent(*entry))
+        zeroPfn = getPfn(*entry);
+
+    munmap(addr, page_size);
+    return zeroPfn != 0;
+}
+
+bool ProcSelfPagemap::clearSoftDirty(void* probeAddr)
+{
+    int crfd = open("/proc/self/clear_refs", O_WRONLY);
+    if (crfd == -1) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not open /proc/self/clear_refs");
+        return false;
+    }
+
+    /* Writing 4 to this file clears the soft-dirty bits */
+    ssize_t rc = write(crfd, "4", 1);
+    close(crfd);
+    if (rc != 1) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not clear soft-dirty bits");
+        return false;
+    }
+
+    /* Some kernels are built without soft-dirty support, in which case the
+     * bit is never set. Check that writing to a page does set it.
+     */
+    static_cast<volatile char*>(probeAddr)[0] = 0;
+
+    ProcSelfPagemap pagemap(probeAddr, sizeof(uint64_t));
+    const uint64_t* entry = pagemap.getEntries(probeAddr, 1);
+    if (!entry || !isSoftDirty(*entry)) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Soft-dirty bits are not supported by the kernel");
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBTAS_PROCSELFPAGEMAP_H
+#define LIBTAS_PROCSELFPAGEMAP_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace libtas {
+/* Read entries from /proc/self/pagemap, which describe for each page if it is
+ * present in memory, swapped, or if it was written since the last time the
+ * soft-dirty bits were cleared (see Documentation/vm/soft-dirty.txt in the
+ * linux kernel).
+ */
+class ProcSelfPagemap
+{
+    public:
+        /* Entries are read into the given buffer, so that we don't allocate
+         * memory in the checkpoint code.
+         */
+        ProcSelfPagemap(void* restoreAddr, size_t restoreLength);
+        ~ProcSelfPagemap();
+
+        /* Read the entries of `count` pages starting at `addr`. `count` must
+         * not exceed maxPages(). Returns nullptr on failure.
+         */
+        const uint64_t* getEntries(const void* addr, size_t count);
+
+        size_t maxPages() const { return numEntries; }
+
+        static bool isPresent(uint64_t entry) { return entry & (1ULL << 63); }
+        static bool isSwapped(uint64_t entry) { return entry & (1ULL << 62); }
+        static bool isSoftDirty(uint64_t entry) { return entry & (1ULL << 55); }
+
+        /* Page is a page of a file or of shared anonymous memory. A present
+         * page of a private file mapping without this flag is a copy-on-write
+         * copy of the file page.
+         */
+        static bool isFilePage(uint64_t entry) { return entry & (1ULL << 61); }
+
+        /* Page frame number of a present page. It reads as zero if we don't
+         * have the CAP_SYS_ADMIN capability.
+         */
+        static uint64_t getPfn(uint64_t entry) { return entry & ((1ULL << 55) - 1); }
+
+        /* Look for the page frame of the shared zero page, which backs pages
+         * of private anonymous mappings that were read but never written.
+         * Returns false if it could not be determined.
+         */
+        bool findZeroPage();
+
+        /* Returns if the page is mapped to the shared zero page */
+        bool isZeroPage(uint64_t entry) const
+        {
+            return zeroPfn && isPresent(entry) && (getPfn(entry) == zeroPfn);
+        }
+
+        /* Clear the soft-dirty bits of all pages. Returns false if the kernel
+         * does not track soft-dirty pages. The first page of `probeAddr` is
+         * written to check that tracking works, so it must be writeable memory
+         * that is never saved.
+         */
+        static bool clearSoftDirty(void* probeAddr);
+
+    private:
+        int fd;
+        uint64_t *entries;
+        size_t numEntries;
+        uint64_t zeroPfn;
+};
+}
+
+#endif
@@ -23,9 +23,6 @@
 #include "../logging.h"
 #include <sys/mman.h>
 
-#define ONE_MB 1024 * 1024
-#define RESTORE_TOTAL_SIZE 5 * ONE_MB
-
 namespace libtas {
 
 static intptr_t restoreAddr = 0;
@@ -44,6 +41,16 @@ void ReservedMemory::init()
         MYASSERT(addr != MAP_FAILED)
         restoreAddr = reinterpret_cast<intptr_t>(addr) + 4096;
         MYASSERT(mprotect(reinterpret_cast<void*>(restoreAddr), restoreLength, PROT_READ | PROT_WRITE) == 0)
+
+        /* The page pool index is shared with forked processes */
+        void* pool = mmap(getAddr(POOL_ADDR), POOL_SIZE, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        MYASSERT(pool != MAP_FAILED)
+
+        /* Statistics of savestates are also filled by forked processes */
+        void* stats = mmap(getAddr(STATS_ADDR), STATS_SIZE, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+        MYASSERT(stats != MAP_FAILED)
         // debuglogstdio(LCF_ERROR, "Setup reserved space from %p to %p", reinterpret_cast<void*>(restoreAddr+ONE_MB), reinterpret_cast<void*>(restoreAddr+restoreLength));
     }
 }
@@ -27,6 +27,127 @@
 
 namespace libtas {
 namespace ReservedMemory {
+    /* Layout of the reserved memory. Each section is used by a specific part
+     * of the checkpoint code, and is never saved nor restored in savestates.
+     */
+    enum {
+        ONE_MB = 1024 * 1024,
+
+        /* Maximum number of threads working on a savestate, including the
+         * checkpoint thread. Some sections hold one buffer per worker.
+         */
+        WORKER_COUNT = 8,
+
+        /* Buffer holding the content of /proc/self/maps, or the larger
+         * /proc/self/smaps when transparent huge pages are enabled. Only the
+         * part that is used gets allocated by the kernel.
+         */
+        PSM_ADDR = 0,
+        PSM_SIZE = 8 * ONE_MB,
+
+        /* Information about savestate slots that must survive a restore */
+        SSM_ADDR = PSM_ADDR + PSM_SIZE,
+        SSM_SIZE = 4096,
+
+        /* Barrier and timings of the threads suspended during a checkpoint */
+        THREAD_ADDR = SSM_ADDR + SSM_SIZE,
+        THREAD_SIZE = 4096,
+
+        /* Buffer holding entries of /proc/self/pagemap */
+        PAGEMAP_ADDR = THREAD_ADDR + THREAD_SIZE,
+        PAGEMAP_SIZE = 4096,
+
+        /* Hashes of the pages stored in a savestate. Only the part that is
+         * used gets allocated by the kernel.
+         */
+        HASH_ADDR = PAGEMAP_ADDR + PAGEMAP_SIZE,
+        HASH_SIZE = 32 * ONE_MB,
+
+        /* Table of contents of a savestate. Only the part that is used gets
+         * allocated by the kernel.
+         */
+        TOC_ADDR = HASH_ADDR + HASH_SIZE,
+        TOC_SIZE = 8 * ONE_MB,
+
+        /* Buffers holding compressed data of savestate blocks, one for each
+         * block compressed or decompressed at the same time. ZBUF_SIZE is the
+         * size of one buffer.
+         */
+        ZBUF_ADDR = TOC_ADDR + TOC_SIZE,
+        ZBUF_SIZE = 512 * 1024,
+
+        /* Buffer holding a decompressed savestate block */
+        BLOCK_ADDR = ZBUF_ADDR + ZBUF_SIZE * WORKER_COUNT,
+        BLOCK_SIZE = 256 * 1024,
+
+        /* Buffer holding the small pieces of a savestate, such as area
+         * headers, until they are written in a batch.
+         */
+        IO_ADDR = BLOCK_ADDR + BLOCK_SIZE,
+        IO_SIZE = 256 * 1024,
+
+        /* Workspaces of the compression library, one for each worker.
+         * CODEC_SIZE is the size of one workspace.
+         */
+        CODEC_ADDR = IO_ADDR + IO_SIZE,
+        CODEC_SIZE = 4 * ONE_MB,
+
+        /* State of the threads helping to write and read savestates, and
+         * their stacks, which also hold their thread-local storage.
+         */
+        HELPER_ADDR = CODEC_ADDR + CODEC_SIZE * WORKER_COUNT,
+        HELPER_SIZE = 4096,
+        HELPER_STACK_ADDR = HELPER_ADDR + HELPER_SIZE,
+        HELPER_STACK_SIZE = ONE_MB,
+
+        /* State of the lazy restore of a savestate */
+        LAZY_ADDR = HELPER_STACK_ADDR + HELPER_STACK_SIZE * (WORKER_COUNT - 1),
+        LAZY_SIZE = ONE_MB,
+
+        /* Buffer used to fill all remaining lazily restored pages */
+        LAZY_BUFFER_ADDR = LAZY_ADDR + LAZY_SIZE,
+        LAZY_BUFFER_SIZE = ONE_MB,
+
+        /* Buffer and stack of the thread filling lazily restored pages. The
+         * stack also holds its thread-local storage.
+         */
+        LAZY_HELPER_BUFFER_ADDR = LAZY_BUFFER_ADDR + LAZY_BUFFER_SIZE,
+        LAZY_HELPER_BUFFER_SIZE = 64 * 1024,
+        LAZY_STACK_ADDR = LAZY_HELPER_BUFFER_ADDR + LAZY_HELPER_BUFFER_SIZE,
+        LAZY_STACK_SIZE = ONE_MB,
+
+        /* Arena holding the internal state of libTAS that must not be
+         * restored. Only the part that is used gets allocated by the kernel.
+         */
+        ARENA_ADDR = LAZY_STACK_ADDR + LAZY_STACK_SIZE,
+        ARENA_SIZE = 16 * ONE_MB,
+
+        /* Rules excluding memory areas from savestates, and their audit */
+        RULES_ADDR = ARENA_ADDR + ARENA_SIZE,
+        RULES_SIZE = 64 * 1024,
+
+        /* Statistics of each area of the last savestate or loadstate. This
+         * section is mapped as shared memory, so that it is filled by the
+         * processes that write savestates in the background. Only the part
+         * that is used gets allocated by the kernel.
+         */
+        STATS_ADDR = RULES_ADDR + RULES_SIZE,
+        STATS_SIZE = 16 * ONE_MB,
+
+        /* Index of the pages shared by savestates. This section is mapped as
+         * shared memory, so that it is also modified by the processes that
+         * write savestates in the background.
+         */
+        POOL_ADDR = STATS_ADDR + STATS_SIZE,
+        POOL_SIZE = 160 * ONE_MB,
+
+        /* Alternate stack used by the checkpoint signal handler */
+        STACK_ADDR = POOL_ADDR + POOL_SIZE,
+        STACK_SIZE = 4 * ONE_MB,
+
+        RESTORE_TOTAL_SIZE = STACK_ADDR + STACK_SIZE
+    };
+
     void init();
     void* getAddr(intptr_t offset);
     size_t getSize();
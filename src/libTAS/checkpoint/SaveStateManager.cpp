@@ -0,0 +1,356 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SaveStateManager.h"
+#include "ReservedMemory.h"
+#include "StateHeader.h"
+#include "PagePool.h"
+#include "Utils.h"
+#include "../logging.h"
+#include "../global.h" // shared_config
+#include <fcntl.h>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h> // MFD_CLOEXEC
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <cerrno>
+
+namespace libtas {
+
+/* Slot information is stored in our reserved memory, because the content of
+ * this structure must not be modified when loading a savestate. Otherwise,
+ * we would lose track of in-memory savestates that were created after the
+ * loaded one.
+ */
+struct SlotTable {
+    /* File descriptor of the memfd holding each in-memory savestate */
+    int ram_fds[SAVESTATE_MAX_SLOTS];
+
+    /* Is there a valid base savestate for incremental savestates */
+    bool base_valid;
+
+    /* Path of the base savestate when stored on disk */
+    char base_path[1024];
+
+    /* Slot of the savestate whose modified pages are tracked */
+    int tracked_slot;
+
+    /* Pid of the child processes that are writing savestates */
+    pid_t fork_pids[SAVESTATE_MAX_SLOTS];
+};
+
+static_assert(sizeof(SlotTable) <= ReservedMemory::SSM_SIZE, "Slot table does not fit in reserved memory");
+
+static SlotTable* getSlotTable()
+{
+    return static_cast<SlotTable*>(ReservedMemory::getAddr(ReservedMemory::SSM_ADDR));
+}
+
+void SaveStateManager::init()
+{
+    SlotTable* st = getSlotTable();
+    for (int i=0; i<SAVESTATE_MAX_SLOTS; i++) {
+        st->ram_fds[i] = -1;
+        st->fork_pids[i] = 0;
+    }
+    st->base_valid = false;
+    st->base_path[0] = '\0';
+    st->tracked_slot = -1;
+}
+
+/* Keyframes are always stored in memory */
+static bool isInMemory(int slot)
+{
+    return (shared_config.savestate_settings & SharedConfig::SS_RAM) ||
+        ((slot >= SAVESTATE_KEYFRAME_SLOT) && (slot < (SAVESTATE_KEYFRAME_SLOT + SAVESTATE_KEYFRAME_COUNT)));
+}
+
+/* Create an anonymous file to hold the savestate of a slot */
+static int createMemoryState(int slot)
+{
+    int fd = syscall(SYS_memfd_create, "libtas_savestate", MFD_CLOEXEC);
+    MYASSERT(fd != -1)
+    getSlotTable()->ram_fds[slot] = fd;
+    return fd;
+}
+
+void SaveStateManager::prepareState(int slot)
+{
+    if ((slot < 0) || (slot >= SAVESTATE_MAX_SLOTS))
+        return;
+
+    if (isInMemory(slot) && (getSlotTable()->ram_fds[slot] == -1))
+        createMemoryState(slot);
+}
+
+int SaveStateManager::openState(int slot, const char* path, bool write)
+{
+    int fd;
+
+    waitForFork(slot);
+
+    if (isInMemory(slot)) {
+        if ((slot < 0) || (slot >= SAVESTATE_MAX_SLOTS)) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Savestate slot %d is out of range", slot);
+            return -1;
+        }
+
+        fd = getSlotTable()->ram_fds[slot];
+
+        if (write && (fd == -1)) {
+            fd = createMemoryState(slot);
+        }
+
+        /* We keep the old content when writing over an existing state, so
+         * that the pages of the file don't have to be reallocated. The file
+         * is truncated to its new size in closeState().
+         */
+        if (fd != -1) {
+            MYASSERT(lseek(fd, 0, SEEK_SET) == 0)
+        }
+        return fd;
+    }
+
+    if (write) {
+        unlink(path);
+        OWNCALL(fd = creat(path, 0644));
+    }
+    else {
+        OWNCALL(fd = open(path, O_RDONLY));
+    }
+    return fd;
+}
+
+void SaveStateManager::closeState(int fd, bool write)
+{
+    SlotTable* st = getSlotTable();
+    for (int i=0; i<SAVESTATE_MAX_SLOTS; i++) {
+        if (st->ram_fds[i] == fd) {
+            if (!write)
+                return;
+
+            /* Remove the remaining content of a previous savestate */
+            off_t size = lseek(fd, 0, SEEK_CUR);
+            MYASSERT(size != -1)
+            MYASSERT(ftruncate(fd, size) == 0)
+            return;
+        }
+    }
+
+    MYASSERT(close(fd) == 0)
+}
+
+bool SaveStateManager::exportState(int slot, const char* path)
+{
+    if ((slot < 0) || (slot >= SAVESTATE_MAX_SLOTS))
+        return false;
+
+    waitForFork(slot);
+
+    int ramfd = getSlotTable()->ram_fds[slot];
+    if (ramfd == -1)
+        return false;
+
+    /* Savestates that use the page pool don't hold their pages */
+    StateHeader sh;
+    if ((Utils::preadAll(ramfd, &sh, sizeof(sh), 0) == sizeof(sh)) &&
+        (memcmp(sh.magic, STATE_MAGIC, STATE_MAGIC_SIZE) == 0) && (sh.pool_id != 0)) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR | LCF_ALERT, "Savestates sharing their pages cannot be exported");
+        return false;
+    }
+
+    struct stat sb;
+    MYASSERT(fstat(ramfd, &sb) == 0)
+
+    int fd;
+    unlink(path);
+    OWNCALL(fd = creat(path, 0644));
+    if (fd == -1) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Could not create file %s", path);
+        return false;
+    }
+
+    /* Copy the whole memfd inside the kernel */
+    off_t offset = 0;
+    while (offset < sb.st_size) {
+        ssize_t ret = sendfile(fd, ramfd, &offset, sb.st_size - offset);
+        if (ret <= 0) {
+            debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Exporting savestate to %s failed", path);
+            close(fd);
+            unlink(path);
+            return false;
+        }
+    }
+
+    close(fd);
+    debuglogstdio(LCF_CHECKPOINT, "Exported savestate %d to %s", slot, path);
+    return true;
+}
+
+void SaveStateManager::releasePages(int slot, const char* path)
+{
+    int fd = openState(slot, path, false);
+    if (fd == -1)
+        return;
+
+    StateHeader sh;
+    if ((Utils::preadAll(fd, &sh, sizeof(sh), 0) == sizeof(sh)) &&
+        (memcmp(sh.magic, STATE_MAGIC, STATE_MAGIC_SIZE) == 0) &&
+        (sh.pool_id != 0) && (sh.pool_id == PagePool::getId())) {
+
+        uint64_t hashes[512];
+        const size_t chunk = sizeof(hashes) / sizeof(hashes[0]);
+        for (size_t i = 0; i < sh.hash_count; i += chunk) {
+            size_t n = sh.hash_count - i;
+            if (n > chunk)
+                n = chunk;
+            ssize_t size = n * sizeof(uint64_t);
+            if (Utils::preadAll(fd, hashes, size, sh.hash_offset + i * sizeof(uint64_t)) != size)
+                break;
+            for (size_t j = 0; j < n; j++)
+                PagePool::releasePage(hashes[j]);
+        }
+    }
+
+    closeState(fd, false);
+}
+
+void SaveStateManager::deleteState(int slot, const char* path)
+{
+    if ((slot < 0) || (slot >= SAVESTATE_MAX_SLOTS))
+        return;
+
+    /* Processes writing savestates in the background may be using the
+     * page pool.
+     */
+    waitForAllForks();
+    releasePages(slot, path);
+
+    SlotTable* st = getSlotTable();
+    if (st->tracked_slot == slot)
+        st->tracked_slot = -1;
+
+    if (st->ram_fds[slot] != -1) {
+        MYASSERT(close(st->ram_fds[slot]) == 0)
+        st->ram_fds[slot] = -1;
+    }
+    else {
+        unlink(path);
+    }
+    debuglogstdio(LCF_CHECKPOINT, "Deleted savestate %d", slot);
+}
+
+uint64_t SaveStateManager::getStateSize(int slot, const char* path)
+{
+    int fd = openState(slot, path, false);
+    if (fd == -1)
+        return 0;
+
+    /* Count the blocks that are allocated, because savestates have holes */
+    uint64_t size = 0;
+    struct stat sb;
+    if (fstat(fd, &sb) == 0)
+        size = static_cast<uint64_t>(sb.st_blocks) * 512;
+
+    StateHeader sh;
+    if ((Utils::preadAll(fd, &sh, sizeof(sh), 0) == sizeof(sh)) &&
+        (memcmp(sh.magic, STATE_MAGIC, STATE_MAGIC_SIZE) == 0))
+        size += sh.pool_size;
+
+    closeState(fd, false);
+    return size;
+}
+
+void SaveStateManager::setBasePath(const char* path)
+{
+    SlotTable* st = getSlotTable();
+    strncpy(st->base_path, path, sizeof(st->base_path) - 1);
+    st->base_path[sizeof(st->base_path) - 1] = '\0';
+}
+
+int SaveStateManager::openBaseState(bool write)
+{
+    return openState(SAVESTATE_BASE_SLOT, getSlotTable()->base_path, write);
+}
+
+bool SaveStateManager::hasBaseState()
+{
+    return getSlotTable()->base_valid;
+}
+
+void SaveStateManager::setBaseState(bool valid)
+{
+    getSlotTable()->base_valid = valid;
+}
+
+int SaveStateManager::getTrackedSlot()
+{
+    return getSlotTable()->tracked_slot;
+}
+
+void SaveStateManager::setTrackedSlot(int slot)
+{
+    getSlotTable()->tracked_slot = slot;
+}
+
+void SaveStateManager::setForkPid(int slot, pid_t pid)
+{
+    getSlotTable()->fork_pids[slot] = pid;
+}
+
+void SaveStateManager::waitForFork(int slot)
+{
+    if ((slot < 0) || (slot >= SAVESTATE_MAX_SLOTS))
+        return;
+
+    SlotTable* st = getSlotTable();
+    pid_t pid = st->fork_pids[slot];
+    if (pid <= 0)
+        return;
+
+    /* Child processes don't send a signal when exiting, so we need __WALL.
+     * If the pid is not our child anymore, waitpid() returns immediately.
+     */
+    int status;
+    pid_t ret;
+    do {
+        ret = waitpid(pid, &status, __WALL);
+    } while ((ret == -1) && (errno == EINTR));
+
+    if ((ret == pid) && !(WIFEXITED(status) && (WEXITSTATUS(status) == 0))) {
+        debuglogstdio(LCF_CHECKPOINT | LCF_ERROR, "Writing savestate %d in the background failed", slot);
+    }
+
+    /* The same process may write several slots */
+    for (int i=0; i<SAVESTATE_MAX_SLOTS; i++) {
+        if (st->fork_pids[i] == pid)
+            st->fork_pids[i] = 0;
+    }
+}
+
+void SaveStateManager::waitForAllForks()
+{
+    for (int i=0; i<SAVESTATE_MAX_SLOTS; i++)
+        waitForFork(i);
+}
+
+}
@@ -0,0 +1,103 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBTAS_SAVESTATEMANAGER_H
+#define LIBTAS_SAVESTATEMANAGER_H
+
+#include "../../shared/messages.h" // SAVESTATE_MAX_SLOTS
+#include <sys/types.h> // pid_t
+#include <cstdint>
+
+namespace libtas {
+namespace SaveStateManager
+{
+    /* Initialize the slot table. Must be called after ReservedMemory::init() */
+    void init();
+
+    /* Open the savestate of a slot. When savestates are stored in memory, which
+     * is always the case for keyframes, this returns the memfd associated with
+     * the slot (or -1 for reading if there is no state in this slot),
+     * otherwise the file at `path` is opened.
+     * This function does not allocate any memory, so it can be called from
+     * the checkpoint signal handler.
+     */
+    int openState(int slot, const char* path, bool write);
+
+    /* Create the memfd of a slot if its savestate is stored in memory. This
+     * must be done before writing the savestate from a child process, because
+     * a file descriptor opened by the child is not shared with us.
+     */
+    void prepareState(int slot);
+
+    /* Close a savestate file descriptor returned by openState(). In-memory
+     * savestates are kept open, and truncated to their new size if they were
+     * just written.
+     */
+    void closeState(int fd, bool write);
+
+    /* Copy the in-memory savestate of a slot into a file */
+    bool exportState(int slot, const char* path);
+
+    /* Remove the references of the savestate of a slot to the pages shared
+     * by savestates. This is done before the savestate is overwritten or
+     * deleted. This function does not allocate any memory.
+     */
+    void releasePages(int slot, const char* path);
+
+    /* Remove the savestate of a slot, in memory or on disk */
+    void deleteState(int slot, const char* path);
+
+    /* Number of bytes used by the savestate of a slot, in memory or in the
+     * file at `path`, including the pages that it added to the page pool.
+     * The savestate being written in the background is waited.
+     */
+    uint64_t getStateSize(int slot, const char* path);
+
+    /* Set the file path of the base savestate */
+    void setBasePath(const char* path);
+
+    /* Open the base savestate, in memory or on disk */
+    int openBaseState(bool write);
+
+    /* Returns if a base savestate was written, and if modified pages have
+     * been tracked since.
+     */
+    bool hasBaseState();
+    void setBaseState(bool valid);
+
+    /* Slot of the savestate that was last saved or loaded, if the pages
+     * modified since then are tracked with the soft-dirty bits, or -1.
+     */
+    int getTrackedSlot();
+    void setTrackedSlot(int slot);
+
+    /* Register the child process that is writing the savestate of a slot */
+    void setForkPid(int slot, pid_t pid);
+
+    /* Wait for the child process writing the savestate of a slot, if any.
+     * This is done before accessing a savestate.
+     */
+    void waitForFork(int slot);
+
+    /* Wait for all the child processes writing savestates */
+    void waitForAllForks();
+}
+}
+
+#endif
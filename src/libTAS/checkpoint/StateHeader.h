@@ -23,18 +23,127 @@
 #define LIBTAS_STATEHEADER_H
 
 #include <pthread.h>
+#include <cstdint>
 
 #define STATEMAXTHREADS 100
 
+/* Savestates start with this magic string, followed by the format version.
+ * Savestates of version 1 have no magic string.
+ */
+#define STATE_MAGIC "LIBTASSS"
+#define STATE_MAGIC_SIZE 8
+#define STATE_VERSION 2
+
 namespace libtas {
+
+/* Layout of a savestate (version 2):
+ * - the StateHeader, which takes one page so that data can be page-aligned
+ * - for each area, an AreaDescriptor followed by the area name, then the
+ *   stored data of the area. Uncompressed data of areas that are fully
+ *   stored starts at a page boundary.
+ * - an AreaDescriptor with a null address, marking the end of areas
+ * - the hashes of all stored pages, which also identify them in the page
+ *   pool if it is used
+ * - the table of contents, with a StateTocEntry for each area
+ */
 union StateHeader {
     struct {
+        char magic[STATE_MAGIC_SIZE];
+        int version;
+
         int thread_count;
         pthread_t pthread_ids[STATEMAXTHREADS];
         pid_t tids[STATEMAXTHREADS];
+
+        /* Compression algorithm of page data */
+        int compression;
+
+        /* Location of the hashes of stored pages */
+        off_t hash_offset;
+        size_t hash_count;
+
+        /* Location of the table of contents. It is empty if there were too
+         * many areas to index.
+         */
+        off_t toc_offset;
+        size_t toc_count;
+
+        /* Identifier of the page pool holding the stored pages, or 0 if
+         * pages are stored in the savestate. In the first case, only the
+         * pages that have no hash are stored in the savestate.
+         */
+        uint64_t pool_id;
+
+        /* Size of the pages that this savestate added to the page pool, when
+         * they were not referenced by another savestate.
+         */
+        uint64_t pool_size;
+
+        /* Identification of the execution of the game that wrote the
+         * savestate, or 0 for older savestates. A savestate of another
+         * execution can only be loaded if the game and its memory layout
+         * are identical.
+         */
+        uint64_t execution_id;
+        uint64_t exe_dev;
+        uint64_t exe_ino;
+        uint64_t exe_addr; // program headers of the game executable
+        uint64_t lib_addr; // our library
+        uint64_t stack_addr; // auxiliary vector on the main stack
+
+        /* If pages of the savestate are stored in the base savestate */
+        int incremental;
     };
     char _padding[4096];
 };
+
+/* Header of savestates of version 1, which was followed by full Area
+ * structures.
+ */
+union StateHeaderV1 {
+    struct {
+        int thread_count;
+        pthread_t pthread_ids[STATEMAXTHREADS];
+        pid_t tids[STATEMAXTHREADS];
+    };
+    char _padding[4096];
+};
+
+/* Description of a memory area in a savestate, followed by `name_len` bytes
+ * of the area name.
+ */
+struct AreaDescriptor {
+    uint64_t addr;
+    uint64_t size;
+    int64_t offset;
+    uint64_t devmajor;
+    uint64_t devminor;
+    uint64_t inodenum;
+    int32_t prot;
+    int32_t flags;
+    int32_t properties;
+    uint32_t name_len;
+};
+
+/* Entry of the table of contents, to access an area without parsing the
+ * savestate.
+ */
+struct StateTocEntry {
+    uint64_t addr;
+    uint64_t size;
+    int32_t properties;
+    int32_t _reserved;
+
+    /* Location of the AreaDescriptor */
+    int64_t header_offset;
+
+    /* Location and size of the data of the area, as stored in the file */
+    int64_t data_offset;
+    uint64_t data_size;
+
+    /* Checksum of the stored pages, combined from the page hashes */
+    uint64_t checksum;
+};
 }
 
 #endif
@@ -0,0 +1,169 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "StateStats.h"
+#include "ReservedMemory.h"
+#include "../timewrappers.h" // clock_gettime
+#include "../GlobalState.h"
+#include <cstring>
+
+namespace libtas {
+
+struct StatsHeader {
+    bool restore;
+
+    /* Statistics are complete and were not retrieved yet */
+    bool ready;
+
+    /* Are we collecting statistics */
+    bool active;
+
+    /* Number of areas, and start time of the last one in microseconds */
+    int count;
+    int64_t start_time;
+};
+
+/* Maximum number of areas. The last entry gathers all following areas. */
+#define STATS_MAX_AREAS static_cast<int>((ReservedMemory::STATS_SIZE - sizeof(StatsHeader)) / sizeof(AreaStats))
+
+static StatsHeader* getHeader()
+{
+    return static_cast<StatsHeader*>(ReservedMemory::getAddr(ReservedMemory::STATS_ADDR));
+}
+
+static AreaStats* getAreas()
+{
+    return reinterpret_cast<AreaStats*>(getHeader() + 1);
+}
+
+/* Returns the current area, or nullptr if we are not collecting */
+static AreaStats* getCurrent()
+{
+    StatsHeader* header = getHeader();
+    if (!header->active || (header->count == 0))
+        return nullptr;
+    return &getAreas()[header->count - 1];
+}
+
+static int64_t getMonotonicTime()
+{
+    struct timespec ts;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &ts));
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Add the time spent since the start of the current area */
+static void endArea(int64_t now)
+{
+    AreaStats* stats = getCurrent();
+    if (stats)
+        stats->time += now - getHeader()->start_time;
+}
+
+void StateStats::begin(bool restore)
+{
+    StatsHeader* header = getHeader();
+    header->restore = restore;
+    header->ready = false;
+    header->active = true;
+    header->count = 0;
+}
+
+void StateStats::startArea(const Area *area)
+{
+    StatsHeader* header = getHeader();
+    if (!header->active)
+        return;
+
+    int64_t now = getMonotonicTime();
+    endArea(now);
+    header->start_time = now;
+
+    /* Areas are saved as several ranges of zero and non-zero pages, which
+     * are gathered again when loading.
+     */
+    AreaStats* stats = getCurrent();
+    if (header->restore && stats && (stats->addr != 0) && ((stats->addr + stats->size) == reinterpret_cast<uintptr_t>(area->addr)) &&
+        (strncmp(stats->name, area->name, AREA_STATS_NAME_SIZE - 1) == 0)) {
+        stats->size += area->size;
+        return;
+    }
+
+    if (header->count < STATS_MAX_AREAS) {
+        stats = &getAreas()[header->count++];
+        memset(stats, 0, sizeof(AreaStats));
+        strncpy(stats->name, area->name, AREA_STATS_NAME_SIZE - 1);
+        stats->addr = reinterpret_cast<uintptr_t>(area->addr);
+    }
+    else {
+        /* Gather all remaining areas into the last entry */
+        stats = &getAreas()[header->count - 1];
+        strncpy(stats->name, "(other areas)", AREA_STATS_NAME_SIZE - 1);
+        stats->addr = 0;
+    }
+    stats->size += area->size;
+}
+
+void StateStats::addData(size_t size)
+{
+    AreaStats* stats = getCurrent();
+    if (stats)
+        stats->data_bytes += size;
+}
+
+void StateStats::addZero(size_t size)
+{
+    AreaStats* stats = getCurrent();
+    if (stats)
+        stats->zero_bytes += size;
+}
+
+void StateStats::addPages(size_t count)
+{
+    AreaStats* stats = getCurrent();
+    if (stats)
+        stats->pages += count;
+}
+
+void StateStats::end()
+{
+    StatsHeader* header = getHeader();
+    if (!header->active)
+        return;
+
+    endArea(getMonotonicTime());
+    header->active = false;
+    __atomic_store_n(&header->ready, true, __ATOMIC_RELEASE);
+}
+
+bool StateStats::get(const AreaStats** stats, int* count, bool* restore)
+{
+    StatsHeader* header = getHeader();
+    if (!__atomic_load_n(&header->ready, __ATOMIC_ACQUIRE))
+        return false;
+
+    header->ready = false;
+    *stats = getAreas();
+    *count = header->count;
+    *restore = header->restore;
+    return true;
+}
+
+}
@@ -0,0 +1,63 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_STATESTATS_H
+#define LIBTAS_STATESTATS_H
+
+#include "ProcMapsArea.h"
+#include "../../shared/AreaStats.h"
+#include <cstddef>
+
+namespace libtas {
+/* Statistics of each memory area of the last savestate or loadstate, such as
+ * the amount of data written and the time spent, so that the user can see
+ * which areas make savestates slow or large. They are stored in our reserved
+ * memory, because the checkpoint code does not allocate memory.
+ */
+namespace StateStats
+{
+    /* Start collecting the statistics of a savestate or loadstate */
+    void begin(bool restore);
+
+    /* Start collecting the statistics of an area, which ends the previous
+     * area.
+     */
+    void startArea(const Area *area);
+
+    /* Count bytes of page content written or read for the current area */
+    void addData(size_t size);
+
+    /* Count bytes of zero pages for the current area */
+    void addZero(size_t size);
+
+    /* Count page entries read from /proc/self/pagemap for the current area */
+    void addPages(size_t count);
+
+    /* End collecting statistics */
+    void end();
+
+    /* Get the statistics of the last savestate or loadstate. Returns false
+     * if there are no new statistics since the last call.
+     */
+    bool get(const AreaStats** stats, int* count, bool* restore);
+}
+}
+
+#endif
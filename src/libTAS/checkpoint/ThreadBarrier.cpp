@@ -0,0 +1,83 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ThreadBarrier.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits> // INT_MAX
+#include <cerrno>
+#include <ctime>
+
+namespace libtas {
+
+static long futex(int* addr, int op, int val, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, addr, op, val, timeout, nullptr, 0);
+}
+
+void ThreadBarrier::init()
+{
+    count = 0;
+    generation = 0;
+}
+
+int ThreadBarrier::arrive()
+{
+    /* The barrier cannot be released before we are counted */
+    int gen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    __atomic_add_fetch(&count, 1, __ATOMIC_ACQ_REL);
+    futex(&count, FUTEX_WAKE_PRIVATE, 1, nullptr);
+    return gen;
+}
+
+void ThreadBarrier::wait(int gen)
+{
+    /* When a savestate was loaded, our stack contains the value of `gen`
+     * from the savestate, which also differs from the current generation.
+     */
+    while (__atomic_load_n(&generation, __ATOMIC_ACQUIRE) == gen) {
+        futex(&generation, FUTEX_WAIT_PRIVATE, gen, nullptr);
+    }
+}
+
+int ThreadBarrier::waitArrivals(int n, int timeout_us)
+{
+    struct timespec timeout = {timeout_us / 1000000, (timeout_us % 1000000) * 1000};
+
+    while (true) {
+        int c = __atomic_load_n(&count, __ATOMIC_ACQUIRE);
+        if (c >= n)
+            return c;
+
+        if ((futex(&count, FUTEX_WAIT_PRIVATE, c, (timeout_us > 0) ? &timeout : nullptr) == -1) &&
+            (errno == ETIMEDOUT))
+            return __atomic_load_n(&count, __ATOMIC_ACQUIRE);
+    }
+}
+
+void ThreadBarrier::release()
+{
+    __atomic_store_n(&count, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&generation, 1, __ATOMIC_ACQ_REL);
+    futex(&generation, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+}
+
+}
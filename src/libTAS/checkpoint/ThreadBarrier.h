@@ -0,0 +1,60 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_THREADBARRIER_H
+#define LIBTAS_THREADBARRIER_H
+
+namespace libtas {
+/* Counting barrier based on futexes, used to suspend and resume the threads
+ * during a checkpoint. Each thread calls arrive() then wait(), while the
+ * checkpoint thread waits for all threads to arrive, then releases them.
+ * It uses neither memory allocation nor pthread objects, so it can be stored
+ * in our reserved memory and keep working when a savestate is loaded while
+ * threads are waiting on it.
+ */
+class ThreadBarrier {
+    /* Number of threads that arrived at the barrier */
+    int count;
+
+    /* Incremented each time the threads are released */
+    int generation;
+
+public:
+    void init();
+
+    /* Called by a thread reaching the barrier. Returns the value to pass to
+     * wait(), which must be read before the thread is counted.
+     */
+    int arrive();
+
+    /* Wait until the barrier is released */
+    void wait(int gen);
+
+    /* Wait for `n` threads to arrive at the barrier, or for `timeout_us`
+     * microseconds if positive. Returns the number of threads that arrived.
+     */
+    int waitArrivals(int n, int timeout_us);
+
+    /* Reset the number of arrived threads and wake up all waiting threads */
+    void release();
+};
+}
+
+#endif
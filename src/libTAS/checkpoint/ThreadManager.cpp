@@ -37,6 +37,11 @@
 #include "AltStack.h"
 #include "CustomSignals.h"
 #include "ReservedMemory.h"
+#include "SaveStateManager.h"
+#include "LazyRestore.h"
+#include "PagePool.h"
+#include "ThreadBarrier.h"
+#include "HelperThreads.h"
 
 namespace libtas {
 
@@ -47,11 +52,61 @@ thread_local ThreadInfo* ThreadManager::current_thread = nullptr;
 pthread_t ThreadManager::main_pthread_id = 0;
 pthread_mutex_t ThreadManager::threadStateLock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t ThreadManager::threadListLock = PTHREAD_MUTEX_INITIALIZER;
-pthread_rwlock_t ThreadManager::threadResumeLock = PTHREAD_RWLOCK_INITIALIZER;
-sem_t ThreadManager::semNotifyCkptThread;
-sem_t ThreadManager::semWaitForCkptThreadSignal;
 volatile bool ThreadManager::restoreInProgress = false;
-int ThreadManager::numThreads;
+
+/* Offset of the thread tid inside the pthread structure of glibc, or -1 if it
+ * was not found. Because glibc uses this value to signal threads, it must be
+ * updated when loading a savestate of another execution of the game.
+ */
+static int pthread_tid_offset = -1;
+
+/* Look for the tid of a thread inside its pthread structure */
+static int findPthreadTidOffset(pthread_t pthread_id, pid_t tid)
+{
+    if (pthread_id == 0)
+        return -1;
+
+    const pid_t* pd = reinterpret_cast<const pid_t*>(pthread_id);
+    for (int i=0; i<1024; i++) {
+        if (pd[i] == tid)
+            return i * sizeof(pid_t);
+    }
+    return -1;
+}
+
+/* State shared between the checkpoint thread and the suspended threads. It is
+ * stored in our reserved memory, so that it is not overwritten when loading
+ * a savestate while threads are waiting on the barrier.
+ */
+struct SuspendState {
+    ThreadBarrier barrier;
+
+    /* Number of threads that were suspended */
+    int numThreads;
+
+    /* Time of the start of each checkpoint phase, in microseconds */
+    int64_t start_time;
+    int64_t signal_time;
+    int64_t suspend_time;
+    int64_t state_time;
+
+    CheckpointTimings timings;
+    bool timings_pending;
+};
+
+static_assert(sizeof(SuspendState) <= ReservedMemory::THREAD_SIZE, "Suspend state does not fit in reserved memory");
+
+static SuspendState* getSuspendState()
+{
+    return static_cast<SuspendState*>(ReservedMemory::getAddr(ReservedMemory::THREAD_ADDR));
+}
+
+static int64_t getMonotonicTime()
+{
+    struct timespec ts;
+    NATIVECALL(clock_gettime(CLOCK_MONOTONIC, &ts));
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
 
 void ThreadManager::init()
 {
@@ -64,16 +119,23 @@ void ThreadManager::init()
     current_thread = thread;
     addToList(thread);
 
+    pthread_tid_offset = findPthreadTidOffset(thread->pthread_id, thread->tid);
+    if (pthread_tid_offset == -1)
+        debuglog(LCF_THREAD | LCF_ERROR, "Could not find the tid inside the pthread structure");
+
     sigset_t mask;
     sigemptyset(&mask);
     sigaddset(&mask, SIGUSR2);
     // NATIVECALL(sigprocmask(SIG_UNBLOCK, &mask, nullptr));
     NATIVECALL(pthread_sigmask(SIG_UNBLOCK, &mask, nullptr));
 
-    sem_init(&semNotifyCkptThread, 0, 0);
-    sem_init(&semWaitForCkptThreadSignal, 0, 0);
-
     ReservedMemory::init();
+    getSuspendState()->barrier.init();
+    getSuspendState()->timings_pending = false;
+    SaveStateManager::init();
+    LazyRestore::init();
+    PagePool::init();
+    HelperThreads::init();
 
     setMainThread();
     // inited = true;
@@ -313,6 +375,9 @@ void ThreadManager::checkpoint(const char* savestatepath)
 
     raise(SIGUSR2);
 
+    /* We also get here after a restore, with our stack from the savestate */
+    getSuspendState()->state_time = getMonotonicTime();
+
     /* Restoring the game alternate stack (if any) */
     AltStack::restoreStack();
 
@@ -381,6 +446,7 @@ void ThreadManager::restore(const char* savestatepath)
 
      /* If restore was not done, we return here */
      debuglog(LCF_THREAD | LCF_CHECKPOINT, "Restoring was not done, resuming threads");
+     getSuspendState()->state_time = getMonotonicTime();
 
      /* Restoring the game alternate stack (if any) */
      AltStack::restoreStack();
@@ -395,6 +461,22 @@ void ThreadManager::restore(const char* savestatepath)
      ThreadSync::releaseLocks();
 }
 
+void ThreadManager::updateTids(const pthread_t* pthread_ids, const pid_t* tids, int count)
+{
+    for (ThreadInfo *thread = thread_list; thread != nullptr; thread = thread->next) {
+        for (int t=0; t<count; t++) {
+            if ((pthread_ids[t] != thread->pthread_id) || (tids[t] == thread->tid))
+                continue;
+
+            debuglogstdio(LCF_THREAD | LCF_CHECKPOINT, "Thread tid %d is now %d", thread->tid, tids[t]);
+            thread->tid = tids[t];
+            if (pthread_tid_offset != -1)
+                *reinterpret_cast<pid_t*>(reinterpret_cast<char*>(thread->pthread_id) + pthread_tid_offset) = tids[t];
+            break;
+        }
+    }
+}
+
 bool ThreadManager::updateState(ThreadInfo *th, ThreadInfo::ThreadState newval, ThreadInfo::ThreadState oldval)
 {
     bool res = false;
@@ -410,129 +492,116 @@ bool ThreadManager::updateState(ThreadInfo *th, ThreadInfo::ThreadState newval,
 
 void ThreadManager::suspendThreads()
 {
-    MYASSERT(pthread_rwlock_destroy(&threadResumeLock) == 0)
-    MYASSERT(pthread_rwlock_init(&threadResumeLock, NULL) == 0)
-    MYASSERT(pthread_rwlock_wrlock(&threadResumeLock) == 0)
-
-    /* Halt all other threads - force them to call stopthisthread
-    * If any have blocked checkpointing, wait for them to unblock before
-    * signalling
-    */
-    MYASSERT(pthread_mutex_lock(&threadListLock) == 0)
-
-    bool needrescan = false;
-    do {
-        needrescan = false;
-        numThreads = 0;
-        ThreadInfo *next;
-        for (ThreadInfo *thread = thread_list; thread != nullptr; thread = next) {
-            debuglog(LCF_THREAD | LCF_CHECKPOINT, "Signaling thread ", thread->tid);
-            next = thread->next;
-            int ret;
-
-            /* Do various things based on thread's state */
-            switch (thread->state) {
-            case ThreadInfo::ST_RUNNING:
-
-                /* Thread is running. Send it a signal so it will call stopthisthread.
-                * We will need to rescan (hopefully it will be suspended by then)
-                */
-                if (updateState(thread, ThreadInfo::ST_SIGNALED, ThreadInfo::ST_RUNNING)) {
-
-                    /* Setup an alternate signal stack.
-                     *
-                     * This is a workaround for a bug when loading a savestate
-                     * which involves the stack pointer.
-                     * During a state loading, the main thread restores the
-                     * memory of the thread stacks, then resume the threads, and
-                     * each thread restore its registers.
-                     * If the stack pointer had changed, the thread is resumed
-                     * with a corrupted stack (old stack pointer, new stack memory)
-                     * and cannot reach the function to restore its stack pointer.
-                     *
-                     * The workaround is to run our signal handler function on
-                     * an alternate stack (different for each thread).
-                     * This way, this stack pointer will be the same.
-                     */
-                    NATIVECALL(sigaltstack(&thread->altstack, nullptr));
-
-                    /* Send the suspend signal to the thread */
-                    NATIVECALL(ret = pthread_kill(thread->pthread_id, SIGUSR1));
-
-                    if (ret == 0) {
-                        needrescan = true;
-                    }
-                    else {
-                        MYASSERT(ret == ESRCH)
-                        debuglog(LCF_THREAD | LCF_CHECKPOINT, "Thread", thread->tid, "has died since");
-                        threadIsDead(thread);
-                    }
-                }
-                break;
+    SuspendState* ss = getSuspendState();
+    ss->start_time = getMonotonicTime();
 
-            case ThreadInfo::ST_ZOMBIE:
+    /* Halt all other threads - force them to call stopthisthread */
+    MYASSERT(pthread_mutex_lock(&threadListLock) == 0)
 
-                /* Zombie threads are detached here, to avoid getting leaking
-                 * threads after state loading or other kinds of errors.
-                 * We have to get the return value if the game wants it later
+    int signaled = 0;
+    ThreadInfo *next;
+    for (ThreadInfo *thread = thread_list; thread != nullptr; thread = next) {
+        next = thread->next;
+        int ret;
+
+        /* Do various things based on thread's state */
+        switch (thread->state) {
+        case ThreadInfo::ST_RUNNING:
+
+            /* Thread is running. Send it a signal so it will call stopthisthread */
+            if (updateState(thread, ThreadInfo::ST_SIGNALED, ThreadInfo::ST_RUNNING)) {
+                debuglog(LCF_THREAD | LCF_CHECKPOINT, "Signaling thread ", thread->tid);
+
+                /* Setup an alternate signal stack.
+                 *
+                 * This is a workaround for a bug when loading a savestate
+                 * which involves the stack pointer.
+                 * During a state loading, the main thread restores the
+                 * memory of the thread stacks, then resume the threads, and
+                 * each thread restore its registers.
+                 * If the stack pointer had changed, the thread is resumed
+                 * with a corrupted stack (old stack pointer, new stack memory)
+                 * and cannot reach the function to restore its stack pointer.
+                 *
+                 * The workaround is to run our signal handler function on
+                 * an alternate stack (different for each thread).
+                 * This way, this stack pointer will be the same.
                  */
+                NATIVECALL(sigaltstack(&thread->altstack, nullptr));
 
-                debuglog(LCF_THREAD | LCF_CHECKPOINT, "Zombie thread ", thread->tid, " is joined");
-                updateState(thread, ThreadInfo::ST_FAKEZOMBIE, ThreadInfo::ST_ZOMBIE);
-                NATIVECALL(pthread_join(thread->pthread_id, &thread->retval));
-                break;
-
-            case ThreadInfo::ST_SIGNALED:
-                NATIVECALL(ret = pthread_kill(thread->pthread_id, 0));
+                /* Send the suspend signal to the thread */
+                NATIVECALL(ret = pthread_kill(thread->pthread_id, SIGUSR1));
 
                 if (ret == 0) {
-                    needrescan = true;
+                    signaled++;
                 }
                 else {
                     MYASSERT(ret == ESRCH)
-                    debuglog(LCF_ERROR | LCF_THREAD | LCF_CHECKPOINT, "Signalled thread ", thread->tid, " died");
+                    debuglog(LCF_THREAD | LCF_CHECKPOINT, "Thread", thread->tid, "has died since");
                     threadIsDead(thread);
                 }
-                break;
+            }
+            break;
 
-            case ThreadInfo::ST_SUSPINPROG:
-                numThreads++;
-                break;
+        case ThreadInfo::ST_ZOMBIE:
 
-            case ThreadInfo::ST_SUSPENDED:
-                numThreads++;
-                break;
+            /* Zombie threads are detached here, to avoid getting leaking
+             * threads after state loading or other kinds of errors.
+             * We have to get the return value if the game wants it later
+             */
 
-            case ThreadInfo::ST_CKPNTHREAD:
-                break;
+            debuglog(LCF_THREAD | LCF_CHECKPOINT, "Zombie thread ", thread->tid, " is joined");
+            updateState(thread, ThreadInfo::ST_FAKEZOMBIE, ThreadInfo::ST_ZOMBIE);
+            NATIVECALL(pthread_join(thread->pthread_id, &thread->retval));
+            break;
 
-            case ThreadInfo::ST_FAKEZOMBIE:
-                break;
+        case ThreadInfo::ST_CKPNTHREAD:
+            break;
 
-            default:
-                debuglog(LCF_ERROR | LCF_THREAD | LCF_CHECKPOINT, "Unknown thread state ", thread->state);
-            }
+        case ThreadInfo::ST_FAKEZOMBIE:
+            break;
+
+        default:
+            debuglog(LCF_ERROR | LCF_THREAD | LCF_CHECKPOINT, "Unexpected thread state ", thread->state);
         }
-        if (needrescan) {
-            struct timespec sleepTime = { 0, 10 * 1000 };
-            NATIVECALL(nanosleep(&sleepTime, NULL));
+    }
+
+    ss->signal_time = getMonotonicTime();
+
+    /* Wait for all signaled threads to reach the barrier. If it takes too
+     * long, check that the threads that did not handle the signal yet are
+     * still alive.
+     */
+    while (ss->barrier.waitArrivals(signaled, 10000) < signaled) {
+        for (ThreadInfo *thread = thread_list; thread != nullptr; thread = next) {
+            next = thread->next;
+            if (thread->state != ThreadInfo::ST_SIGNALED)
+                continue;
+
+            int ret;
+            NATIVECALL(ret = pthread_kill(thread->pthread_id, 0));
+            if (ret != 0) {
+                MYASSERT(ret == ESRCH)
+                debuglog(LCF_ERROR | LCF_THREAD | LCF_CHECKPOINT, "Signalled thread ", thread->tid, " died");
+                threadIsDead(thread);
+                signaled--;
+            }
         }
-    } while (needrescan);
+    }
 
     MYASSERT(pthread_mutex_unlock(&threadListLock) == 0)
 
-    for (int i = 0; i < numThreads; i++) {
-        sem_wait(&semNotifyCkptThread);
-    }
+    ss->numThreads = signaled;
+    ss->suspend_time = getMonotonicTime();
 
-    debuglog(LCF_THREAD | LCF_CHECKPOINT, numThreads, " threads were suspended");
+    debuglog(LCF_THREAD | LCF_CHECKPOINT, signaled, " threads were suspended");
 }
 
 /* Resume all threads. */
 void ThreadManager::resumeThreads()
 {
     debuglog(LCF_THREAD | LCF_CHECKPOINT, "Resuming all threads");
-    MYASSERT(pthread_rwlock_unlock(&threadResumeLock) == 0)
+    getSuspendState()->barrier.release();
     debuglog(LCF_THREAD | LCF_CHECKPOINT, "All threads resumed");
 }
 
@@ -561,13 +630,13 @@ void ThreadManager::stopThisThread(int signum)
 
             /* Tell the checkpoint thread that we're all saved away */
             MYASSERT(updateState(current_thread, ThreadInfo::ST_SUSPENDED, ThreadInfo::ST_SUSPINPROG))
-            sem_post(&semNotifyCkptThread);
+            ThreadBarrier& barrier = getSuspendState()->barrier;
+            int gen = barrier.arrive();
 
             /* Then wait for the ckpt thread to write the ckpt file then wake us up */
             debuglog(LCF_THREAD | LCF_CHECKPOINT, "Thread suspended");
 
-            MYASSERT(pthread_rwlock_rdlock(&threadResumeLock) == 0)
-            MYASSERT(pthread_rwlock_unlock(&threadResumeLock) == 0)
+            barrier.wait(gen);
 
             /* If when thread was suspended, we performed a restore,
              * then we must resume execution using setcontext
@@ -594,20 +663,46 @@ void ThreadManager::stopThisThread(int signum)
 
 void ThreadManager::waitForAllRestored(ThreadInfo *thread)
 {
+    /* The number of threads is taken from our reserved memory, because
+     * after a restore we must wait for the threads that were suspended,
+     * not the ones of the savestate.
+     */
+    SuspendState* ss = getSuspendState();
+
     if (thread->state == ThreadInfo::ST_CKPNTHREAD) {
-        for (int i = 0; i < numThreads; i++) {
-            sem_wait(&semNotifyCkptThread);
-        }
+        ss->barrier.waitArrivals(ss->numThreads, 0);
 
         /* If this was last of all, wake everyone up */
-        for (int i = 0; i < numThreads; i++) {
-            sem_post(&semWaitForCkptThreadSignal);
-        }
+        ss->barrier.release();
+
+        /* Store the duration of each phase */
+        int64_t end_time = getMonotonicTime();
+        ss->timings.restore = restoreInProgress;
+        ss->timings.signal = ss->signal_time - ss->start_time;
+        ss->timings.suspend = ss->suspend_time - ss->signal_time;
+        ss->timings.state = ss->state_time - ss->suspend_time;
+        ss->timings.resume = end_time - ss->state_time;
+        ss->timings_pending = true;
+
+        debuglogstdio(LCF_THREAD | LCF_CHECKPOINT, "Checkpoint timings: signal %lld us, suspend %lld us, state %lld us, resume %lld us",
+            static_cast<long long>(ss->timings.signal), static_cast<long long>(ss->timings.suspend),
+            static_cast<long long>(ss->timings.state), static_cast<long long>(ss->timings.resume));
     }
     else {
-        sem_post(&semNotifyCkptThread);
-        sem_wait(&semWaitForCkptThreadSignal);
+        int gen = ss->barrier.arrive();
+        ss->barrier.wait(gen);
     }
 }
 
+bool ThreadManager::getTimings(CheckpointTimings* timings)
+{
+    SuspendState* ss = getSuspendState();
+    if (!ss->timings_pending)
+        return false;
+
+    *timings = ss->timings;
+    ss->timings_pending = false;
+    return true;
+}
+
 }
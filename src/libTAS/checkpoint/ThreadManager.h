@@ -23,6 +23,7 @@
 #define LIBTAS_THREAD_MANAGER_H
 #include "../TimeHolder.h"
 #include "ThreadInfo.h"
+#include "../../shared/CheckpointTimings.h"
 #include <set>
 #include <map>
 #include <vector>
@@ -30,7 +31,6 @@
 #include <atomic>
 #include <cstddef>
 #include <pthread.h>
-#include <semaphore.h>
 
 namespace libtas {
 class ThreadManager {
@@ -42,11 +42,6 @@ class ThreadManager {
 
     static pthread_mutex_t threadStateLock;
     static pthread_mutex_t threadListLock;
-    static pthread_rwlock_t threadResumeLock;
-    static sem_t semNotifyCkptThread;
-    static sem_t semWaitForCkptThreadSignal;
-
-    static int numThreads;
 
 public:
     static ThreadInfo* thread_list;
@@ -104,6 +99,10 @@ public:
     /* Restore */
     static void restore(const char* savestatepath);
 
+    /* Give back their current tid to threads restored from a savestate of
+     * another execution, matching threads by pthread id */
+    static void updateTids(const pthread_t* pthread_ids, const pid_t* tids, int count);
+
     /* Safely try to change a ThreadInfo state and return if done */
     static bool updateState(ThreadInfo *th, ThreadInfo::ThreadState newval, ThreadInfo::ThreadState oldval);
 
@@ -117,6 +116,11 @@ public:
     static void stopThisThread(int signum);
 
     static void waitForAllRestored(ThreadInfo *thread);
+
+    /* Get the duration of each phase of the last checkpoint or restore.
+     * Returns false if they were already retrieved.
+     */
+    static bool getTimings(CheckpointTimings* timings);
 };
 }
 
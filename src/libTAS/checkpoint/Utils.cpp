@@ -24,6 +24,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <climits> // IOV_MAX
 
 namespace libtas {
 
@@ -51,6 +53,44 @@ ssize_t Utils::writeAll(int fd, const void *buf, size_t count)
     return num_written;
 }
 
+// Same as writeAll(), but writing a list of buffers. The list is modified
+// when a partial write occurs.
+ssize_t Utils::writevAll(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t count = 0;
+    for (int i = 0; i < iovcnt; i++)
+        count += iov[i].iov_len;
+
+    size_t num_written = 0;
+    while (iovcnt > 0) {
+        ssize_t rc = writev(fd, iov, (iovcnt < IOV_MAX) ? iovcnt : IOV_MAX);
+        if (rc == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            } else {
+                return rc;
+            }
+        } else if (rc == 0) {
+            break;
+        }
+
+        num_written += rc;
+
+        /* Skip the buffers that were fully written */
+        while ((iovcnt > 0) && (static_cast<size_t>(rc) >= iov->iov_len)) {
+            rc -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + rc;
+            iov->iov_len -= rc;
+        }
+    }
+    MYASSERT(num_written == count);
+    return num_written;
+}
+
 // Fails, succeeds, or partial read due to EOF (returns num read)
 // return value:
 // -1: unrecoverable error
@@ -78,11 +118,34 @@ ssize_t Utils::readAll(int fd, void *buf, size_t count)
     return num_read;
 }
 
-/* This function detects if the given pages are zero pages or not. There is
- * scope of improving this function using some optimizations.
- *
- * TODO: One can use /proc/self/pagemap to detect if the page is backed by a
- * shared zero page.
+// Same as readAll(), but reading at a given offset without moving the file
+// position
+ssize_t Utils::preadAll(int fd, void *buf, size_t count, off_t offset)
+{
+    ssize_t rc;
+    char *ptr = (char *)buf;
+    size_t num_read = 0;
+
+    for (num_read = 0; num_read < count;) {
+        rc = pread(fd, ptr + num_read, count - num_read, offset + num_read);
+        if (rc == -1) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            } else {
+                return -1;
+            }
+        } else if (rc == 0) {
+            break;
+        } else { // else rc > 0
+            num_read += rc;
+        }
+    }
+    return num_read;
+}
+
+/* This function detects if the given pages are zero pages or not, by reading
+ * their content. Callers should look at /proc/self/pagemap first, so that
+ * pages that are not mapped or backed by the shared zero page are not read.
  */
 bool Utils::areZeroPages(void *addr, size_t numPages)
 {
@@ -101,4 +164,70 @@ bool Utils::areZeroPages(void *addr, size_t numPages)
     return res == 0;
 }
 
+/* Hash the content of a page, using the XXH64 algorithm
+ * <https://github.com/Cyan4973/xxHash>. The page size is a multiple of 32
+ * bytes, so we don't need to process remaining bytes.
+ */
+static const uint64_t PRIME64_1 = 11400714785074694791ULL;
+static const uint64_t PRIME64_2 = 14029467366897019727ULL;
+static const uint64_t PRIME64_3 = 1609587929392839161ULL;
+static const uint64_t PRIME64_4 = 9650029242287828579ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh64Round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64MergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64Round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t Utils::hashPage(const void *addr)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t *p = static_cast<const uint64_t*>(addr);
+    const uint64_t *end = p + page_size / sizeof(uint64_t);
+
+    uint64_t v1 = PRIME64_1 + PRIME64_2;
+    uint64_t v2 = PRIME64_2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -PRIME64_1;
+
+    for (; p < end; p += 4) {
+        v1 = xxh64Round(v1, p[0]);
+        v2 = xxh64Round(v2, p[1]);
+        v3 = xxh64Round(v3, p[2]);
+        v4 = xxh64Round(v4, p[3]);
+    }
+
+    uint64_t h64 = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h64 = xxh64MergeRound(h64, v1);
+    h64 = xxh64MergeRound(h64, v2);
+    h64 = xxh64MergeRound(h64, v3);
+    h64 = xxh64MergeRound(h64, v4);
+    h64 += page_size;
+
+    h64 ^= h64 >> 33;
+    h64 *= PRIME64_2;
+    h64 ^= h64 >> 29;
+    h64 *= PRIME64_3;
+    h64 ^= h64 >> 32;
+    return h64;
+}
+
+/* Combine the hash of a page into a checksum of several pages */
+uint64_t Utils::combineHash(uint64_t checksum, uint64_t hash)
+{
+    return xxh64MergeRound(checksum, hash);
+}
+
 }
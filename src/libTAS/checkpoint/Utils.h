@@ -24,13 +24,20 @@
 
 #include <cstddef> // size_t
 #include <unistd.h> // ssize_t
+#include <cstdint> // uint64_t
+
+struct iovec;
 
 namespace libtas {
 namespace Utils
 {
     ssize_t writeAll(int fd, const void *buf, size_t count);
+    ssize_t writevAll(int fd, struct iovec *iov, int iovcnt);
     ssize_t readAll(int fd, void *buf, size_t count);
+    ssize_t preadAll(int fd, void *buf, size_t count, off_t offset);
     bool areZeroPages(void *addr, size_t numPages);
+    uint64_t hashPage(const void *addr);
+    uint64_t combineHash(uint64_t checksum, uint64_t hash);
 }
 }
 
@@ -22,13 +22,14 @@
 #include <cstring>
 #include <set>
 #include "backtrace.h"
+#include "checkpoint/Arena.h"
 
 namespace libtas {
 
 /* Set of libraries that are loaded by the game,
  * either at startup (link time) or using the dl functions.
  */
-static std::set<std::string> libraries;
+static std::set<SavedString, std::less<SavedString>, ArenaAllocator<SavedString, Arena::SAVED>> libraries;
 
 // void add_lib(std::string library)
 // {
@@ -40,8 +41,8 @@ static std::set<std::string> libraries;
 std::string find_lib(const char* library)
 {
     for (auto const& itr : libraries)
-        if (itr.find(library) != std::string::npos)
-            return itr;
+        if (itr.find(library) != SavedString::npos)
+            return std::string(itr.c_str());
 
     std::string emptystring;
     return emptystring;
@@ -66,7 +67,7 @@ static void *my_dlopen(const char *file, int mode, void *dl_caller) {
     dlleave();
 
     if (result && (file != nullptr))
-        libraries.insert(std::string(file));
+        libraries.insert(SavedString(file));
     return result;
 }
 
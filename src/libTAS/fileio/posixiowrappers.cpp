@@ -34,6 +34,7 @@
 #include <string>
 #include <sys/stat.h>
 #include "../GlobalState.h"
+#include "../checkpoint/Arena.h"
 #include "../inputs/jsdev.h"
 #include "../inputs/evdev.h"
 
@@ -41,7 +42,8 @@ namespace libtas {
 
 /*** Helper functions ***/
 
-static std::map<std::string,int> savefile_fds;
+static std::map<SavedString,int,std::less<SavedString>,
+    ArenaAllocator<std::pair<const SavedString,int>, Arena::SAVED>> savefile_fds;
 
 /*
  * Create an anonymous file with a copy of the content of the file using
@@ -53,7 +55,7 @@ static std::map<std::string,int> savefile_fds;
  */
 static int get_memfd(const char* source, int flags)
 {
-    std::string sstr(source);
+    SavedString sstr(source);
     int fd;
 
     /* Do we need to overwrite the content of the file ? */
@@ -133,7 +135,7 @@ static bool isSaveFile(const char *file, int oflag)
     /* If the file has already been registered as a savefile, open the duplicate file,
      * even if the open is read-only.
      */
-    std::string sstr(file);
+    SavedString sstr(file);
     if (savefile_fds.find(sstr) != savefile_fds.end())
         return true;
 
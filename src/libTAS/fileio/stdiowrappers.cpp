@@ -28,12 +28,14 @@
 #include <string>
 #include <sys/stat.h>
 #include "../GlobalState.h"
+#include "../checkpoint/Arena.h"
 
 namespace libtas {
 
 /*** Helper functions ***/
 
-static std::map<std::string,std::pair<char*,size_t>> savefile_buffers;
+static std::map<SavedString,std::pair<char*,size_t>,std::less<SavedString>,
+    ArenaAllocator<std::pair<const SavedString,std::pair<char*,size_t>>, Arena::SAVED>> savefile_buffers;
 
 /*
  * Create a memory stream with a copy of the content of the file using
@@ -44,7 +46,7 @@ static std::map<std::string,std::pair<char*,size_t>> savefile_buffers;
  */
 static FILE* get_memstream(const char* source, const char* modes)
 {
-    std::string sstr(source);
+    SavedString sstr(source);
     FILE* memstream;
 
     /* Do we need to overwrite the content of the file ? */
@@ -130,7 +132,7 @@ static bool isSaveFile(const char *file, const char *modes)
     /* If the file has already been registered as a savefile, open our memory
      * buffer, even if the open is read-only.
      */
-    std::string sstr(file);
+    SavedString sstr(file);
     if (savefile_buffers.find(sstr) != savefile_buffers.end())
         return true;
 
@@ -33,6 +33,10 @@
 #include "timewrappers.h" // clock_gettime
 #include "threadwrappers.h" // isMainThread()
 #include "checkpoint/ThreadManager.h"
+#include "checkpoint/Checkpoint.h"
+#include "checkpoint/SaveStateManager.h"
+#include "checkpoint/MemoryRules.h"
+#include "checkpoint/StateStats.h"
 #include "ScreenCapture.h"
 #include "WindowTitle.h"
 #include "EventQueue.h"
@@ -255,6 +259,33 @@ void frameBoundary(bool drawFB, std::function<void()> draw)
     sendData(&fps, sizeof(float));
     sendData(&lfps, sizeof(float));
 
+    /* Send the timings of the last savestate or loadstate */
+    CheckpointTimings timings;
+    if (ThreadManager::getTimings(&timings)) {
+        sendMessage(MSGB_CHECKPOINT_TIMINGS);
+        sendData(&timings, sizeof(CheckpointTimings));
+    }
+
+    /* Send the audit of the exclusion rules made by the last savestate */
+    const uint64_t* rule_sizes;
+    int rule_count;
+    if (MemoryRules::getAudit(&rule_sizes, &rule_count)) {
+        sendMessage(MSGB_MEMORY_RULES_AUDIT);
+        sendData(&rule_count, sizeof(int));
+        sendData(rule_sizes, rule_count * sizeof(uint64_t));
+    }
+
+    /* Send the statistics of each area of the last savestate or loadstate */
+    const AreaStats* area_stats;
+    int area_count;
+    bool area_restore;
+    if (StateStats::get(&area_stats, &area_count, &area_restore)) {
+        sendMessage(MSGB_AREA_STATS);
+        sendData(&area_restore, sizeof(bool));
+        sendData(&area_count, sizeof(int));
+        sendData(area_stats, area_count * sizeof(AreaStats));
+    }
+
     /* Last message to send */
     sendMessage(MSGB_START_FRAMEBOUNDARY);
 
@@ -352,6 +383,16 @@ static void receive_messages(std::function<void()> draw)
                 receiveData(&ai, sizeof(AllInputs));
                 break;
 
+            case MSGN_MEMORY_RULES:
+                {
+                    int count;
+                    receiveData(&count, sizeof(int));
+                    MYASSERT((count >= 0) && (count <= MEMORY_RULES_MAX))
+                    receiveData(MemoryRules::getBuffer(), count * sizeof(MemoryRule));
+                    MemoryRules::setCount(count);
+                }
+                break;
+
             case MSGN_EXPOSE:
                 if (shared_config.save_screenpixels) {
                     ScreenCapture::setPixels(false);
@@ -379,6 +420,14 @@ static void receive_messages(std::function<void()> draw)
 
                 break;
 
+            case MSGN_SAVESTATE_INDEX:
+                {
+                    int slot;
+                    receiveData(&slot, sizeof(int));
+                    Checkpoint::setSavestateIndex(slot);
+                }
+                break;
+
             case MSGN_SAVESTATE:
                 /* Get the savestate path */
                 receiveCString(savestatepath);
@@ -452,6 +501,46 @@ static void receive_messages(std::function<void()> draw)
 
                 break;
 
+            case MSGN_EXPORT_SAVESTATE:
+                {
+                    int slot;
+                    receiveData(&slot, sizeof(int));
+                    receiveCString(savestatepath);
+                    if (!SaveStateManager::exportState(slot, savestatepath)) {
+                        debuglog(LCF_CHECKPOINT | LCF_ERROR, "Could not export savestate ", slot, " to ", savestatepath);
+                    }
+                }
+                break;
+
+            case MSGN_DELETE_SAVESTATE:
+                {
+                    int slot;
+                    receiveData(&slot, sizeof(int));
+                    receiveCString(savestatepath);
+                    SaveStateManager::deleteState(slot, savestatepath);
+                }
+                break;
+
+            case MSGN_SAVESTATE_STORAGE:
+                {
+                    int count;
+                    receiveData(&count, sizeof(int));
+                    uint64_t sizes[SAVESTATE_MAX_SLOTS];
+                    char path[SAVESTATE_FILESIZE];
+                    for (int i = 0; i < count; i++) {
+                        int slot;
+                        receiveData(&slot, sizeof(int));
+                        receiveCString(path);
+                        if (i < SAVESTATE_MAX_SLOTS)
+                            sizes[i] = SaveStateManager::getStateSize(slot, path);
+                    }
+                    if (count > SAVESTATE_MAX_SLOTS)
+                        count = SAVESTATE_MAX_SLOTS;
+                    sendMessage(MSGB_SAVESTATE_STORAGE);
+                    sendData(sizes, count * sizeof(uint64_t));
+                }
+                break;
+
             case MSGN_STOP_ENCODE:
 #ifdef LIBTAS_ENABLE_AVDUMPING
                 if (avencoder) {
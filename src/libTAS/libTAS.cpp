@@ -30,6 +30,9 @@
 #include "../shared/AllInputs.h"
 #include "inputs/inputs.h"
 #include "checkpoint/ThreadManager.h"
+#include "checkpoint/SaveStateManager.h"
+#include "checkpoint/PagePool.h"
+#include "checkpoint/MemoryRules.h"
 #include "audio/AudioContext.h"
 #include "AVEncoder.h"
 #include <unistd.h> // getpid()
@@ -75,6 +78,26 @@ void __attribute__((constructor)) init(void)
                 debuglog(LCF_SOCKET, "File ", AVEncoder::dumpfile);
                 break;
 #endif
+            case MSGN_BASE_SAVESTATE_PATH:
+                debuglog(LCF_SOCKET, "Receiving base savestate path");
+                libstring = receiveString();
+                SaveStateManager::setBasePath(libstring.c_str());
+                break;
+            case MSGN_PAGE_POOL_PATH:
+                debuglog(LCF_SOCKET, "Receiving page pool path");
+                libstring = receiveString();
+                PagePool::setPath(libstring.c_str());
+                break;
+            case MSGN_MEMORY_RULES:
+                debuglog(LCF_SOCKET, "Receiving memory exclusion rules");
+                {
+                    int count;
+                    receiveData(&count, sizeof(int));
+                    MYASSERT((count >= 0) && (count <= MEMORY_RULES_MAX))
+                    receiveData(MemoryRules::getBuffer(), count * sizeof(MemoryRule));
+                    MemoryRules::setCount(count);
+                }
+                break;
             case MSGN_LIB_FILE:
                 debuglog(LCF_SOCKET, "Receiving lib filename");
                 libstring = receiveString();
@@ -27,6 +27,7 @@
 #include "timewrappers.h" // For frame_counter
 #include <mutex>
 #include <list>
+#include "checkpoint/Arena.h"
 
 namespace libtas {
 
@@ -116,22 +117,41 @@ void debuglogstdio(LogCategoryFlag lcf, const char* fmt, ...)
 
 }
 
-static std::list<std::string> alert_messages;
+/* Messages waiting to be sent to the program must not be lost or sent twice
+ * when loading a savestate, so they are not stored in savestates. The list
+ * is found using a root pointer of the arena, because our own variables are
+ * restored with savestates.
+ */
+typedef std::list<UnsavedString, ArenaAllocator<UnsavedString, Arena::UNSAVED>> AlertList;
 static std::mutex mutex;
 
+static AlertList* getAlertList(bool create)
+{
+    void** root = Arena::getRoot(Arena::UNSAVED, Arena::ALERT_MESSAGES);
+    if (!*root && create)
+        *root = Arena::create<AlertList>(Arena::UNSAVED);
+    return static_cast<AlertList*>(*root);
+}
+
 void setAlertMsg(const char* alert, int size)
 {
     std::lock_guard<std::mutex> lock(mutex);
-    alert_messages.push_back(std::string(alert, size));
+    try {
+        getAlertList(true)->push_back(UnsavedString(alert, size));
+    }
+    catch (const std::bad_alloc&) {
+        /* Our memory is full, the message is dropped */
+    }
 }
 
 bool getAlertMsg(std::string& alert)
 {
     std::lock_guard<std::mutex> lock(mutex);
-    if (alert_messages.empty())
+    AlertList* alert_messages = getAlertList(false);
+    if (!alert_messages || alert_messages->empty())
         return false;
-    alert = alert_messages.front();
-    alert_messages.pop_front();
+    alert.assign(alert_messages->front().data(), alert_messages->front().size());
+    alert_messages->pop_front();
     return true;
 }
 
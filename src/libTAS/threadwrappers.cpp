@@ -86,6 +86,10 @@ static void *pthread_start(void *arg)
     debuglog(LCF_THREAD, "Thread is created with routine ", (void*)start_routine);
     LINK_NAMESPACE(pthread_create, "pthread");
 
+    /* Threads created by our own code are not registered */
+    if (GlobalState::isNative())
+        return orig::pthread_create(tid_p, attr, start_routine, arg);
+
     ThreadSync::wrapperExecutionLockLock();
     ThreadSync::incrementUninitializedThreadCount();
 
@@ -50,6 +50,10 @@ void Config::save(const std::string& gamepath) {
     settings.setValue("rundir", rundir.c_str());
     settings.setValue("opengl_soft", opengl_soft);
     settings.setValue("on_movie_end", on_movie_end);
+    settings.setValue("savestate_tree_budget", savestate_tree_budget);
+    settings.setValue("keyframe_interval", keyframe_interval);
+    settings.setValue("keyframe_count", keyframe_count);
+    settings.setValue("rewind_frames", rewind_frames);
 
     settings.beginGroup("keymapping");
 
@@ -76,6 +80,22 @@ void Config::save(const std::string& gamepath) {
 
     settings.endGroup();
 
+    settings.remove("memory_rules");
+    settings.beginWriteArray("memory_rules");
+    {
+        std::lock_guard<std::mutex> lock(memory_rules_mutex);
+        i = 0;
+        for (const MemoryRule& rule : memory_rules) {
+            settings.setArrayIndex(i++);
+            settings.setValue("enabled", rule.enabled);
+            settings.setValue("pattern", rule.pattern);
+            settings.setValue("start", static_cast<qulonglong>(rule.start));
+            settings.setValue("end", static_cast<qulonglong>(rule.end));
+            settings.setValue("min_size", static_cast<qulonglong>(rule.min_size));
+        }
+    }
+    settings.endArray();
+
     settings.beginGroup("shared");
 
     settings.setValue("speed_divisor", sc.speed_divisor);
@@ -116,6 +136,8 @@ void Config::save(const std::string& gamepath) {
 
     settings.setValue("save_screenpixels", sc.save_screenpixels);
     settings.setValue("ignore_sections", sc.ignore_sections);
+    settings.setValue("savestate_settings", sc.savestate_settings);
+    settings.setValue("savestate_compression", sc.savestate_compression);
 
     settings.endGroup();
 }
@@ -139,6 +161,10 @@ void Config::load(const std::string& gamepath) {
 
     opengl_soft = settings.value("opengl_soft", opengl_soft).toBool();
     on_movie_end = settings.value("on_movie_end", on_movie_end).toInt();
+    savestate_tree_budget = settings.value("savestate_tree_budget", savestate_tree_budget).toInt();
+    keyframe_interval = settings.value("keyframe_interval", keyframe_interval).toInt();
+    keyframe_count = settings.value("keyframe_count", keyframe_count).toInt();
+    rewind_frames = settings.value("rewind_frames", rewind_frames).toInt();
 
     /* Load key mapping */
 
@@ -168,6 +194,25 @@ void Config::load(const std::string& gamepath) {
 
     settings.endGroup();
 
+    size = settings.beginReadArray("memory_rules");
+    {
+        std::lock_guard<std::mutex> lock(memory_rules_mutex);
+        memory_rules.clear();
+        memory_rules_audit.clear();
+        for (int i = 0; (i < size) && (i < MEMORY_RULES_MAX); ++i) {
+            settings.setArrayIndex(i);
+            MemoryRule rule;
+            rule.enabled = settings.value("enabled", rule.enabled).toBool();
+            std::string pattern = settings.value("pattern").toString().toStdString();
+            pattern.copy(rule.pattern, MEMORY_RULE_PATTERN_SIZE - 1);
+            rule.start = settings.value("start").toULongLong();
+            rule.end = settings.value("end").toULongLong();
+            rule.min_size = settings.value("min_size").toULongLong();
+            memory_rules.push_back(rule);
+        }
+    }
+    settings.endArray();
+
     /* Load shared config */
     settings.beginGroup("shared");
 
@@ -195,6 +240,8 @@ void Config::load(const std::string& gamepath) {
     #endif
     sc.save_screenpixels = settings.value("save_screenpixels", sc.save_screenpixels).toBool();
     sc.ignore_sections = settings.value("ignore_sections", sc.ignore_sections).toInt();
+    sc.savestate_settings = settings.value("savestate_settings", sc.savestate_settings).toInt();
+    sc.savestate_compression = settings.value("savestate_compression", sc.savestate_compression).toInt();
 
     size = settings.beginReadArray("main_gettimes_threshold");
     for (int t=0; t<size; t++) {
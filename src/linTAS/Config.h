@@ -23,8 +23,11 @@
 #include <QString>
 #include <string>
 #include <memory>
+#include <vector>
+#include <mutex>
 
 #include "../shared/SharedConfig.h"
+#include "../shared/MemoryRule.h"
 #include "KeyMapping.h"
 
 
@@ -86,6 +89,30 @@ public:
 
     int on_movie_end = MOVIEEND_PAUSE;
 
+    /* Maximum storage used by savestates before states of the savestate
+     * tree are removed, in MB. This includes the pages of keyframes.
+     */
+    int savestate_tree_budget = 2048;
+
+    /* Number of frames between two keyframes, or 0 to disable keyframes */
+    int keyframe_interval = 0;
+
+    /* Maximum number of keyframes */
+    int keyframe_count = 32;
+
+    /* Number of frames to go back when rewinding */
+    int rewind_frames = 60;
+
+    /* Rules excluding memory areas from savestates, edited by the UI and
+     * sent by the game thread, so they are protected by a mutex. The audit
+     * holds the size of the areas matched by each rule during the last
+     * savestate.
+     */
+    std::vector<MemoryRule> memory_rules;
+    std::vector<uint64_t> memory_rules_audit;
+    bool memory_rules_modified = false;
+    std::mutex memory_rules_mutex;
+
     /* Save the config into the config file */
     void save(const std::string& gamepath);
 
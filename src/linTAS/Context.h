@@ -25,7 +25,11 @@
 // #include <X11/Xlib.h>
 #include <xcb/xcb.h>
 #include "ConcurrentQueue.h"
+#include "SaveStateTree.h"
 #include "../shared/GameInfo.h"
+#include "../shared/AreaStats.h"
+#include <vector>
+#include <mutex>
 
 struct Context {
     /* Execution status */
@@ -90,9 +94,22 @@ struct Context {
     /* Queue of hotkeys that where pushed by the UI, to process by the main thread */
     ConcurrentQueue<HotKeyType> hotkey_queue;
 
+    /* Savestates of the savestate tree */
+    SaveStateTree savestate_tree;
+
+    /* Frame to seek to, set by the UI before pushing HOTKEY_SEEK */
+    unsigned int seek_frame = 0;
+
     /* Store some game information sent by the game, that is shown in the UI */
     GameInfo game_info;
 
+    /* Statistics of each memory area of the last savestate or loadstate,
+     * received by the game thread and shown by the UI.
+     */
+    std::vector<AreaStats> area_stats;
+    bool area_stats_restore = false;
+    std::mutex area_stats_mutex;
+
 };
 
 #endif
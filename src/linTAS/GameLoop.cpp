@@ -28,6 +28,9 @@
 #include "../shared/sockethelpers.h"
 #include "../shared/SharedConfig.h"
 #include "../shared/messages.h"
+#include "../shared/CheckpointTimings.h"
+#include "../shared/MemoryRule.h"
+#include "../shared/AreaStats.h"
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_keysyms.h>
@@ -43,6 +46,7 @@
 #include <memory> // unique_ptr
 #include <sys/stat.h> // stat
 #include <sys/wait.h> // waitpid
+#include <sys/personality.h> // personality
 #include <X11/X.h>
 
 GameLoop::GameLoop(Context* c) : context(c), keysyms(xcb_key_symbols_alloc(c->conn), xcb_key_symbols_free) {}
@@ -97,6 +101,17 @@ void GameLoop::launchGameThread()
     else
         unsetenv("LP_PERF");
 
+    /* Disable address space randomization, so that savestates can be loaded
+     * by a later execution of the game, which must have the same memory layout.
+     * gdb already disables it by default.
+     */
+    if (context->config.sc.savestate_settings & SharedConfig::SS_PERSISTENT) {
+        int persona = personality(0xffffffff);
+        if ((persona == -1) || (personality(persona | ADDR_NO_RANDOMIZE) == -1)) {
+            std::cerr << "Could not disable address space randomization" << std::endl;
+        }
+    }
+
     /* Run the actual game */
     if (context->attach_gdb) {
         /* Call the game using gdb. The LD_PRELOAD must be set inside gdb,
@@ -142,6 +157,9 @@ void GameLoop::start()
         }
 
         /* We are at a frame boundary */
+        if (context->game_window)
+            processKeyframes();
+
         /* If we did not yet receive the game window id, just make the game running */
         bool endInnerLoop = false;
         if (context->game_window ) do {
@@ -208,8 +226,11 @@ void GameLoop::init()
 
     emit statusChanged();
 
-    /* Remove savestates again in case we did not exist cleanly the previous time */
-    remove_savestates(context);
+    /* Remove savestates again in case we did not exist cleanly the previous time,
+     * unless they are kept between executions of the game.
+     */
+    if (!(context->config.sc.savestate_settings & SharedConfig::SS_PERSISTENT))
+        remove_savestates(context);
 
     /* Remove the file socket */
     removeSocket();
@@ -239,6 +260,11 @@ void GameLoop::init()
     xcb_change_keyboard_control(context->conn, mask_aroff, values_aroff);
 
     last_savestate_slot = -1;
+    ram_savestates.fill(false);
+    context->savestate_tree.clear();
+    emit savestateTreeChanged();
+    keyframes.clear();
+    seeking = false;
 
     ar_ticks = -1;
     ar_delay = 50;
@@ -299,6 +325,23 @@ void GameLoop::initProcessMessages()
         sendString(context->config.dumpfile);
     }
 
+    /* Send the path of the base savestate */
+    std::string basestatepath = context->config.savestatedir + '/';
+    basestatepath += context->gamename;
+    basestatepath += ".state0";
+    sendMessage(MSGN_BASE_SAVESTATE_PATH);
+    sendString(basestatepath);
+
+    /* Send the path of the pages shared by savestates */
+    std::string poolpath = context->config.savestatedir + '/';
+    poolpath += context->gamename;
+    poolpath += ".pages";
+    sendMessage(MSGN_PAGE_POOL_PATH);
+    sendString(poolpath);
+
+    /* Send the rules excluding memory areas from savestates */
+    sendMemoryRules();
+
     /* Get the shared libs of the game executable */
     std::vector<std::string> linked_libs;
     std::ostringstream libcmd;
@@ -379,6 +422,43 @@ bool GameLoop::loopReceiveMessages()
             receiveData(&lfps, sizeof(float));
             emit fpsChanged(fps, lfps);
             break;
+        case MSGB_CHECKPOINT_TIMINGS:
+            {
+                CheckpointTimings timings;
+                receiveData(&timings, sizeof(CheckpointTimings));
+                emit checkpointTimingsChanged(timings.restore, timings.signal / 1000.0f,
+                    timings.suspend / 1000.0f, timings.state / 1000.0f, timings.resume / 1000.0f);
+            }
+            break;
+        case MSGB_MEMORY_RULES_AUDIT:
+            {
+                int count;
+                receiveData(&count, sizeof(int));
+                std::vector<uint64_t> sizes(count);
+                receiveData(sizes.data(), count * sizeof(uint64_t));
+                {
+                    std::lock_guard<std::mutex> lock(context->config.memory_rules_mutex);
+                    context->config.memory_rules_audit = sizes;
+                }
+                emit memoryRulesAuditChanged();
+            }
+            break;
+        case MSGB_AREA_STATS:
+            {
+                bool restore;
+                int count;
+                receiveData(&restore, sizeof(bool));
+                receiveData(&count, sizeof(int));
+                std::vector<AreaStats> stats(count);
+                receiveData(stats.data(), count * sizeof(AreaStats));
+                {
+                    std::lock_guard<std::mutex> lock(context->area_stats_mutex);
+                    context->area_stats.swap(stats);
+                    context->area_stats_restore = restore;
+                }
+                emit areaStatsChanged();
+            }
+            break;
         case MSGB_QUIT:
             return true;
         default:
@@ -534,6 +614,388 @@ void GameLoop::notifyControllerEvent(xcb_keysym_t ks, bool pressed)
 
 }
 
+std::string GameLoop::savestatePath(int slot)
+{
+    std::string savestatepath = context->config.savestatedir + '/';
+    savestatepath += context->gamename;
+    savestatepath += ".state" + std::to_string(slot);
+    return savestatepath;
+}
+
+std::string GameLoop::savestateMoviePath(int slot)
+{
+    std::string moviepath = context->config.savestatedir + '/';
+    moviepath += context->gamename;
+    moviepath += ".movie" + std::to_string(slot) + ".ltm";
+    return moviepath;
+}
+
+bool GameLoop::saveState(int slot)
+{
+    /* Perform a savestate:
+     * - save the moviefile if we are recording
+     * - tell the game to save its state
+     */
+
+    /* Saving is not allowed if currently encoding */
+    if (context->config.sc.av_dumping) {
+        emit alertToShow(QString("Saving is not allowed when in the middle of video encoding"));
+        return false;
+    }
+
+    last_savestate_slot = slot;
+
+    if (context->config.sc.recording != SharedConfig::NO_RECORDING) {
+        /* Save the movie file */
+        movie.saveMovie(savestateMoviePath(slot), context->framecount);
+    }
+
+    sendSaveState(slot);
+    return true;
+}
+
+void GameLoop::sendSaveState(int slot)
+{
+    sendMessage(MSGN_SAVESTATE_INDEX);
+    sendData(&slot, sizeof(int));
+
+    sendMessage(MSGN_SAVESTATE);
+    sendString(savestatePath(slot));
+
+    if (context->config.sc.savestate_settings & SharedConfig::SS_RAM)
+        ram_savestates[slot] = true;
+}
+
+bool GameLoop::loadState(int slot)
+{
+    /* Load a savestate:
+     * - check for an existing savestate in the slot
+     * - if in read-only move, we must check that the movie
+         associated with the savestate must be a prefix of the
+         current movie
+     * - tell the game to load its state
+     * - if loading succeeded:
+     * -- load the movie associated with the savestate if in write mode
+     * -- increment the rerecord count
+     */
+
+    /* Loading is not allowed if currently encoding */
+    if (context->config.sc.av_dumping) {
+        emit alertToShow(QString("Loading is not allowed when in the middle of video encoding"));
+        return false;
+    }
+
+    std::string savestatepath = savestatePath(slot);
+
+    /* Check that the savestate exists */
+    bool state_exists;
+    if (context->config.sc.savestate_settings & SharedConfig::SS_RAM) {
+        state_exists = ram_savestates[slot];
+    }
+    else {
+        struct stat sb;
+        state_exists = (stat(savestatepath.c_str(), &sb) == 0);
+    }
+    if (!state_exists) {
+        emit alertToShow(QString("There is no savestate to load in this slot"));
+        return false;
+    }
+
+    std::string moviepath = savestateMoviePath(slot);
+
+    if (context->config.sc.recording == SharedConfig::RECORDING_READ) {
+        /* When loading in read mode, we must check that
+         * the moviefile associated with the savestate is
+         * a prefix of our moviefile.
+         */
+        MovieFile savedmovie(context);
+        int ret = savedmovie.loadInputs(moviepath);
+        if (ret < 0) {
+            emit alertToShow(QString("Could not load the moviefile associated with the savestate"));
+            return false;
+        }
+
+        if (!movie.isPrefix(savedmovie)) {
+            /* Not a prefix, we don't allow loading */
+            emit alertToShow(QString("Trying to load a state in read-only but the inputs mismatch"));
+            return false;
+        }
+    }
+
+    if (!sendLoadState(slot))
+        return false;
+
+    if (context->config.sc.recording == SharedConfig::RECORDING_WRITE) {
+        /* When in writing move, we load the movie associated
+         * with the savestate.
+         * Check if we are loading the same state we just saved.
+         * If so, we can keep the same movie.
+         */
+        if (last_savestate_slot != slot) {
+            /* Load the movie file. Keyframes after the first frame whose
+             * inputs changed don't match the movie anymore.
+             */
+            std::vector<AllInputs> old_inputs = std::move(movie.input_list);
+            if (movie.loadInputs(moviepath) < 0) {
+                movie.input_list = std::move(old_inputs);
+            }
+            else {
+                size_t f = 0;
+                while ((f < old_inputs.size()) && (f < movie.input_list.size()) && (old_inputs[f] == movie.input_list[f]))
+                    f++;
+                deleteKeyframesAfter(f);
+            }
+        }
+
+        /* Increment rerecord count */
+        context->rerecord_count++;
+        emit rerecordChanged();
+    }
+
+    last_savestate_slot = slot;
+    return true;
+}
+
+bool GameLoop::sendLoadState(int slot)
+{
+    sendMessage(MSGN_SAVESTATE_INDEX);
+    sendData(&slot, sizeof(int));
+
+    sendMessage(MSGN_LOADSTATE);
+    sendString(savestatePath(slot));
+
+    int message = receiveMessage();
+    /* Loading is not assured to succeed, the following must
+     * only be done if it's the case.
+     */
+    bool succeeded = (message == MSGB_LOADING_SUCCEEDED);
+    if (succeeded) {
+        /* The copy of SharedConfig that the game stores may not
+         * be the same as this one due to memory loading, so we
+         * send it.
+         */
+        sendMessage(MSGN_CONFIG);
+        sendData(&context->config.sc, sizeof(SharedConfig));
+
+        message = receiveMessage();
+    }
+
+    /* The frame count has changed, we must get the new one */
+    if (message != MSGB_FRAMECOUNT_TIME) {
+        std::cerr << "Got wrong message after state loading" << std::endl;
+        return false;
+    }
+    receiveData(&context->framecount, sizeof(unsigned long));
+    if (context->config.sc.recording == SharedConfig::RECORDING_WRITE) {
+        context->config.sc.movie_framecount = context->framecount;
+    }
+    receiveData(&context->current_time, sizeof(struct timespec));
+    emit frameCountChanged();
+    return succeeded;
+}
+
+void GameLoop::processKeyframes()
+{
+    if (seeking && (context->framecount >= seek_frame))
+        endSeek();
+
+    /* Keyframes are only useful to replay the inputs of a movie */
+    int interval = context->config.keyframe_interval;
+    if ((interval <= 0) || (context->config.sc.recording == SharedConfig::NO_RECORDING))
+        return;
+
+    /* Saving is not allowed if currently encoding */
+    if (context->config.sc.av_dumping)
+        return;
+
+    if ((context->framecount == 0) || (context->framecount % interval) || keyframes.contains(context->framecount))
+        return;
+
+    /* Reuse the slot of the oldest keyframe when the cache is full */
+    int max_count = context->config.keyframe_count;
+    if (max_count > SAVESTATE_KEYFRAME_COUNT)
+        max_count = SAVESTATE_KEYFRAME_COUNT;
+    if (max_count < 1)
+        max_count = 1;
+
+    while (keyframes.count() > max_count)
+        sendDeleteState(keyframes.removeOldest());
+
+    int slot;
+    if (keyframes.count() == max_count)
+        slot = keyframes.removeOldest();
+    else
+        slot = keyframes.freeSlot();
+
+    sendSaveState(slot);
+    keyframes.add(context->framecount, slot);
+}
+
+void GameLoop::deleteKeyframesAfter(unsigned int framecount)
+{
+    for (int slot : keyframes.removeAfter(framecount))
+        sendDeleteState(slot);
+}
+
+void GameLoop::seek(unsigned int framecount)
+{
+    /* We may already be seeking, which changed the recording mode */
+    int recording = seeking ? seek_recording : context->config.sc.recording;
+
+    if (recording == SharedConfig::NO_RECORDING) {
+        emit alertToShow(QString("Seeking is only possible when recording or playing a movie"));
+        return;
+    }
+
+    if (context->config.sc.av_dumping) {
+        emit alertToShow(QString("Seeking is not allowed when in the middle of video encoding"));
+        return;
+    }
+
+    if (framecount > movie.nbFrames()) {
+        emit alertToShow(QString("Cannot seek after the end of the movie"));
+        return;
+    }
+
+    /* Load the last keyframe before the frame, unless we are nearer */
+    unsigned int keyframe;
+    int slot;
+    bool found = keyframes.nearest(framecount, keyframe, slot);
+    if ((context->framecount > framecount) || (found && (keyframe > context->framecount))) {
+        if (!found) {
+            emit alertToShow(QString("There is no keyframe before frame %1").arg(framecount));
+            return;
+        }
+
+        if (!sendLoadState(slot))
+            return;
+
+        /* The movie in memory is not the one of any savestate slot now */
+        last_savestate_slot = -1;
+
+        if (recording == SharedConfig::RECORDING_WRITE) {
+            context->rerecord_count++;
+            emit rerecordChanged();
+        }
+    }
+
+    /* Replay the remaining frames in fastforward with the inputs of the
+     * movie, then pause.
+     */
+    seeking = true;
+    seek_frame = framecount;
+    seek_recording = recording;
+    if (context->framecount >= framecount) {
+        endSeek();
+        return;
+    }
+
+    context->config.sc.recording = SharedConfig::RECORDING_READ;
+    context->config.sc.movie_framecount = movie.nbFrames();
+    context->config.sc.running = true;
+    context->config.sc.fastforward = true;
+    context->config.sc_modified = true;
+    emit sharedConfigChanged();
+}
+
+void GameLoop::endSeek()
+{
+    seeking = false;
+    context->config.sc.recording = seek_recording;
+    if (context->config.sc.recording == SharedConfig::RECORDING_WRITE)
+        context->config.sc.movie_framecount = context->framecount;
+    context->config.sc.running = false;
+    context->config.sc.fastforward = false;
+    context->config.sc_modified = true;
+    emit sharedConfigChanged();
+}
+
+bool GameLoop::savestateSizes(const std::vector<SaveStateTree::Node>& nodes, uint64_t* sizes)
+{
+    sendMessage(MSGN_SAVESTATE_STORAGE);
+    int count = nodes.size();
+    sendData(&count, sizeof(int));
+    for (const SaveStateTree::Node& node : nodes) {
+        sendData(&node.slot, sizeof(int));
+        sendString(savestatePath(node.slot));
+    }
+
+    int message = receiveMessage();
+    if (message != MSGB_SAVESTATE_STORAGE) {
+        std::cerr << "Got wrong message after asking savestate storage" << std::endl;
+        return false;
+    }
+
+    std::vector<uint64_t> node_sizes(count);
+    receiveData(node_sizes.data(), count * sizeof(uint64_t));
+    for (int i = 0; i < count; i++)
+        sizes[nodes[i].slot] = node_sizes[i];
+    return true;
+}
+
+void GameLoop::saveTreeState()
+{
+    SaveStateTree& tree = context->savestate_tree;
+
+    /* Only the states of the tree count towards the budget. They are stored
+     * in memory or on disk depending on the savestate settings, so the game
+     * is given their path.
+     */
+    std::vector<SaveStateTree::Node> nodes = tree.nodes();
+    uint64_t sizes[SAVESTATE_MAX_SLOTS] = {};
+    if (!savestateSizes(nodes, sizes))
+        return;
+
+    uint64_t storage = 0;
+    for (const SaveStateTree::Node& node : nodes)
+        storage += sizes[node.slot];
+
+    /* Remove the least recently used states until there is a free slot and
+     * savestates fit in the budget. The size of the new state is not known
+     * yet, so the budget may be exceeded by one state until the next save.
+     */
+    uint64_t budget = static_cast<uint64_t>(context->config.savestate_tree_budget) * 1024 * 1024;
+    int slot;
+    while (((slot = tree.freeSlot()) == -1) || (storage > budget)) {
+        SaveStateTree::Node node;
+        if (!tree.get(tree.leastRecentlyUsed(), node))
+            break;
+        storage -= sizes[node.slot];
+        deleteTreeState(node);
+        emit savestateTreeChanged();
+    }
+
+    if (slot == -1) {
+        emit alertToShow(QString("There is no slot left in the savestate tree"));
+        return;
+    }
+
+    if (saveState(slot)) {
+        tree.add(slot, context->framecount);
+        emit savestateTreeChanged();
+    }
+}
+
+void GameLoop::sendDeleteState(int slot)
+{
+    sendMessage(MSGN_DELETE_SAVESTATE);
+    sendData(&slot, sizeof(int));
+    sendString(savestatePath(slot));
+
+    ram_savestates[slot] = false;
+}
+
+void GameLoop::deleteTreeState(const SaveStateTree::Node& node)
+{
+    sendDeleteState(node.slot);
+
+    unlink(savestateMoviePath(node.slot).c_str());
+    if (last_savestate_slot == node.slot)
+        last_savestate_slot = -1;
+
+    context->savestate_tree.remove(node.id);
+}
+
 bool GameLoop::processEvent(uint8_t type, struct HotKey &hk)
 {
 
@@ -586,41 +1048,8 @@ bool GameLoop::processEvent(uint8_t type, struct HotKey &hk)
         case HOTKEY_SAVESTATE7:
         case HOTKEY_SAVESTATE8:
         case HOTKEY_SAVESTATE9:
-        {
-            /* Perform a savestate:
-             * - save the moviefile if we are recording
-             * - tell the game to save its state
-             */
-
-            /* Saving is not allowed if currently encoding */
-            if (context->config.sc.av_dumping) {
-                emit alertToShow(QString("Saving is not allowed when in the middle of video encoding"));
-                return false;
-            }
-
-            /* Slot number */
-            int statei = hk.type - HOTKEY_SAVESTATE1 + 1;
-            last_savestate_slot = statei;
-
-            if (context->config.sc.recording != SharedConfig::NO_RECORDING) {
-                /* Building the movie path */
-                std::string moviepath = context->config.savestatedir + '/';
-                moviepath += context->gamename;
-                moviepath += ".movie" + std::to_string(statei) + ".ltm";
-
-                /* Save the movie file */
-                movie.saveMovie(moviepath, context->framecount);
-            }
-
-            /* Building the savestate path */
-            std::string savestatepath = context->config.savestatedir + '/';
-            savestatepath += context->gamename;
-            savestatepath += ".state" + std::to_string(statei);
-
-            sendMessage(MSGN_SAVESTATE);
-            sendString(savestatepath);
+            saveState(hk.type - HOTKEY_SAVESTATE1 + 1);
             return false;
-        }
 
         case HOTKEY_LOADSTATE1:
         case HOTKEY_LOADSTATE2:
@@ -631,111 +1060,50 @@ bool GameLoop::processEvent(uint8_t type, struct HotKey &hk)
         case HOTKEY_LOADSTATE7:
         case HOTKEY_LOADSTATE8:
         case HOTKEY_LOADSTATE9:
-
-            /* Load a savestate:
-             * - check for an existing savestate in the slot
-             * - if in read-only move, we must check that the movie
-                 associated with the savestate must be a prefix of the
-                 current movie
-             * - tell the game to load its state
-             * - if loading succeeded:
-             * -- send the shared config
-             * -- increment the rerecord count
-             * -- receive the frame count and the current time
-             */
-        {
-
-            /* Loading is not allowed if currently encoding */
-            if (context->config.sc.av_dumping) {
-                emit alertToShow(QString("Loading is not allowed when in the middle of video encoding"));
-                return false;
+            if (loadState(hk.type - HOTKEY_LOADSTATE1 + 1)) {
+                /* The next state saved in the tree has no parent */
+                context->savestate_tree.use(-1);
+                emit savestateTreeChanged();
             }
+            return false;
 
-            /* Slot number */
-            int statei = hk.type - HOTKEY_LOADSTATE1 + 1;
-
-            /* Building the savestate path */
-            std::string savestatepath = context->config.savestatedir + '/';
-            savestatepath += context->gamename;
-            savestatepath += ".state" + std::to_string(statei);
-
-            /* Check that the savestate exists */
-            struct stat sb;
-            if (stat(savestatepath.c_str(), &sb) == -1) {
-                emit alertToShow(QString("There is no savestate to load in this slot"));
-                return false;
-            }
+        case HOTKEY_SAVESTATE_TREE:
+            saveTreeState();
+            return false;
 
-            /* Building the movie path */
-            std::string moviepath = context->config.savestatedir + '/';
-            moviepath += context->gamename;
-            moviepath += ".movie" + std::to_string(statei) + ".ltm";
+        case HOTKEY_SEEK:
+            seek(context->seek_frame);
+            return false;
 
-            if (context->config.sc.recording == SharedConfig::RECORDING_READ) {
-                /* When loading in read mode, we must check that
-                 * the moviefile associated with the savestate is
-                 * a prefix of our moviefile.
-                 */
-                MovieFile savedmovie(context);
-                int ret = savedmovie.loadInputs(moviepath);
-                if (ret < 0) {
-                    emit alertToShow(QString("Could not load the moviefile associated with the savestate"));
-                    return false;
-                }
+        case HOTKEY_REWIND:
+        {
+            unsigned int rewind = context->config.rewind_frames;
+            seek((context->framecount > rewind) ? (context->framecount - rewind) : 0);
+            return false;
+        }
 
-                if (!movie.isPrefix(savedmovie)) {
-                    /* Not a prefix, we don't allow loading */
-                    emit alertToShow(QString("Trying to load a state in read-only but the inputs mismatch"));
-                    return false;
-                }
+        case HOTKEY_LOADSTATE_TREE:
+        {
+            SaveStateTree::Node node;
+            if (!context->savestate_tree.get(context->savestate_tree.selected(), node)) {
+                emit alertToShow(QString("There is no state selected in the savestate tree"));
+                return false;
             }
 
-            sendMessage(MSGN_LOADSTATE);
-            sendString(savestatepath);
-
-            int message = receiveMessage();
-            /* Loading is not assured to succeed, the following must
-             * only be done if it's the case.
-             */
-            if (message == MSGB_LOADING_SUCCEEDED) {
-                /* The copy of SharedConfig that the game stores may not
-                 * be the same as this one due to memory loading, so we
-                 * send it.
-                 */
-                sendMessage(MSGN_CONFIG);
-                sendData(&context->config.sc, sizeof(SharedConfig));
-
-                if (context->config.sc.recording == SharedConfig::RECORDING_WRITE) {
-                    /* When in writing move, we load the movie associated
-                     * with the savestate.
-                     * Check if we are loading the same state we just saved.
-                     * If so, we can keep the same movie.
-                     */
-                    if (last_savestate_slot != statei) {
-                        /* Load the movie file */
-                        movie.loadInputs(moviepath);
-                    }
-
-                    /* Increment rerecord count */
-                    context->rerecord_count++;
-                    emit rerecordChanged();
-                }
-
-                last_savestate_slot = statei;
-                message = receiveMessage();
+            if (loadState(node.slot)) {
+                context->savestate_tree.use(node.id);
+                emit savestateTreeChanged();
             }
+            return false;
+        }
 
-            /* The frame count has changed, we must get the new one */
-            if (message != MSGB_FRAMECOUNT_TIME) {
-                std::cerr << "Got wrong message after state loading" << std::endl;
-                return false;
-            }
-            receiveData(&context->framecount, sizeof(unsigned long));
-            if (context->config.sc.recording == SharedConfig::RECORDING_WRITE) {
-                context->config.sc.movie_framecount = context->framecount;
+        case HOTKEY_DELETESTATE_TREE:
+        {
+            SaveStateTree::Node node;
+            if (context->savestate_tree.get(context->savestate_tree.selected(), node)) {
+                deleteTreeState(node);
+                emit savestateTreeChanged();
             }
-            receiveData(&context->current_time, sizeof(struct timespec));
-            emit frameCountChanged();
             return false;
         }
 
@@ -762,6 +1130,31 @@ bool GameLoop::processEvent(uint8_t type, struct HotKey &hk)
             emit sharedConfigChanged();
             return false;
 
+        case HOTKEY_EXPORT_SAVESTATES:
+            /* Copy all in-memory savestates into the savestate directory,
+             * so that they can be loaded later with savestates on disk.
+             */
+            if (!(context->config.sc.savestate_settings & SharedConfig::SS_RAM)) {
+                emit alertToShow(QString("Savestates are already stored on disk"));
+                return false;
+            }
+
+            /* Slot 0 holds the base savestate of incremental savestates.
+             * Keyframes and states of the savestate tree share their pages,
+             * so they cannot be exported.
+             */
+            for (int statei = 0; statei < SAVESTATE_KEYFRAME_SLOT; statei++) {
+                if ((statei == 0) && !(context->config.sc.savestate_settings & SharedConfig::SS_INCREMENTAL))
+                    continue;
+                if ((statei > 0) && !ram_savestates[statei])
+                    continue;
+
+                sendMessage(MSGN_EXPORT_SAVESTATE);
+                sendData(&statei, sizeof(int));
+                sendString(savestatePath(statei));
+            }
+            return false;
+
         /* Start or stop a video encode */
         case HOTKEY_TOGGLE_ENCODE:
 #ifdef LIBTAS_ENABLE_AVDUMPING
@@ -852,6 +1245,9 @@ void GameLoop::processInputs(AllInputs &ai)
             }
 
             if (context->config.sc.recording == SharedConfig::RECORDING_WRITE) {
+                /* Keyframes after this frame don't match the movie anymore */
+                deleteKeyframesAfter(context->framecount);
+
                 /* Save inputs to moviefile */
                 movie.setInputs(ai);
                 AutoSave::update(context, movie);
@@ -884,6 +1280,20 @@ void GameLoop::processInputs(AllInputs &ai)
     }
 }
 
+void GameLoop::sendMemoryRules()
+{
+    std::lock_guard<std::mutex> lock(context->config.memory_rules_mutex);
+
+    int count = context->config.memory_rules.size();
+    if (count > MEMORY_RULES_MAX)
+        count = MEMORY_RULES_MAX;
+
+    sendMessage(MSGN_MEMORY_RULES);
+    sendData(&count, sizeof(int));
+    sendData(context->config.memory_rules.data(), count * sizeof(MemoryRule));
+    context->config.memory_rules_modified = false;
+}
+
 void GameLoop::loopSendMessages(AllInputs &ai)
 {
     /* Send shared config if modified */
@@ -894,6 +1304,10 @@ void GameLoop::loopSendMessages(AllInputs &ai)
         context->config.sc_modified = false;
     }
 
+    /* Send the memory exclusion rules if modified */
+    if (context->config.memory_rules_modified)
+        sendMemoryRules();
+
     /* Send dump file if modified */
     if (context->config.dumpfile_modified) {
         sendMessage(MSGN_DUMP_FILE);
@@ -963,8 +1377,11 @@ void GameLoop::loopExit()
     movie.close();
     closeSocket();
 
-    /* Remove savestates because they are invalid on future instances of the game */
-    remove_savestates(context);
+    /* Remove savestates because they are invalid on future instances of the
+     * game, unless the game was launched so that they can be loaded again.
+     */
+    if (!(context->config.sc.savestate_settings & SharedConfig::SS_PERSISTENT))
+        remove_savestates(context);
 
     context->status = Context::INACTIVE;
     emit statusChanged();
@@ -22,9 +22,13 @@
 
 #include <QObject>
 #include <memory>
+#include <array>
 
 #include "Context.h"
 #include "MovieFile.h"
+#include "SaveStateTree.h"
+#include "KeyframeCache.h"
+#include "../shared/messages.h" // SAVESTATE_MAX_SLOTS
 #include <xcb/xcb_keysyms.h>
 
 /* TODO: I really don't like this extern, but let's use it for now.
@@ -65,6 +69,21 @@ private:
      */
     int last_savestate_slot;
 
+    /* Keep track of which slots hold a savestate when savestates are
+     * stored in the game memory.
+     */
+    std::array<bool, SAVESTATE_MAX_SLOTS> ram_savestates;
+
+    /* Savestates taken automatically to seek in the movie */
+    KeyframeCache keyframes;
+
+    /* Are we replaying the movie up to a frame after loading a keyframe,
+     * and the recording mode to set back when this is done.
+     */
+    bool seeking;
+    unsigned int seek_frame;
+    int seek_recording;
+
     /* Keyboard layout */
     std::unique_ptr<xcb_key_symbols_t, void(*)(xcb_key_symbols_t*)> keysyms;
 
@@ -87,10 +106,59 @@ private:
 
     bool processEvent(uint8_t type, struct HotKey &hk);
 
+    /* Paths of the savestate and of the movie of a slot */
+    std::string savestatePath(int slot);
+    std::string savestateMoviePath(int slot);
+
+    /* Save the state of the game in a slot. Returns false if saving is not
+     * allowed.
+     */
+    bool saveState(int slot);
+
+    /* Load the state of a slot. Returns true if loading succeeded. */
+    bool loadState(int slot);
+
+    /* Ask the game to save, load or remove the savestate of a slot, without
+     * doing anything with the movie.
+     */
+    void sendSaveState(int slot);
+    bool sendLoadState(int slot);
+    void sendDeleteState(int slot);
+
+    /* Take a keyframe if needed, and stop seeking when the frame is reached.
+     * Called at each frame boundary.
+     */
+    void processKeyframes();
+
+    /* Remove the keyframes after a frame */
+    void deleteKeyframesAfter(unsigned int framecount);
+
+    /* Load the nearest keyframe before a frame of the movie, then replay the
+     * movie up to this frame.
+     */
+    void seek(unsigned int framecount);
+    void endSeek();
+
+    /* Get the number of bytes used by the savestate of each state of the
+     * tree, indexed by slot.
+     */
+    bool savestateSizes(const std::vector<SaveStateTree::Node>& nodes, uint64_t* sizes);
+
+    /* Save a new state in the savestate tree, removing the least recently
+     * used states if needed.
+     */
+    void saveTreeState();
+
+    /* Remove a state of the savestate tree */
+    void deleteTreeState(const SaveStateTree::Node& node);
+
     void sleepSendPreview();
 
     void processInputs(AllInputs &ai);
 
+    /* Send the rules excluding memory areas from savestates */
+    void sendMemoryRules();
+
     void loopSendMessages(AllInputs &ai);
 
     /* Determine if we are allowed to send inputs to the game, based on which
@@ -108,7 +176,11 @@ signals:
     void rerecordChanged();
     void frameCountChanged();
     void sharedConfigChanged();
+    void savestateTreeChanged();
     void fpsChanged(float fps, float lfps);
+    void checkpointTimingsChanged(bool restore, float signal, float suspend, float state, float resume);
+    void memoryRulesAuditChanged();
+    void areaStatsChanged();
     void askMovieSaved(void* promise);
 
     void controllerButtonToggled(int controller_id, int button, bool pressed);
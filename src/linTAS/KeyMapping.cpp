@@ -106,6 +106,11 @@ void KeyMapping::init(xcb_connection_t* conn)
     hotkey_list.push_back({{IT_KEYBOARD, XK_F8}, HOTKEY_LOADSTATE8, "Load State 8"});
     hotkey_list.push_back({{IT_KEYBOARD, XK_F9}, HOTKEY_LOADSTATE9, "Load State 9"});
     hotkey_list.push_back({{IT_NONE, 0}, HOTKEY_TOGGLE_ENCODE, "Toggle encode"});
+    hotkey_list.push_back({{IT_NONE, 0}, HOTKEY_EXPORT_SAVESTATES, "Export savestates"});
+    hotkey_list.push_back({{IT_NONE, 0}, HOTKEY_SAVESTATE_TREE, "Save State in tree"});
+    hotkey_list.push_back({{IT_NONE, 0}, HOTKEY_LOADSTATE_TREE, "Load State from tree"});
+    hotkey_list.push_back({{IT_NONE, 0}, HOTKEY_DELETESTATE_TREE, "Delete State from tree"});
+    hotkey_list.push_back({{IT_NONE, 0}, HOTKEY_REWIND, "Rewind"});
 
     /* Set default hotkeys */
     default_hotkeys();
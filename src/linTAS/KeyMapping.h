@@ -180,6 +180,12 @@ typedef int HotKeyType; enum
     HOTKEY_LOADSTATE8,
     HOTKEY_LOADSTATE9,
     HOTKEY_TOGGLE_ENCODE, // Start/stop audio/video encoding
+    HOTKEY_EXPORT_SAVESTATES, // Copy in-memory savestates to disk
+    HOTKEY_SAVESTATE_TREE, // Save a new state in the savestate tree
+    HOTKEY_LOADSTATE_TREE, // Load the selected state of the savestate tree
+    HOTKEY_DELETESTATE_TREE, // Remove the selected state of the savestate tree
+    HOTKEY_REWIND, // Go back a few frames in the movie using keyframes
+    HOTKEY_SEEK, // Go to the frame of the movie chosen in the UI
     HOTKEY_LEN
 };
 
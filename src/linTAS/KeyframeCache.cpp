@@ -0,0 +1,100 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "KeyframeCache.h"
+#include "../shared/messages.h" // SAVESTATE_KEYFRAME_SLOT
+
+void KeyframeCache::clear()
+{
+    keyframes.clear();
+}
+
+int KeyframeCache::count()
+{
+    return keyframes.size();
+}
+
+bool KeyframeCache::contains(unsigned int framecount)
+{
+    for (const Keyframe& kf : keyframes) {
+        if (kf.framecount == framecount)
+            return true;
+    }
+    return false;
+}
+
+int KeyframeCache::freeSlot()
+{
+    for (int slot = SAVESTATE_KEYFRAME_SLOT; slot < SAVESTATE_KEYFRAME_SLOT + SAVESTATE_KEYFRAME_COUNT; slot++) {
+        bool used = false;
+        for (const Keyframe& kf : keyframes) {
+            if (kf.slot == slot) {
+                used = true;
+                break;
+            }
+        }
+        if (!used)
+            return slot;
+    }
+    return -1;
+}
+
+void KeyframeCache::add(unsigned int framecount, int slot)
+{
+    keyframes.push_back({framecount, slot});
+}
+
+int KeyframeCache::removeOldest()
+{
+    if (keyframes.empty())
+        return -1;
+
+    int slot = keyframes.front().slot;
+    keyframes.erase(keyframes.begin());
+    return slot;
+}
+
+std::vector<int> KeyframeCache::removeAfter(unsigned int framecount)
+{
+    std::vector<int> slots;
+    for (auto it = keyframes.begin(); it != keyframes.end(); ) {
+        if (it->framecount > framecount) {
+            slots.push_back(it->slot);
+            it = keyframes.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    return slots;
+}
+
+bool KeyframeCache::nearest(unsigned int framecount, unsigned int& keyframe, int& slot)
+{
+    bool found = false;
+    for (const Keyframe& kf : keyframes) {
+        if ((kf.framecount <= framecount) && (!found || (kf.framecount > keyframe))) {
+            keyframe = kf.framecount;
+            slot = kf.slot;
+            found = true;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,72 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LINTAS_KEYFRAMECACHE_H_INCLUDED
+#define LINTAS_KEYFRAMECACHE_H_INCLUDED
+
+#include <vector>
+
+/* Keyframes are savestates taken automatically every few frames when a movie
+ * is recording or playing, so that we can quickly seek to any frame of the
+ * movie. Each keyframe is stored by the game in its own slot, starting at
+ * SAVESTATE_KEYFRAME_SLOT.
+ *
+ * A keyframe only stays valid while the inputs of the movie before it don't
+ * change, so keyframes after a frame whose inputs are modified are removed.
+ */
+class KeyframeCache {
+public:
+    /* Remove all keyframes */
+    void clear();
+
+    /* Number of keyframes */
+    int count();
+
+    /* Is there a keyframe of this frame */
+    bool contains(unsigned int framecount);
+
+    /* Returns a slot that is not used by a keyframe, or -1 */
+    int freeSlot();
+
+    /* Add a keyframe saved in a slot */
+    void add(unsigned int framecount, int slot);
+
+    /* Remove the keyframe that was added first, and return its slot */
+    int removeOldest();
+
+    /* Remove all keyframes after a frame, and return their slots */
+    std::vector<int> removeAfter(unsigned int framecount);
+
+    /* Get the last keyframe before or at a frame. Returns false if there
+     * is none.
+     */
+    bool nearest(unsigned int framecount, unsigned int& keyframe, int& slot);
+
+private:
+    struct Keyframe {
+        unsigned int framecount;
+        int slot;
+    };
+
+    /* Keyframes in order of insertion */
+    std::vector<Keyframe> keyframes;
+};
+
+#endif
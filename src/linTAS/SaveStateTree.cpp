@@ -0,0 +1,161 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "SaveStateTree.h"
+#include "../shared/messages.h" // SAVESTATE_TREE_SLOT
+
+void SaveStateTree::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    node_list.clear();
+    current_id = -1;
+    selected_id = -1;
+}
+
+int SaveStateTree::find(int id)
+{
+    for (int i = 0; i < static_cast<int>(node_list.size()); i++) {
+        if (node_list[i].id == id)
+            return i;
+    }
+    return -1;
+}
+
+int SaveStateTree::freeSlot()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int slot = SAVESTATE_TREE_SLOT; slot < SAVESTATE_MAX_SLOTS; slot++) {
+        bool used = false;
+        for (const Node& node : node_list) {
+            if (node.slot == slot) {
+                used = true;
+                break;
+            }
+        }
+        if (!used)
+            return slot;
+    }
+    return -1;
+}
+
+int SaveStateTree::add(int slot, unsigned int framecount)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Node node;
+    node.id = next_id++;
+    node.parent = current_id;
+    node.slot = slot;
+    node.framecount = framecount;
+    node.last_used = ++use_counter;
+    node_list.push_back(node);
+
+    current_id = node.id;
+    selected_id = node.id;
+    return node.id;
+}
+
+bool SaveStateTree::get(int id, Node& node)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int i = find(id);
+    if (i < 0)
+        return false;
+    node = node_list[i];
+    return true;
+}
+
+void SaveStateTree::use(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int i = find(id);
+    if (i < 0) {
+        current_id = -1;
+        return;
+    }
+    node_list[i].last_used = ++use_counter;
+    current_id = id;
+    selected_id = id;
+}
+
+void SaveStateTree::remove(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int i = find(id);
+    if (i < 0)
+        return;
+
+    /* States don't depend on their parent to be loaded, so the branch is
+     * kept by attaching the children to the parent of the removed state.
+     */
+    int parent = node_list[i].parent;
+    for (Node& node : node_list) {
+        if (node.parent == id)
+            node.parent = parent;
+    }
+    node_list.erase(node_list.begin() + i);
+
+    if (current_id == id)
+        current_id = parent;
+    if (selected_id == id)
+        selected_id = current_id;
+}
+
+int SaveStateTree::leastRecentlyUsed()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int lru_id = -1;
+    uint64_t lru = UINT64_MAX;
+    for (const Node& node : node_list) {
+        /* The current state is never removed */
+        if (node.id == current_id)
+            continue;
+        if (node.last_used < lru) {
+            lru = node.last_used;
+            lru_id = node.id;
+        }
+    }
+    return lru_id;
+}
+
+int SaveStateTree::current()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current_id;
+}
+
+int SaveStateTree::selected()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return selected_id;
+}
+
+void SaveStateTree::select(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (find(id) >= 0)
+        selected_id = id;
+}
+
+std::vector<SaveStateTree::Node> SaveStateTree::nodes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return node_list;
+}
@@ -0,0 +1,110 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LINTAS_SAVESTATETREE_H_INCLUDED
+#define LINTAS_SAVESTATETREE_H_INCLUDED
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+/* Tree of savestates, where each state is a child of the state that was
+ * saved or loaded before it. The game stores each state in its own slot,
+ * starting at SAVESTATE_TREE_SLOT. States are removed when there is no free
+ * slot or when savestates use more than a storage budget, starting from the
+ * least recently used one.
+ *
+ * The tree is modified by the game-handling thread and displayed by the UI,
+ * so all accesses are protected by a mutex.
+ */
+class SaveStateTree {
+public:
+    struct Node {
+        /* Identifier of the state, which is never reused */
+        int id;
+
+        /* Identifier of the parent state, or -1 */
+        int parent;
+
+        /* Slot of the game where the state is stored */
+        int slot;
+
+        /* Frame count when the state was saved */
+        unsigned int framecount;
+
+        /* Value of a counter that is incremented each time a state is saved
+         * or loaded, to know which state was used the least recently.
+         */
+        uint64_t last_used;
+    };
+
+    /* Remove all states, which are invalid on future instances of the game */
+    void clear();
+
+    /* Returns a free slot, or -1 if all slots are used */
+    int freeSlot();
+
+    /* Add a state saved in `slot` as a child of the current state, and make
+     * it the current state. Returns the id of the new state.
+     */
+    int add(int slot, unsigned int framecount);
+
+    /* Get a state. Returns false if it does not exist */
+    bool get(int id, Node& node);
+
+    /* Make a state the current state after it has been loaded. If `id` is
+     * -1, a savestate outside of the tree was loaded.
+     */
+    void use(int id);
+
+    /* Remove a state. Its children become children of its parent. */
+    void remove(int id);
+
+    /* Returns the least recently used state that can be removed, or -1 */
+    int leastRecentlyUsed();
+
+    /* State that was last saved or loaded, or -1 */
+    int current();
+
+    /* State selected in the UI, which is loaded or deleted by the
+     * corresponding hotkeys, or -1
+     */
+    int selected();
+    void select(int id);
+
+    /* Copy of all the states, in order of creation */
+    std::vector<Node> nodes();
+
+private:
+    std::mutex mutex;
+    std::vector<Node> node_list;
+
+    int current_id = -1;
+    int selected_id = -1;
+    int next_id = 0;
+    uint64_t use_counter = 0;
+
+    /* Returns the index of a state in node_list, or -1. Must be called with
+     * the mutex locked.
+     */
+    int find(int id);
+};
+
+#endif
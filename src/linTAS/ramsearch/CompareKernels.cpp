@@ -0,0 +1,199 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CompareKernels.h"
+#include <cstring>
+#include <type_traits>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+/* Searching for an exact float value is intended, so -Wfloat-equal is disabled */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+
+/* Comparison operators, which apply both to single values and to vectors.
+ * The result of a vector comparison is a vector of masks, with all bits of
+ * a lane set if the comparison is true.
+ */
+struct OpEqual {
+    template <class V> static auto apply(V a, V b) -> decltype(a == b) {return a == b;}
+};
+struct OpNotEqual {
+    template <class V> static auto apply(V a, V b) -> decltype(a != b) {return a != b;}
+};
+struct OpLess {
+    template <class V> static auto apply(V a, V b) -> decltype(a < b) {return a < b;}
+};
+struct OpGreater {
+    template <class V> static auto apply(V a, V b) -> decltype(a > b) {return a > b;}
+};
+struct OpLessEqual {
+    template <class V> static auto apply(V a, V b) -> decltype(a <= b) {return a <= b;}
+};
+struct OpGreaterEqual {
+    template <class V> static auto apply(V a, V b) -> decltype(a >= b) {return a >= b;}
+};
+
+/* Returns if a value is neither NaN nor Inf, for which the difference with
+ * itself is NaN.
+ */
+template <class V>
+static inline auto isFinite(V v) -> decltype(v == v)
+{
+    V d = v - v;
+    return d == d;
+}
+
+#if defined(__AVX2__)
+
+typedef __m256i MaskVector;
+
+/* Get one bit for each lane of a mask vector */
+static inline uint32_t maskBits(MaskVector m, int lane_size)
+{
+    switch (lane_size) {
+        case 1:
+            return _mm256_movemask_epi8(m);
+        case 2: {
+            /* Packing is done inside each half of the vector */
+            uint32_t bits = _mm256_movemask_epi8(_mm256_packs_epi16(m, _mm256_setzero_si256()));
+            return (bits & 0xff) | ((bits >> 8) & 0xff00);
+        }
+        case 4:
+            return _mm256_movemask_ps(_mm256_castsi256_ps(m));
+        default:
+            return _mm256_movemask_pd(_mm256_castsi256_pd(m));
+    }
+}
+
+#elif defined(__SSE2__)
+
+typedef __m128i MaskVector;
+
+/* Get one bit for each lane of a mask vector */
+static inline uint32_t maskBits(MaskVector m, int lane_size)
+{
+    switch (lane_size) {
+        case 1:
+            return _mm_movemask_epi8(m);
+        case 2:
+            return _mm_movemask_epi8(_mm_packs_epi16(m, _mm_setzero_si128()));
+        case 4:
+            return _mm_movemask_ps(_mm_castsi128_ps(m));
+        default:
+            return _mm_movemask_pd(_mm_castsi128_pd(m));
+    }
+}
+
+#endif
+
+template <class T, class Op>
+static inline bool compareValue(T v, T c)
+{
+    if (std::is_floating_point<T>::value && !isFinite(v))
+        return false;
+    return Op::apply(v, c);
+}
+
+template <class T, class Op>
+static void compareLoop(const T* values, const T* previous, T value, size_t count, uint64_t* matches)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    /* Vectors of values, using the compiler vector extension */
+    typedef T Vector __attribute__((vector_size(sizeof(MaskVector))));
+    const int lanes = sizeof(Vector) / sizeof(T);
+
+    Vector value_vec;
+    for (int l = 0; l < lanes; l++)
+        value_vec[l] = value;
+
+    for (; i + 64 <= count; i += 64) {
+        uint64_t bits = 0;
+        for (int l = 0; l < 64; l += lanes) {
+            Vector v, c;
+            memcpy(&v, values + i + l, sizeof(Vector));
+            if (previous)
+                memcpy(&c, previous + i + l, sizeof(Vector));
+            else
+                c = value_vec;
+
+            auto m = Op::apply(v, c);
+            if (std::is_floating_point<T>::value)
+                m &= isFinite(v);
+
+            bits |= static_cast<uint64_t>(maskBits((MaskVector) m, sizeof(T))) << l;
+        }
+        matches[i / 64] = bits;
+    }
+#endif
+
+    /* Remaining values */
+    for (; i < count; i += 64) {
+        uint64_t bits = 0;
+        for (size_t l = 0; (l < 64) && (i + l < count); l++) {
+            if (compareValue<T, Op>(values[i + l], previous ? previous[i + l] : value))
+                bits |= static_cast<uint64_t>(1) << l;
+        }
+        matches[i / 64] = bits;
+    }
+}
+
+template <class T>
+void compareValues(const T* values, const T* previous, T value, CompareType compare_type, CompareOperator compare_operator, size_t count, uint64_t* matches)
+{
+    if (compare_type == CompareType::Value)
+        previous = nullptr;
+
+    switch (compare_operator) {
+        case CompareOperator::Equal:
+            compareLoop<T, OpEqual>(values, previous, value, count, matches);
+            break;
+        case CompareOperator::NotEqual:
+            compareLoop<T, OpNotEqual>(values, previous, value, count, matches);
+            break;
+        case CompareOperator::Less:
+            compareLoop<T, OpLess>(values, previous, value, count, matches);
+            break;
+        case CompareOperator::Greater:
+            compareLoop<T, OpGreater>(values, previous, value, count, matches);
+            break;
+        case CompareOperator::LessEqual:
+            compareLoop<T, OpLessEqual>(values, previous, value, count, matches);
+            break;
+        case CompareOperator::GreaterEqual:
+            compareLoop<T, OpGreaterEqual>(values, previous, value, count, matches);
+            break;
+    }
+}
+
+template void compareValues<unsigned char>(const unsigned char*, const unsigned char*, unsigned char, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<char>(const char*, const char*, char, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<unsigned short>(const unsigned short*, const unsigned short*, unsigned short, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<short>(const short*, const short*, short, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<unsigned int>(const unsigned int*, const unsigned int*, unsigned int, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<int>(const int*, const int*, int, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<int64_t>(const int64_t*, const int64_t*, int64_t, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<uint64_t>(const uint64_t*, const uint64_t*, uint64_t, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<float>(const float*, const float*, float, CompareType, CompareOperator, size_t, uint64_t*);
+template void compareValues<double>(const double*, const double*, double, CompareType, CompareOperator, size_t, uint64_t*);
+
+#pragma GCC diagnostic pop
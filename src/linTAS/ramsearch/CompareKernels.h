@@ -0,0 +1,38 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINTAS_COMPAREKERNELS_H_INCLUDED
+#define LINTAS_COMPAREKERNELS_H_INCLUDED
+
+#include "CompareEnums.h"
+#include <cstdint>
+#include <cstddef>
+
+/* Compare `count` values with either the `previous` values or `value`,
+ * depending on the compare type. The bit of each value that passes the
+ * comparison is set in `matches`, which holds 64 values per word. Values of
+ * floating-point types must also be finite.
+ *
+ * Values are compared using AVX2 or SSE2 vectors when the program is built
+ * with them. It is instantiated for all the value types of the ram search.
+ */
+template <class T>
+void compareValues(const T* values, const T* previous, T value, CompareType compare_type, CompareOperator compare_operator, size_t count, uint64_t* matches);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINTAS_IRAMCANDIDATES_H_INCLUDED
+#define LINTAS_IRAMCANDIDATES_H_INCLUDED
+
+#include "CompareEnums.h"
+#include <cstdint>
+#include <cstddef>
+
+/* Addresses of the game memory that are candidates of a ram search, with
+ * their previous value. Candidates are grouped by memory region, and are
+ * accessed by their index in increasing address order.
+ */
+class IRamCandidates {
+public:
+    virtual ~IRamCandidates() = default;
+
+    /* Number of candidates */
+    virtual size_t count() const = 0;
+
+    virtual uintptr_t address(size_t index) const = 0;
+    virtual const char* tostring(size_t index, bool hex) const = 0;
+    virtual const char* tostring_current(size_t index, bool hex) const = 0;
+
+    /* Number of regions, which are searched one at a time */
+    virtual size_t regionCount() const = 0;
+
+    /* Keep the candidates of a region whose current value passes the
+     * comparison, and store their current value as previous value. Returns
+     * the number of candidates that were checked.
+     */
+    virtual size_t searchRegion(size_t region, CompareType compare_type, CompareOperator compare_operator, double compare_value) = 0;
+
+    /* Remove the regions without candidates after a search */
+    virtual void finishSearch() = 0;
+};
+
+#endif
@@ -17,7 +17,19 @@
     along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "IRamWatch.h"
+#include "MemAccess.h"
+#include <sys/uio.h>
 
-ssize_t IRamWatch::last_read;
-pid_t IRamWatch::game_pid;
+size_t readGameMemory(pid_t pid, uintptr_t addr, void* buf, size_t size)
+{
+    struct iovec local, remote;
+    local.iov_base = buf;
+    local.iov_len = size;
+    remote.iov_base = reinterpret_cast<void*>(addr);
+    remote.iov_len = size;
+
+    ssize_t ret = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    if (ret < 0)
+        return 0;
+    return ret;
+}
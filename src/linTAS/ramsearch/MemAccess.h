@@ -17,27 +17,20 @@
     along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef LINTAS_IRAMWATCH_H_INCLUDED
-#define LINTAS_IRAMWATCH_H_INCLUDED
+#ifndef LINTAS_MEMACCESS_H_INCLUDED
+#define LINTAS_MEMACCESS_H_INCLUDED
 
-#include "CompareEnums.h"
 #include <cstdint>
+#include <cstddef>
 #include <sys/types.h>
-#include <string>
-
-class IRamWatch {
-public:
-    uintptr_t address;
-    static ssize_t last_read;
-    static pid_t game_pid;
-
-    IRamWatch(uintptr_t addr) : address(addr) {};
-    virtual ~IRamWatch() = default;
-    virtual const char* tostring(bool hex) = 0;
-    virtual const char* tostring_current(bool hex) = 0;
-    virtual bool check_update(CompareType compare_type, CompareOperator compare_operator, double compare_value_db) = 0;
-    virtual bool check_no_update(CompareType compare_type, CompareOperator compare_operator, double compare_value_db) = 0;
-    virtual bool query() = 0;
-};
+
+/* Size of the chunks of game memory that are read at once by the ram search */
+#define RAMSEARCH_CHUNK_SIZE (4 * 1024 * 1024)
+
+/* Read `size` bytes of the game memory at address `addr` into `buf`, using a
+ * single process_vm_readv call. Returns the number of bytes that were read,
+ * which is lower than `size` if the memory stops being readable before.
+ */
+size_t readGameMemory(pid_t pid, uintptr_t addr, void* buf, size_t size);
 
 #endif
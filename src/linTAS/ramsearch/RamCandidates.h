@@ -0,0 +1,338 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINTAS_RAMCANDIDATES_H_INCLUDED
+#define LINTAS_RAMCANDIDATES_H_INCLUDED
+
+#include "IRamCandidates.h"
+#include "CompareKernels.h"
+#include "MemAccess.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <utility> // std::pair
+#include <sys/types.h>
+#include <unistd.h> // sysconf
+#include <inttypes.h>
+
+template <typename T> static inline const char* fmt_from_type(bool hex) {return hex?"%x":"%d";}
+template <> inline const char* fmt_from_type<float>(bool hex) {return hex?"%a":"%g";}
+template <> inline const char* fmt_from_type<double>(bool hex) {return hex?"%la":"%lg";}
+template <> inline const char* fmt_from_type<int64_t>(bool hex) {return hex?"%" PRIx64:"%" PRId64;}
+template <> inline const char* fmt_from_type<uint64_t>(bool hex) {return hex?"%" PRIx64:"%" PRIu64;}
+
+template <class T>
+class RamCandidates : public IRamCandidates {
+public:
+    RamCandidates(pid_t pid) : game_pid(pid), total(0),
+        values(RAMSEARCH_CHUNK_SIZE / sizeof(T)),
+        current(RAMSEARCH_CHUNK_SIZE / sizeof(T)),
+        matches((values.size() + 63) / 64),
+        slot_bits((values.size() + 63) / 64) {};
+
+    /* Read a chunk of memory of at most RAMSEARCH_CHUNK_SIZE bytes, and add a
+     * region with the aligned addresses whose value passes the comparison,
+     * or all the addresses with a finite value when comparing with previous
+     * values. Returns the size of memory that was processed, which includes
+     * the page that could not be read if any.
+     */
+    size_t addChunk(uintptr_t addr, size_t size, CompareType compare_type, CompareOperator compare_operator, double compare_value)
+    {
+        size_t read_size = readGameMemory(game_pid, addr, values.data(), size);
+        size_t slot_count = read_size / sizeof(T);
+        size_t words = (slot_count + 63) / 64;
+
+        if (compare_type == CompareType::Value)
+            compareValues<T>(values.data(), nullptr, static_cast<T>(compare_value), compare_type, compare_operator, slot_count, matches.data());
+        else
+            compareValues<T>(values.data(), values.data(), 0, CompareType::Previous, CompareOperator::Equal, slot_count, matches.data());
+
+        size_t found = 0;
+        for (size_t w = 0; w < words; w++)
+            found += __builtin_popcountll(matches[w]);
+
+        if (found > 0) {
+            regions.emplace_back();
+            Region& region = regions.back();
+            region.addr = addr;
+            region.slot_count = slot_count;
+            region.first = total;
+            total += found;
+
+            if (found == slot_count) {
+                region.previous.assign(values.begin(), values.begin() + slot_count);
+            }
+            else {
+                region.previous.reserve(found);
+                for (size_t w = 0; w < words; w++)
+                    for (uint64_t bits = matches[w]; bits != 0; bits &= bits - 1)
+                        region.previous.push_back(values[w * 64 + __builtin_ctzll(bits)]);
+            }
+            storeSlots(region, matches.data(), words);
+        }
+
+        /* Skip the page that could not be read */
+        if (read_size < size) {
+            static const size_t page_size = sysconf(_SC_PAGESIZE);
+            read_size = (read_size / page_size + 1) * page_size;
+        }
+        return read_size;
+    }
+
+    size_t count() const
+    {
+        return total;
+    }
+
+    uintptr_t address(size_t index) const
+    {
+        size_t k;
+        const Region& region = findRegion(index, k);
+        return region.addr + findSlot(region, k) * sizeof(T);
+    }
+
+    const char* tostring(size_t index, bool hex) const
+    {
+        size_t k;
+        const Region& region = findRegion(index, k);
+
+        static char str[30];
+        /* Use snprintf instead of ostringstream for a good speedup */
+        snprintf(str, 30, fmt_from_type<T>(hex), region.previous[k]);
+        return str;
+    }
+
+    const char* tostring_current(size_t index, bool hex) const
+    {
+        T value = 0;
+        readGameMemory(game_pid, address(index), &value, sizeof(T));
+
+        static char str[30];
+        /* Use snprintf instead of ostringstream for a good speedup */
+        snprintf(str, 30, fmt_from_type<T>(hex), value);
+        return str;
+    }
+
+    size_t regionCount() const
+    {
+        return regions.size();
+    }
+
+    size_t searchRegion(size_t r, CompareType compare_type, CompareOperator compare_operator, double compare_value)
+    {
+        Region& region = regions[r];
+        size_t n = region.previous.size();
+        if (n == 0)
+            return 0;
+
+        /* Read the memory from the first to the last candidate at once. If a
+         * page cannot be read, the reading continues after it, and the
+         * candidates of the page are removed.
+         */
+        size_t first_slot = findSlot(region, 0);
+        size_t last_slot = findSlot(region, n - 1);
+        uintptr_t first_addr = region.addr + first_slot * sizeof(T);
+        size_t size = (last_slot - first_slot + 1) * sizeof(T);
+
+        holes.clear();
+        for (size_t offset = 0; offset < size; ) {
+            uint8_t* buf = reinterpret_cast<uint8_t*>(values.data()) + offset;
+            size_t read_size = readGameMemory(game_pid, first_addr + offset, buf, size - offset);
+            offset += read_size;
+            if (offset < size) {
+                static const size_t page_size = sysconf(_SC_PAGESIZE);
+                size_t hole_end = std::min(((first_addr + offset) / page_size + 1) * page_size - first_addr, size);
+                holes.push_back(std::make_pair(first_slot + offset / sizeof(T), first_slot + hole_end / sizeof(T)));
+                offset = hole_end;
+            }
+        }
+
+        /* Gather the current values of candidates next to their previous
+         * values, so that they are compared at once. Previous values of
+         * candidates that could not be read are dropped.
+         */
+        size_t readable = 0;
+        size_t index = 0;
+        size_t hole = 0;
+        forEachSlot(region, [&](size_t slot) {
+            if (!inHole(slot, hole)) {
+                current[readable] = values[slot - first_slot];
+                region.previous[readable++] = region.previous[index];
+            }
+            index++;
+        });
+
+        compareValues<T>(current.data(), region.previous.data(), static_cast<T>(compare_value), compare_type, compare_operator, readable, matches.data());
+
+        /* Keep the candidates that passed, and store their new value */
+        size_t words = (region.slot_count + 63) / 64;
+        std::fill(slot_bits.begin(), slot_bits.begin() + words, 0);
+        size_t k = 0;
+        size_t kept = 0;
+        hole = 0;
+        forEachSlot(region, [&](size_t slot) {
+            if (inHole(slot, hole))
+                return;
+            if ((matches[k / 64] >> (k % 64)) & 1) {
+                slot_bits[slot / 64] |= static_cast<uint64_t>(1) << (slot % 64);
+                region.previous[kept++] = current[k];
+            }
+            k++;
+        });
+
+        region.previous.resize(kept);
+        if (kept < region.previous.capacity() / 2)
+            region.previous.shrink_to_fit();
+        storeSlots(region, slot_bits.data(), words);
+
+        return n;
+    }
+
+    void finishSearch()
+    {
+        regions.erase(
+            std::remove_if(regions.begin(), regions.end(),
+                [] (const Region& region) {return region.previous.empty();}),
+            regions.end());
+
+        total = 0;
+        for (Region& region : regions) {
+            region.first = total;
+            total += region.previous.size();
+        }
+    }
+
+private:
+    /* Candidates of a region are stored as a bitmap of its aligned addresses
+     * when they are dense, or as a sorted array of address offsets otherwise.
+     * Previous values are packed in address order.
+     */
+    struct Region {
+        uintptr_t addr;
+        size_t slot_count;
+
+        /* Index of the first candidate of the region */
+        size_t first;
+
+        /* One bit for each aligned address, and number of candidates before
+         * each word of the bitmap.
+         */
+        std::vector<uint64_t> bitmap;
+        std::vector<uint32_t> ranks;
+
+        /* Offset of each candidate, in number of values */
+        std::vector<uint32_t> offsets;
+
+        std::vector<T> previous;
+    };
+
+    pid_t game_pid;
+    std::vector<Region> regions;
+    size_t total;
+
+    /* Buffers used when adding and searching regions */
+    std::vector<T> values;
+    std::vector<T> current;
+    std::vector<uint64_t> matches;
+    std::vector<uint64_t> slot_bits;
+
+    /* Ranges of offsets that could not be read when searching a region */
+    std::vector<std::pair<size_t, size_t>> holes;
+
+    /* Returns if an offset is inside an unreadable range, starting from the
+     * range at index `hole`, which is advanced as offsets increase.
+     */
+    bool inHole(size_t slot, size_t& hole) const
+    {
+        while ((hole < holes.size()) && (slot >= holes[hole].second))
+            hole++;
+        return (hole < holes.size()) && (slot >= holes[hole].first);
+    }
+
+    /* Store the candidates of a region from a bitmap of its addresses,
+     * choosing the most compact representation. An offset takes 32 bits
+     * per candidate, while the bitmap takes one bit per address.
+     */
+    static void storeSlots(Region& region, const uint64_t* bits, size_t words)
+    {
+        size_t n = region.previous.size();
+
+        if ((n * 32) >= (words * 64)) {
+            region.bitmap.assign(bits, bits + words);
+            region.ranks.resize(words);
+            uint32_t rank = 0;
+            for (size_t w = 0; w < words; w++) {
+                region.ranks[w] = rank;
+                rank += __builtin_popcountll(bits[w]);
+            }
+            std::vector<uint32_t>().swap(region.offsets);
+        }
+        else {
+            std::vector<uint32_t> offsets;
+            offsets.reserve(n);
+            for (size_t w = 0; w < words; w++)
+                for (uint64_t b = bits[w]; b != 0; b &= b - 1)
+                    offsets.push_back(w * 64 + __builtin_ctzll(b));
+            region.offsets.swap(offsets);
+            std::vector<uint64_t>().swap(region.bitmap);
+            std::vector<uint32_t>().swap(region.ranks);
+        }
+    }
+
+    /* Call `f` with the offset of each candidate of a region, in order */
+    template <class F>
+    static void forEachSlot(const Region& region, F f)
+    {
+        if (region.bitmap.empty()) {
+            for (uint32_t offset : region.offsets)
+                f(offset);
+        }
+        else {
+            for (size_t w = 0; w < region.bitmap.size(); w++)
+                for (uint64_t bits = region.bitmap[w]; bits != 0; bits &= bits - 1)
+                    f(w * 64 + __builtin_ctzll(bits));
+        }
+    }
+
+    /* Get the region of a candidate, and its index inside the region */
+    const Region& findRegion(size_t index, size_t& k) const
+    {
+        auto it = std::upper_bound(regions.begin(), regions.end(), index,
+            [] (size_t i, const Region& region) {return i < region.first;});
+        const Region& region = *(it - 1);
+        k = index - region.first;
+        return region;
+    }
+
+    /* Get the offset of the k-th candidate of a region */
+    static size_t findSlot(const Region& region, size_t k)
+    {
+        if (region.bitmap.empty())
+            return region.offsets[k];
+
+        size_t w = std::upper_bound(region.ranks.begin(), region.ranks.end(), k) - region.ranks.begin() - 1;
+        uint64_t bits = region.bitmap[w];
+        for (size_t i = region.ranks[w]; i < k; i++)
+            bits &= bits - 1;
+        return w * 64 + __builtin_ctzll(bits);
+    }
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QPushButton>
+#include <QDialogButtonBox>
+#include <QVBoxLayout>
+#include <QHeaderView>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <fstream>
+
+#include "AreaStatsWindow.h"
+
+enum {
+    COLUMN_NAME,
+    COLUMN_ADDRESS,
+    COLUMN_SIZE,
+    COLUMN_DATA,
+    COLUMN_ZERO,
+    COLUMN_PAGES,
+    COLUMN_TIME,
+    COLUMN_COUNT
+};
+
+/* Item showing a number, so that the table is sorted by value */
+static QTableWidgetItem* numberItem(const QVariant& value)
+{
+    QTableWidgetItem *item = new QTableWidgetItem();
+    item->setData(Qt::DisplayRole, value);
+    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    return item;
+}
+
+/* Quote a field of the CSV file if needed */
+static std::string csvField(const char* str)
+{
+    std::string field(str);
+    if (field.find_first_of(",\"\n") == std::string::npos)
+        return field;
+
+    std::string quoted = "\"";
+    for (char c : field) {
+        if (c == '"')
+            quoted += '"';
+        quoted += c;
+    }
+    quoted += '"';
+    return quoted;
+}
+
+AreaStatsWindow::AreaStatsWindow(Context* c, QWidget *parent, Qt::WindowFlags flags) : QDialog(parent, flags), context(c)
+{
+    setWindowTitle("Savestate Statistics");
+
+    /* Table */
+    statsTable = new QTableWidget(0, COLUMN_COUNT);
+    statsTable->setHorizontalHeaderLabels(QStringList() << tr("Name") << tr("Address") << tr("Size (KB)")
+        << tr("Data (KB)") << tr("Zero (KB)") << tr("Pages scanned") << tr("Time (ms)"));
+    statsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    statsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    statsTable->setAlternatingRowColors(true);
+    statsTable->verticalHeader()->hide();
+    statsTable->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    statsTable->horizontalHeader()->setSectionResizeMode(COLUMN_NAME, QHeaderView::Stretch);
+    statsTable->setSortingEnabled(true);
+
+    summaryLabel = new QLabel(tr("No savestate yet"));
+
+    /* Buttons */
+    QPushButton *exportButton = new QPushButton(tr("Export CSV..."));
+    connect(exportButton, &QAbstractButton::clicked, this, &AreaStatsWindow::slotExport);
+
+    QDialogButtonBox *buttonBox = new QDialogButtonBox();
+    buttonBox->addButton(exportButton, QDialogButtonBox::ActionRole);
+
+    /* Create the main layout */
+    QVBoxLayout *mainLayout = new QVBoxLayout;
+
+    mainLayout->addWidget(statsTable);
+    mainLayout->addWidget(summaryLabel);
+    mainLayout->addWidget(buttonBox);
+
+    setLayout(mainLayout);
+
+    resize(800, 500);
+}
+
+void AreaStatsWindow::update()
+{
+    std::vector<AreaStats> stats;
+    bool restore;
+    {
+        std::lock_guard<std::mutex> lock(context->area_stats_mutex);
+        stats = context->area_stats;
+        restore = context->area_stats_restore;
+    }
+
+    /* Rows must not be sorted while they are filled */
+    statsTable->setSortingEnabled(false);
+    statsTable->setRowCount(stats.size());
+
+    uint64_t data_bytes = 0;
+    int64_t time = 0;
+    for (int row = 0; row < static_cast<int>(stats.size()); row++) {
+        const AreaStats& as = stats[row];
+        statsTable->setItem(row, COLUMN_NAME, new QTableWidgetItem(QString(as.name)));
+        statsTable->setItem(row, COLUMN_ADDRESS, new QTableWidgetItem(QString("%1").arg(as.addr, 16, 16, QChar('0'))));
+        statsTable->setItem(row, COLUMN_SIZE, numberItem(static_cast<qulonglong>(as.size / 1024)));
+        statsTable->setItem(row, COLUMN_DATA, numberItem(static_cast<qulonglong>(as.data_bytes / 1024)));
+        statsTable->setItem(row, COLUMN_ZERO, numberItem(static_cast<qulonglong>(as.zero_bytes / 1024)));
+        statsTable->setItem(row, COLUMN_PAGES, numberItem(static_cast<qulonglong>(as.pages)));
+        statsTable->setItem(row, COLUMN_TIME, numberItem(as.time / 1000.0));
+        data_bytes += as.data_bytes;
+        time += as.time;
+    }
+
+    statsTable->setSortingEnabled(true);
+
+    summaryLabel->setText(QString("Last %1: %2 areas, %3 MB of data, %4 ms")
+        .arg(restore ? "loadstate" : "savestate")
+        .arg(stats.size())
+        .arg(data_bytes / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(time / 1000.0, 0, 'f', 1));
+}
+
+void AreaStatsWindow::slotExport()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Export statistics"), QString(), tr("CSV files (*.csv)"));
+    if (filename.isNull())
+        return;
+
+    std::vector<AreaStats> stats;
+    bool restore;
+    {
+        std::lock_guard<std::mutex> lock(context->area_stats_mutex);
+        stats = context->area_stats;
+        restore = context->area_stats_restore;
+    }
+
+    std::ofstream csv(filename.toStdString(), std::ofstream::trunc);
+    if (!csv) {
+        QMessageBox::warning(this, "Error", QString("Could not write %1").arg(filename));
+        return;
+    }
+
+    /* Sizes are exported in bytes and times in microseconds */
+    csv << "operation,name,address,size,data_bytes,zero_bytes,pages_scanned,time_us" << std::endl;
+    for (const AreaStats& as : stats) {
+        csv << (restore ? "load" : "save") << ',' << csvField(as.name) << ','
+            << std::hex << "0x" << as.addr << std::dec << ',' << as.size << ','
+            << as.data_bytes << ',' << as.zero_bytes << ',' << as.pages << ','
+            << as.time << std::endl;
+    }
+}
@@ -18,6 +18,7 @@
  */
 
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
@@ -35,6 +36,7 @@
 #include <iostream>
 #include <future>
 #include <sys/stat.h>
+#include <climits> // INT_MAX
 
 MainWindow::MainWindow(Context* c) : QMainWindow(), context(c)
 {
@@ -53,7 +55,11 @@ MainWindow::MainWindow(Context* c) : QMainWindow(), context(c)
     connect(gameLoop, &GameLoop::frameCountChanged, this, &MainWindow::updateFrameCountTime);
     connect(gameLoop, &GameLoop::sharedConfigChanged, this, &MainWindow::updateSharedConfigChanged);
     connect(gameLoop, &GameLoop::fpsChanged, this, &MainWindow::updateFps);
+    connect(gameLoop, &GameLoop::checkpointTimingsChanged, this, &MainWindow::updateCheckpointTimings);
     connect(gameLoop, &GameLoop::askMovieSaved, this, &MainWindow::alertSave);
+    connect(gameLoop, &GameLoop::savestateTreeChanged, this, &MainWindow::updateSavestateTree);
+    connect(gameLoop, &GameLoop::memoryRulesAuditChanged, this, &MainWindow::updateMemoryRulesAudit);
+    connect(gameLoop, &GameLoop::areaStatsChanged, this, &MainWindow::updateAreaStats);
 
     /* Create other windows */
 #ifdef LIBTAS_ENABLE_AVDUMPING
@@ -65,6 +71,9 @@ MainWindow::MainWindow(Context* c) : QMainWindow(), context(c)
     gameInfoWindow = new GameInfoWindow(c, this);
     ramSearchWindow = new RamSearchWindow(c, this);
     ramWatchWindow = new RamWatchWindow(c, this);
+    savestateTreeWindow = new SaveStateTreeWindow(c, this);
+    memoryRulesWindow = new MemoryRulesWindow(c, this);
+    areaStatsWindow = new AreaStatsWindow(c, this);
 
     /* Menu */
     createActions();
@@ -103,6 +112,9 @@ MainWindow::MainWindow(Context* c) : QMainWindow(), context(c)
 
     fpsValues = new QLabel("Current FPS: - / -");
 
+    /* Duration of the last savestate or loadstate */
+    checkpointTimings = new QLabel("Last savestate: -");
+
     /* Re-record count */
     rerecordCount = new QSpinBox();
     rerecordCount->setReadOnly(true);
@@ -214,6 +226,7 @@ MainWindow::MainWindow(Context* c) : QMainWindow(), context(c)
     generalFrameLayout->addWidget(new QLabel(tr("Frames per second:")), 1, 0);
     generalFrameLayout->addWidget(logicalFps, 1, 1);
     generalFrameLayout->addWidget(fpsValues, 1, 3);
+    generalFrameLayout->addWidget(checkpointTimings, 2, 0, 1, 4);
     generalFrameLayout->setColumnMinimumWidth(2, 50);
 
     QHBoxLayout *generalTimeLayout = new QHBoxLayout;
@@ -278,6 +291,33 @@ void MainWindow::createActions()
     addActionCheckable(movieEndGroup, tr("Pause the Movie"), Config::MOVIEEND_PAUSE);
     addActionCheckable(movieEndGroup, tr("Switch to Writing"), Config::MOVIEEND_WRITE);
 
+    keyframeIntervalGroup = new QActionGroup(this);
+    connect(keyframeIntervalGroup, &QActionGroup::triggered, this, &MainWindow::slotKeyframeInterval);
+
+    addActionCheckable(keyframeIntervalGroup, tr("Disabled"), 0);
+    addActionCheckable(keyframeIntervalGroup, tr("Every 10 frames"), 10);
+    addActionCheckable(keyframeIntervalGroup, tr("Every 30 frames"), 30);
+    addActionCheckable(keyframeIntervalGroup, tr("Every 60 frames"), 60);
+    addActionCheckable(keyframeIntervalGroup, tr("Every 120 frames"), 120);
+    addActionCheckable(keyframeIntervalGroup, tr("Every 300 frames"), 300);
+
+    keyframeCountGroup = new QActionGroup(this);
+    connect(keyframeCountGroup, &QActionGroup::triggered, this, &MainWindow::slotKeyframeCount);
+
+    addActionCheckable(keyframeCountGroup, tr("8"), 8);
+    addActionCheckable(keyframeCountGroup, tr("16"), 16);
+    addActionCheckable(keyframeCountGroup, tr("32"), 32);
+    addActionCheckable(keyframeCountGroup, tr("64"), 64);
+
+    rewindGroup = new QActionGroup(this);
+    connect(rewindGroup, &QActionGroup::triggered, this, &MainWindow::slotRewindFrames);
+
+    addActionCheckable(rewindGroup, tr("10 frames"), 10);
+    addActionCheckable(rewindGroup, tr("30 frames"), 30);
+    addActionCheckable(rewindGroup, tr("60 frames"), 60);
+    addActionCheckable(rewindGroup, tr("120 frames"), 120);
+    addActionCheckable(rewindGroup, tr("300 frames"), 300);
+
     renderPerfGroup = new QActionGroup(this);
     renderPerfGroup->setExclusive(false);
 
@@ -348,6 +388,29 @@ void MainWindow::createActions()
     addActionCheckable(savestateIgnoreGroup, tr("Ignore exec segments"), SharedConfig::IGNORE_EXEC);
     addActionCheckable(savestateIgnoreGroup, tr("Ignore shared segments"), SharedConfig::IGNORE_SHARED);
 
+    savestateSettingsGroup = new QActionGroup(this);
+    savestateSettingsGroup->setExclusive(false);
+    connect(savestateSettingsGroup, &QActionGroup::triggered, this, &MainWindow::slotSavestateSettings);
+
+    addActionCheckable(savestateSettingsGroup, tr("Store savestates in memory"), SharedConfig::SS_RAM);
+    addActionCheckable(savestateSettingsGroup, tr("Incremental savestates"), SharedConfig::SS_INCREMENTAL);
+    addActionCheckable(savestateSettingsGroup, tr("Write savestates in background"), SharedConfig::SS_FORK);
+    addActionCheckable(savestateSettingsGroup, tr("Load savestates lazily"), SharedConfig::SS_LAZY);
+    addActionCheckable(savestateSettingsGroup, tr("Share identical pages between savestates"), SharedConfig::SS_DEDUP);
+    addActionCheckable(savestateSettingsGroup, tr("Audit memory exclusion rules"), SharedConfig::SS_AUDIT_RULES);
+    addActionCheckable(savestateSettingsGroup, tr("Keep savestates between game executions"), SharedConfig::SS_PERSISTENT);
+
+    savestateCompressionGroup = new QActionGroup(this);
+    connect(savestateCompressionGroup, &QActionGroup::triggered, this, &MainWindow::slotSavestateCompression);
+
+    addActionCheckable(savestateCompressionGroup, tr("None"), SharedConfig::COMPRESSION_NONE);
+#ifdef LIBTAS_ENABLE_LZ4
+    addActionCheckable(savestateCompressionGroup, tr("LZ4 (fast)"), SharedConfig::COMPRESSION_LZ4);
+#endif
+#ifdef LIBTAS_ENABLE_ZSTD
+    addActionCheckable(savestateCompressionGroup, tr("Zstd (small)"), SharedConfig::COMPRESSION_ZSTD);
+#endif
+
     loggingOutputGroup = new QActionGroup(this);
 
     addActionCheckable(loggingOutputGroup, tr("Disabled"), SharedConfig::NO_LOGGING);
@@ -470,6 +533,19 @@ void MainWindow::createMenus()
     QMenu *movieEndMenu = fileMenu->addMenu(tr("On Movie End"));
     movieEndMenu->addActions(movieEndGroup->actions());
 
+    fileMenu->addSeparator();
+
+    fileMenu->addAction(tr("Seek to Frame..."), this, &MainWindow::slotSeek);
+    fileMenu->addAction(tr("Rewind"), this, &MainWindow::slotRewind);
+
+    QMenu *keyframeMenu = fileMenu->addMenu(tr("Keyframes"));
+    QMenu *keyframeIntervalMenu = keyframeMenu->addMenu(tr("Interval"));
+    keyframeIntervalMenu->addActions(keyframeIntervalGroup->actions());
+    QMenu *keyframeCountMenu = keyframeMenu->addMenu(tr("Maximum count"));
+    keyframeCountMenu->addActions(keyframeCountGroup->actions());
+    QMenu *rewindMenu = keyframeMenu->addMenu(tr("Rewind length"));
+    rewindMenu->addActions(rewindGroup->actions());
+
     /* Video Menu */
     QMenu *videoMenu = menuBar()->addMenu(tr("Video"));
 
@@ -514,6 +590,14 @@ void MainWindow::createMenus()
     QMenu *savestateMenu = runtimeMenu->addMenu(tr("Savestates"));
     QMenu *savestateSegmentMenu = savestateMenu->addMenu(tr("Ignore memory segments"));
     savestateSegmentMenu->addActions(savestateIgnoreGroup->actions());
+    savestateMenu->addActions(savestateSettingsGroup->actions());
+    disabledActionsOnStart.append(savestateSettingsGroup->actions());
+    QMenu *savestateCompressionMenu = savestateMenu->addMenu(tr("Compression"));
+    savestateCompressionMenu->addActions(savestateCompressionGroup->actions());
+    savestateMenu->addAction(tr("Export savestates to disk"), this, &MainWindow::slotExportSavestates);
+    savestateMenu->addAction(tr("Savestate Tree..."), savestateTreeWindow, &SaveStateTreeWindow::show);
+    savestateMenu->addAction(tr("Memory Exclusion Rules..."), memoryRulesWindow, &MemoryRulesWindow::show);
+    savestateMenu->addAction(tr("Savestate Statistics..."), areaStatsWindow, &AreaStatsWindow::show);
 
     saveScreenAction = runtimeMenu->addAction(tr("Save screen"), this, &MainWindow::slotSaveScreen);
     saveScreenAction->setCheckable(true);
@@ -614,6 +698,7 @@ void MainWindow::updateStatus()
             frameCount->setValue(0);
             currentLength->setText("Current Time: -");
             fpsValues->setText("Current FPS: - / -");
+            checkpointTimings->setText("Last savestate: -");
             {
                 MovieFile tempmovie(context);
                 /* Update the movie frame count and rerecord count
@@ -748,6 +833,15 @@ void MainWindow::updateFps(float fps, float lfps)
     }
 }
 
+void MainWindow::updateCheckpointTimings(bool restore, float signal, float suspend, float state, float resume)
+{
+    checkpointTimings->setText(QString("Last %1: signal %2 ms, suspend %3 ms, %4 %5 ms, resume %6 ms")
+        .arg(restore ? "loadstate" : "savestate")
+        .arg(signal, 0, 'f', 2).arg(suspend, 0, 'f', 2)
+        .arg(restore ? "read" : "write").arg(state, 0, 'f', 2)
+        .arg(resume, 0, 'f', 2));
+}
+
 void MainWindow::updateRam()
 {
     if (ramSearchWindow->isVisible()) {
@@ -758,6 +852,21 @@ void MainWindow::updateRam()
     }
 }
 
+void MainWindow::updateSavestateTree()
+{
+    savestateTreeWindow->update();
+}
+
+void MainWindow::updateMemoryRulesAudit()
+{
+    memoryRulesWindow->updateAudit();
+}
+
+void MainWindow::updateAreaStats()
+{
+    areaStatsWindow->update();
+}
+
 void MainWindow::setCheckboxesFromMask(const QActionGroup *actionGroup, int value)
 {
     for (auto& action : actionGroup->actions()) {
@@ -801,6 +910,8 @@ void MainWindow::updateUIFromConfig()
     cmdOptions->setText(context->config.gameargs.c_str());
     moviePath->setText(context->config.moviefile.c_str());
     logicalFps->setValue(context->config.sc.framerate);
+    savestateTreeWindow->updateConfig();
+    memoryRulesWindow->update();
 
     initialTimeSec->setValue(context->config.sc.initial_time.tv_sec);
     initialTimeNsec->setValue(context->config.sc.initial_time.tv_nsec);
@@ -864,8 +975,13 @@ void MainWindow::updateUIFromConfig()
     preventSavefileAction->setChecked(context->config.sc.prevent_savefiles);
 
     setCheckboxesFromMask(savestateIgnoreGroup, context->config.sc.ignore_sections);
+    setCheckboxesFromMask(savestateSettingsGroup, context->config.sc.savestate_settings);
+    setRadioFromList(savestateCompressionGroup, context->config.sc.savestate_compression);
 
     setRadioFromList(movieEndGroup, context->config.on_movie_end);
+    setRadioFromList(keyframeIntervalGroup, context->config.keyframe_interval);
+    setRadioFromList(keyframeCountGroup, context->config.keyframe_count);
+    setRadioFromList(rewindGroup, context->config.rewind_frames);
 }
 
 void MainWindow::slotLaunch()
@@ -1172,6 +1288,24 @@ void MainWindow::slotSavestateIgnore()
     context->config.sc_modified = true;
 }
 
+void MainWindow::slotSavestateSettings()
+{
+    setMaskFromCheckboxes(savestateSettingsGroup, context->config.sc.savestate_settings);
+    context->config.sc_modified = true;
+}
+
+void MainWindow::slotSavestateCompression()
+{
+    setListFromRadio(savestateCompressionGroup, context->config.sc.savestate_compression);
+    context->config.sc_modified = true;
+}
+
+void MainWindow::slotExportSavestates()
+{
+    if (context->status == Context::ACTIVE)
+        context->hotkey_queue.push(HOTKEY_EXPORT_SAVESTATES);
+}
+
 void MainWindow::slotSaveScreen(bool checked)
 {
     context->config.sc.save_screenpixels = checked;
@@ -1189,6 +1323,41 @@ void MainWindow::slotMovieEnd()
     setListFromRadio(movieEndGroup, context->config.on_movie_end);
 }
 
+void MainWindow::slotKeyframeInterval()
+{
+    setListFromRadio(keyframeIntervalGroup, context->config.keyframe_interval);
+}
+
+void MainWindow::slotKeyframeCount()
+{
+    setListFromRadio(keyframeCountGroup, context->config.keyframe_count);
+}
+
+void MainWindow::slotRewindFrames()
+{
+    setListFromRadio(rewindGroup, context->config.rewind_frames);
+}
+
+void MainWindow::slotSeek()
+{
+    if (context->status != Context::ACTIVE)
+        return;
+
+    bool ok;
+    int frame = QInputDialog::getInt(this, tr("Seek to Frame"), tr("Frame:"), context->framecount, 0, INT_MAX, 1, &ok);
+    if (!ok)
+        return;
+
+    context->seek_frame = frame;
+    context->hotkey_queue.push(HOTKEY_SEEK);
+}
+
+void MainWindow::slotRewind()
+{
+    if (context->status == Context::ACTIVE)
+        context->hotkey_queue.push(HOTKEY_REWIND);
+}
+
 void MainWindow::alertSave(void* promise)
 {
     std::promise<bool>* saveAnswer = static_cast<std::promise<bool>*>(promise);
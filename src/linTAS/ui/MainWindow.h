@@ -39,6 +39,9 @@
 #include "GameInfoWindow.h"
 #include "RamSearchWindow.h"
 #include "RamWatchWindow.h"
+#include "SaveStateTreeWindow.h"
+#include "MemoryRulesWindow.h"
+#include "AreaStatsWindow.h"
 #include "../GameLoop.h"
 #include "../Context.h"
 
@@ -65,11 +68,17 @@ public:
     GameInfoWindow* gameInfoWindow;
     RamSearchWindow* ramSearchWindow;
     RamWatchWindow* ramWatchWindow;
+    SaveStateTreeWindow* savestateTreeWindow;
+    MemoryRulesWindow* memoryRulesWindow;
+    AreaStatsWindow* areaStatsWindow;
 
     QList<QWidget*> disabledWidgetsOnStart;
     QList<QAction*> disabledActionsOnStart;
 
     QActionGroup *movieEndGroup;
+    QActionGroup *keyframeIntervalGroup;
+    QActionGroup *keyframeCountGroup;
+    QActionGroup *rewindGroup;
     QAction *renderSoftAction;
     QActionGroup *renderPerfGroup;
     QActionGroup *osdGroup;
@@ -87,6 +96,8 @@ public:
     QAction *preventSavefileAction;
 
     QActionGroup *savestateIgnoreGroup;
+    QActionGroup *savestateSettingsGroup;
+    QActionGroup *savestateCompressionGroup;
 
     QActionGroup *loggingOutputGroup;
     QActionGroup *loggingPrintGroup;
@@ -118,6 +129,7 @@ public:
 
     QSpinBox *logicalFps;
     QLabel *fpsValues;
+    QLabel *checkpointTimings;
 
     QCheckBox *pauseCheck;
     QCheckBox *fastForwardCheck;
@@ -155,10 +167,16 @@ public:
 
     /* Update fps values */
     void updateFps(float fps, float lfps);
+    void updateCheckpointTimings(bool restore, float signal, float suspend, float state, float resume);
 
     /* Update ramsearch and ramwatch values if window is shown */
     void updateRam();
 
+    /* Update the states shown in the savestate tree window */
+    void updateSavestateTree();
+    void updateMemoryRulesAudit();
+    void updateAreaStats();
+
     /* Update UI elements when a config file is loaded */
     void updateUIFromConfig();
 
@@ -219,9 +237,17 @@ private slots:
     void slotOsd();
     void slotOsdEncode(bool checked);
     void slotSavestateIgnore();
+    void slotSavestateSettings();
+    void slotSavestateCompression();
+    void slotExportSavestates();
     void slotSaveScreen(bool checked);
     void slotPreventSavefile(bool checked);
     void slotMovieEnd();
+    void slotKeyframeInterval();
+    void slotKeyframeCount();
+    void slotRewindFrames();
+    void slotSeek();
+    void slotRewind();
 };
 
 #endif
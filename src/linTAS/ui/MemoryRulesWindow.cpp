@@ -0,0 +1,230 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QPushButton>
+#include <QDialogButtonBox>
+#include <QVBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+
+#include "MemoryRulesWindow.h"
+
+enum {
+    COLUMN_ENABLED,
+    COLUMN_PATTERN,
+    COLUMN_START,
+    COLUMN_END,
+    COLUMN_MIN_SIZE,
+    COLUMN_EXCLUDED,
+    COLUMN_COUNT
+};
+
+/* Parse a size with an optional K, M or G suffix */
+static uint64_t parseSize(QString text)
+{
+    text = text.trimmed().toUpper();
+    uint64_t unit = 1;
+    if (text.endsWith('K'))
+        unit = 1024;
+    else if (text.endsWith('M'))
+        unit = 1024 * 1024;
+    else if (text.endsWith('G'))
+        unit = 1024 * 1024 * 1024;
+    if (unit != 1)
+        text.chop(1);
+    return text.toULongLong() * unit;
+}
+
+static QString formatSize(uint64_t size)
+{
+    if (size == 0)
+        return QString();
+    if ((size % (1024 * 1024 * 1024)) == 0)
+        return QString("%1G").arg(size / (1024 * 1024 * 1024));
+    if ((size % (1024 * 1024)) == 0)
+        return QString("%1M").arg(size / (1024 * 1024));
+    if ((size % 1024) == 0)
+        return QString("%1K").arg(size / 1024);
+    return QString::number(size);
+}
+
+static QString formatAddress(uint64_t addr)
+{
+    if (addr == 0)
+        return QString();
+    return QString("%1").arg(addr, 0, 16);
+}
+
+MemoryRulesWindow::MemoryRulesWindow(Context* c, QWidget *parent, Qt::WindowFlags flags) : QDialog(parent, flags), context(c)
+{
+    setWindowTitle("Memory Exclusion Rules");
+
+    /* Table */
+    ruleTable = new QTableWidget(0, COLUMN_COUNT);
+    ruleTable->setHorizontalHeaderLabels(QStringList() << tr("Enabled") << tr("Name pattern")
+        << tr("Start address") << tr("End address") << tr("Min size") << tr("Excluded"));
+    ruleTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    ruleTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    ruleTable->verticalHeader()->hide();
+    ruleTable->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    ruleTable->horizontalHeader()->setSectionResizeMode(COLUMN_PATTERN, QHeaderView::Stretch);
+    connect(ruleTable, &QTableWidget::itemChanged, this, &MemoryRulesWindow::slotChanged);
+
+    QLabel *help = new QLabel(tr("Areas matching all the criteria of an enabled rule are neither saved nor restored. "
+        "Patterns are matched against the file path or the name of areas, such as [heap]. "
+        "Sizes accept K, M and G suffixes. "
+        "The excluded size is reported after each savestate when auditing is enabled, including for disabled rules."));
+    help->setWordWrap(true);
+
+    /* Buttons */
+    QPushButton *addRule = new QPushButton(tr("Add Rule"));
+    connect(addRule, &QAbstractButton::clicked, this, &MemoryRulesWindow::slotAdd);
+
+    QPushButton *removeRule = new QPushButton(tr("Remove Rule"));
+    connect(removeRule, &QAbstractButton::clicked, this, &MemoryRulesWindow::slotRemove);
+
+    QDialogButtonBox *buttonBox = new QDialogButtonBox();
+    buttonBox->addButton(addRule, QDialogButtonBox::ActionRole);
+    buttonBox->addButton(removeRule, QDialogButtonBox::ActionRole);
+
+    /* Create the main layout */
+    QVBoxLayout *mainLayout = new QVBoxLayout;
+
+    mainLayout->addWidget(ruleTable);
+    mainLayout->addWidget(help);
+    mainLayout->addWidget(buttonBox);
+
+    setLayout(mainLayout);
+
+    update();
+}
+
+void MemoryRulesWindow::addRow(const MemoryRule& rule)
+{
+    int row = ruleTable->rowCount();
+    ruleTable->insertRow(row);
+
+    QTableWidgetItem *enabled = new QTableWidgetItem();
+    enabled->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+    enabled->setCheckState(rule.enabled ? Qt::Checked : Qt::Unchecked);
+    ruleTable->setItem(row, COLUMN_ENABLED, enabled);
+
+    ruleTable->setItem(row, COLUMN_PATTERN, new QTableWidgetItem(QString(rule.pattern)));
+    ruleTable->setItem(row, COLUMN_START, new QTableWidgetItem(formatAddress(rule.start)));
+    ruleTable->setItem(row, COLUMN_END, new QTableWidgetItem(formatAddress(rule.end)));
+    ruleTable->setItem(row, COLUMN_MIN_SIZE, new QTableWidgetItem(formatSize(rule.min_size)));
+
+    QTableWidgetItem *excluded = new QTableWidgetItem();
+    excluded->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
+    excluded->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    ruleTable->setItem(row, COLUMN_EXCLUDED, excluded);
+}
+
+void MemoryRulesWindow::update()
+{
+    std::vector<MemoryRule> rules;
+    {
+        std::lock_guard<std::mutex> lock(context->config.memory_rules_mutex);
+        rules = context->config.memory_rules;
+    }
+
+    /* Don't store the rules back while filling the table */
+    ruleTable->blockSignals(true);
+    ruleTable->setRowCount(0);
+    for (const MemoryRule& rule : rules)
+        addRow(rule);
+    ruleTable->blockSignals(false);
+
+    updateAudit();
+}
+
+void MemoryRulesWindow::updateAudit()
+{
+    std::vector<uint64_t> sizes;
+    {
+        std::lock_guard<std::mutex> lock(context->config.memory_rules_mutex);
+        sizes = context->config.memory_rules_audit;
+    }
+
+    ruleTable->blockSignals(true);
+    for (int row = 0; row < ruleTable->rowCount(); row++) {
+        QString text;
+        if (row < static_cast<int>(sizes.size()))
+            text = QString("%1 MB").arg(sizes[row] / (1024.0 * 1024.0), 0, 'f', 1);
+        ruleTable->item(row, COLUMN_EXCLUDED)->setText(text);
+    }
+    ruleTable->blockSignals(false);
+}
+
+void MemoryRulesWindow::storeRules()
+{
+    std::vector<MemoryRule> rules;
+    for (int row = 0; row < ruleTable->rowCount(); row++) {
+        MemoryRule rule;
+        rule.enabled = (ruleTable->item(row, COLUMN_ENABLED)->checkState() == Qt::Checked);
+        std::string pattern = ruleTable->item(row, COLUMN_PATTERN)->text().trimmed().toStdString();
+        pattern.copy(rule.pattern, MEMORY_RULE_PATTERN_SIZE - 1);
+        rule.start = ruleTable->item(row, COLUMN_START)->text().trimmed().toULongLong(nullptr, 16);
+        rule.end = ruleTable->item(row, COLUMN_END)->text().trimmed().toULongLong(nullptr, 16);
+        rule.min_size = parseSize(ruleTable->item(row, COLUMN_MIN_SIZE)->text());
+        rules.push_back(rule);
+    }
+
+    std::lock_guard<std::mutex> lock(context->config.memory_rules_mutex);
+    context->config.memory_rules = rules;
+    context->config.memory_rules_modified = true;
+}
+
+void MemoryRulesWindow::slotAdd()
+{
+    if (ruleTable->rowCount() >= MEMORY_RULES_MAX)
+        return;
+
+    ruleTable->blockSignals(true);
+    addRow(MemoryRule());
+    ruleTable->blockSignals(false);
+
+    storeRules();
+    ruleTable->editItem(ruleTable->item(ruleTable->rowCount() - 1, COLUMN_PATTERN));
+}
+
+void MemoryRulesWindow::slotRemove()
+{
+    int row = ruleTable->currentRow();
+    if (row < 0)
+        return;
+
+    ruleTable->removeRow(row);
+
+    {
+        /* Keep the audit of the other rules */
+        std::lock_guard<std::mutex> lock(context->config.memory_rules_mutex);
+        std::vector<uint64_t>& sizes = context->config.memory_rules_audit;
+        if (row < static_cast<int>(sizes.size()))
+            sizes.erase(sizes.begin() + row);
+    }
+
+    storeRules();
+}
+
+void MemoryRulesWindow::slotChanged()
+{
+    storeRules();
+}
@@ -0,0 +1,59 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LINTAS_MEMORYRULESWINDOW_H_INCLUDED
+#define LINTAS_MEMORYRULESWINDOW_H_INCLUDED
+
+#include <QDialog>
+#include <QTableWidget>
+
+#include "../Context.h"
+
+class MemoryRulesWindow : public QDialog {
+    Q_OBJECT
+
+public:
+    MemoryRulesWindow(Context *c, QWidget *parent = Q_NULLPTR, Qt::WindowFlags flags = 0);
+
+    /* Fill the table with the rules of the config */
+    void update();
+
+    /* Show the size of the areas matched by each rule in the last savestate */
+    void updateAudit();
+
+private:
+    Context *context;
+
+    QTableWidget *ruleTable;
+
+    /* Add a row showing a rule */
+    void addRow(const MemoryRule& rule);
+
+    /* Store the rules of the table into the config */
+    void storeRules();
+
+private slots:
+    void slotAdd();
+    void slotRemove();
+    void slotChanged();
+
+};
+
+#endif
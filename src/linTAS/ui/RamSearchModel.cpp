@@ -23,7 +23,9 @@ RamSearchModel::RamSearchModel(Context* c, QObject *parent) : QAbstractTableMode
 
 int RamSearchModel::rowCount(const QModelIndex & /*parent*/) const
 {
-   return ramwatches.size();
+    if (!candidates)
+        return 0;
+    return candidates->count();
 }
 
 int RamSearchModel::columnCount(const QModelIndex & /*parent*/) const
@@ -51,14 +53,14 @@ QVariant RamSearchModel::headerData(int section, Qt::Orientation orientation, in
 QVariant RamSearchModel::data(const QModelIndex &index, int role) const
 {
     if (role == Qt::DisplayRole) {
-        const std::unique_ptr<IRamWatch> &watch = ramwatches.at(index.row());
+        size_t row = index.row();
         switch(index.column()) {
             case 0:
-                return QString("%1").arg(watch->address, 0, 16);
+                return QString("%1").arg(candidates->address(row), 0, 16);
             case 1:
-                return QString(watch->tostring_current(hex));
+                return QString(candidates->tostring_current(row, hex));
             case 2:
-                return QString(watch->tostring(hex));
+                return QString(candidates->tostring(row, hex));
             default:
                 return QString();
         }
@@ -97,7 +99,12 @@ int RamSearchModel::predictWatchCount(int type_filter)
 
 int RamSearchModel::watchCount()
 {
-    return ramwatches.size();
+    return rowCount();
+}
+
+uintptr_t RamSearchModel::watchAddress(int row)
+{
+    return candidates->address(row);
 }
 
 void RamSearchModel::searchWatches(CompareType ct, CompareOperator co, double cv)
@@ -106,18 +113,17 @@ void RamSearchModel::searchWatches(CompareType ct, CompareOperator co, double cv
     compare_operator = co;
     compare_value = cv;
 
+    if (!candidates)
+        return;
+
     beginResetModel();
 
     int count = 0;
-    ramwatches.erase(
-        std::remove_if(ramwatches.begin(), ramwatches.end(),
-            [this, &count] (std::unique_ptr<IRamWatch> &watch) {
-                if (!(count++ & 0xfff)) {
-                    emit signalProgress(count);
-                }
-                return watch->check_update(compare_type, compare_operator, compare_value);
-            }),
-        ramwatches.end());
+    for (size_t r = 0; r < candidates->regionCount(); r++) {
+        count += candidates->searchRegion(r, compare_type, compare_operator, compare_value);
+        emit signalProgress(count);
+    }
+    candidates->finishSearch();
 
     endResetModel();
 }
@@ -27,12 +27,14 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 #include "../Context.h"
-#include "../ramsearch/IRamWatch.h"
+#include "../ramsearch/IRamCandidates.h"
 #include "../ramsearch/CompareEnums.h"
-#include "../ramsearch/RamWatch.h"
+#include "../ramsearch/RamCandidates.h"
 #include "../ramsearch/MemSection.h"
+#include "../ramsearch/MemAccess.h"
 
 class RamSearchModel : public QAbstractTableModel {
     Q_OBJECT
@@ -42,8 +44,8 @@ public:
 
     void update();
 
-    /* List of watches */
-    std::vector<std::unique_ptr<IRamWatch>> ramwatches;
+    /* Candidate addresses of the search */
+    std::unique_ptr<IRamCandidates> candidates;
 
     /* Flag if we display values in hex or decimal */
     bool hex;
@@ -64,8 +66,8 @@ public:
 
         beginResetModel();
 
-        ramwatches.clear();
-        IRamWatch::game_pid = context->game_pid;
+        RamCandidates<T>* typed_candidates = new RamCandidates<T>(context->game_pid);
+        candidates.reset(typed_candidates);
 
         /* Compose the filename for the /proc memory map, and open it. */
         std::ostringstream oss;
@@ -89,36 +91,16 @@ public:
             if (!(type_filter & section.type))
                 continue;
 
-            /* Reserve the vector space so we avoid multiple reallocations */
-            ramwatches.reserve(ramwatches.size() + section.size/sizeof(T));
-
-            /* For now we only store aligned addresses */
-            std::unique_ptr<RamWatch<T>> watch(nullptr);
-            for (uintptr_t addr = section.addr; addr < section.endaddr; addr += sizeof(T), cur_size += sizeof(T)) {
-
-                if (!(cur_size & 0xfff)) {
-                    emit signalProgress(cur_size);
-                }
-
-                if (! watch)
-                    watch = std::unique_ptr<RamWatch<T>>(new RamWatch<T>(addr));
-                else
-                    /* Reusing a watch object that wasn't inserted */
-                    watch->address = addr;
-
-                /* If only insert watches that match the compare */
-                if (compare_type == CompareType::Value) {
-                    if (!watch->check_update(compare_type, compare_operator, compare_value)) {
-                        ramwatches.push_back(std::move(watch));
-                    }
-                }
-
-                /* Insert all watches, still checking for accessible and non NaN/Inf values */
-                else {
-                    if (!watch->query()) {
-                        ramwatches.push_back(std::move(watch));
-                    }
-                }
+            /* Memory is read by chunks, whose values are all compared at once.
+             * For now we only store aligned addresses.
+             */
+            for (uintptr_t addr = section.addr; addr < section.endaddr; ) {
+                size_t size = std::min(static_cast<size_t>(section.endaddr - addr), static_cast<size_t>(RAMSEARCH_CHUNK_SIZE));
+                size_t done = typed_candidates->addChunk(addr, size, compare_type, compare_operator, compare_value);
+
+                addr += done;
+                cur_size += done;
+                emit signalProgress(cur_size);
             }
         }
 
@@ -127,6 +109,7 @@ public:
 
     int predictWatchCount(int type_filter);
     int watchCount();
+    uintptr_t watchAddress(int row);
     void searchWatches(CompareType ct, CompareOperator co, double cv);
 
 private:
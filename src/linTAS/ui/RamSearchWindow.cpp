@@ -311,7 +311,7 @@ void RamSearchWindow::slotAdd()
 
     MainWindow *mw = qobject_cast<MainWindow*>(parent());
     if (mw) {
-        mw->ramWatchWindow->editWindow->fill(ramSearchModel->ramwatches.at(row));
+        mw->ramWatchWindow->editWindow->fill(ramSearchModel->watchAddress(row));
         mw->ramWatchWindow->slotAdd();
     }
 }
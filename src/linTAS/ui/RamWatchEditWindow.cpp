@@ -80,10 +80,10 @@ void RamWatchEditWindow::fill(std::unique_ptr<IRamWatchDetailed> &watch)
         displayBox->setCurrentIndex(0);
 }
 
-void RamWatchEditWindow::fill(std::unique_ptr<IRamWatch> &watch)
+void RamWatchEditWindow::fill(uintptr_t addr)
 {
     /* Fill address */
-    addressInput->setText(QString("%1").arg(watch->address, 0, 16));
+    addressInput->setText(QString("%1").arg(addr, 0, 16));
 }
 
 void RamWatchEditWindow::slotSave()
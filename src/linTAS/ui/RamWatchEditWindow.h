@@ -24,8 +24,8 @@
 #include <QLineEdit>
 #include <QComboBox>
 #include <memory> // std::unique_ptr
+#include <cstdint>
 
-#include "../ramsearch/IRamWatch.h"
 #include "../ramsearch/IRamWatchDetailed.h"
 
 class RamWatchEditWindow : public QDialog {
@@ -35,7 +35,7 @@ public:
     RamWatchEditWindow(QWidget *parent = Q_NULLPTR, Qt::WindowFlags flags = 0);
 
     void fill(std::unique_ptr<IRamWatchDetailed> &watch);
-    void fill(std::unique_ptr<IRamWatch> &watch);
+    void fill(uintptr_t addr);
     void update();
 
     std::unique_ptr<IRamWatchDetailed> ramwatch;
@@ -0,0 +1,170 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <QPushButton>
+#include <QDialogButtonBox>
+#include <QVBoxLayout>
+#include <QFormLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <map>
+
+#include "SaveStateTreeWindow.h"
+
+SaveStateTreeWindow::SaveStateTreeWindow(Context* c, QWidget *parent, Qt::WindowFlags flags) : QDialog(parent, flags), context(c)
+{
+    setWindowTitle("Savestate Tree");
+
+    /* Tree */
+    stateTree = new QTreeWidget();
+    stateTree->setColumnCount(2);
+    stateTree->setHeaderLabels(QStringList() << tr("Frame") << tr("Slot"));
+    stateTree->setSelectionMode(QAbstractItemView::SingleSelection);
+    stateTree->setAlternatingRowColors(true);
+    stateTree->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    connect(stateTree, &QTreeWidget::itemSelectionChanged, this, &SaveStateTreeWindow::slotSelect);
+    connect(stateTree, &QTreeWidget::itemDoubleClicked, this, &SaveStateTreeWindow::slotLoad);
+
+    /* Storage budget */
+    budgetSpin = new QSpinBox();
+    budgetSpin->setRange(64, 1024 * 1024);
+    budgetSpin->setSuffix(tr(" MB"));
+    budgetSpin->setValue(context->config.savestate_tree_budget);
+    connect(budgetSpin, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &SaveStateTreeWindow::slotBudget);
+
+    QFormLayout *budgetLayout = new QFormLayout;
+    budgetLayout->addRow(new QLabel(tr("Savestate storage budget:")), budgetSpin);
+
+    /* Buttons */
+    QPushButton *saveState = new QPushButton(tr("Save State"));
+    connect(saveState, &QAbstractButton::clicked, this, &SaveStateTreeWindow::slotSave);
+
+    QPushButton *loadState = new QPushButton(tr("Load State"));
+    connect(loadState, &QAbstractButton::clicked, this, &SaveStateTreeWindow::slotLoad);
+
+    QPushButton *deleteState = new QPushButton(tr("Delete State"));
+    connect(deleteState, &QAbstractButton::clicked, this, &SaveStateTreeWindow::slotDelete);
+
+    QDialogButtonBox *buttonBox = new QDialogButtonBox();
+    buttonBox->addButton(saveState, QDialogButtonBox::ActionRole);
+    buttonBox->addButton(loadState, QDialogButtonBox::ActionRole);
+    buttonBox->addButton(deleteState, QDialogButtonBox::ActionRole);
+
+    /* Create the main layout */
+    QVBoxLayout *mainLayout = new QVBoxLayout;
+
+    mainLayout->addWidget(stateTree);
+    mainLayout->addLayout(budgetLayout);
+    mainLayout->addWidget(buttonBox);
+
+    setLayout(mainLayout);
+}
+
+void SaveStateTreeWindow::update()
+{
+    std::vector<SaveStateTree::Node> nodes = context->savestate_tree.nodes();
+    int current = context->savestate_tree.current();
+    int selected = context->savestate_tree.selected();
+
+    /* Don't notify the game thread about the selection while rebuilding */
+    stateTree->blockSignals(true);
+    stateTree->clear();
+
+    /* Nodes are in order of creation, so parents come before children */
+    std::map<int, QTreeWidgetItem*> items;
+    for (const SaveStateTree::Node& node : nodes) {
+        QTreeWidgetItem *item;
+        auto parent = items.find(node.parent);
+        if (parent != items.end())
+            item = new QTreeWidgetItem(parent->second);
+        else
+            item = new QTreeWidgetItem(stateTree);
+
+        item->setText(0, QString::number(node.framecount));
+        item->setText(1, QString::number(node.slot));
+        item->setData(0, Qt::UserRole, node.id);
+
+        if (node.id == current) {
+            QFont font = item->font(0);
+            font.setBold(true);
+            item->setFont(0, font);
+            item->setFont(1, font);
+        }
+
+        items[node.id] = item;
+    }
+
+    stateTree->expandAll();
+
+    auto item = items.find(selected);
+    if (item != items.end()) {
+        stateTree->setCurrentItem(item->second);
+        stateTree->scrollToItem(item->second);
+    }
+
+    stateTree->blockSignals(false);
+}
+
+void SaveStateTreeWindow::updateConfig()
+{
+    budgetSpin->setValue(context->config.savestate_tree_budget);
+}
+
+void SaveStateTreeWindow::pushSelected(HotKeyType type)
+{
+    QTreeWidgetItem *item = stateTree->currentItem();
+
+    /* If no state was selected, return */
+    if (!item)
+        return;
+
+    context->savestate_tree.select(item->data(0, Qt::UserRole).toInt());
+
+    if (context->status == Context::ACTIVE)
+        context->hotkey_queue.push(type);
+}
+
+void SaveStateTreeWindow::slotSelect()
+{
+    QTreeWidgetItem *item = stateTree->currentItem();
+    if (item)
+        context->savestate_tree.select(item->data(0, Qt::UserRole).toInt());
+}
+
+void SaveStateTreeWindow::slotSave()
+{
+    if (context->status == Context::ACTIVE)
+        context->hotkey_queue.push(HOTKEY_SAVESTATE_TREE);
+}
+
+void SaveStateTreeWindow::slotLoad()
+{
+    pushSelected(HOTKEY_LOADSTATE_TREE);
+}
+
+void SaveStateTreeWindow::slotDelete()
+{
+    pushSelected(HOTKEY_DELETESTATE_TREE);
+}
+
+void SaveStateTreeWindow::slotBudget(int value)
+{
+    context->config.savestate_tree_budget = value;
+}
@@ -18,6 +18,7 @@
  */
 
 #include "utils.h"
+#include "../shared/messages.h" // SAVESTATE_MAX_SLOTS
 #include <sys/stat.h>
 #include <cerrno> // errno
 #include <cstring> // strerror
@@ -110,10 +111,14 @@ void remove_savestates(Context* context)
 {
     std::string savestateprefix = context->config.savestatedir + '/';
     savestateprefix += context->gamename;
-    for (int i=1; i<=9; i++) {
+    /* State 0 is the base savestate of incremental savestates */
+    unlink((savestateprefix + ".state0").c_str());
+    for (int i=1; i<SAVESTATE_MAX_SLOTS; i++) {
         std::string savestatepath = savestateprefix + ".state" + std::to_string(i);
         unlink(savestatepath.c_str());
         std::string moviepath = savestateprefix + ".movie" + std::to_string(i) + ".ltm";
         unlink(moviepath.c_str());
     }
+    /* Pages shared by savestates */
+    unlink((savestateprefix + ".pages").c_str());
 }
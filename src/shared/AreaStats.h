@@ -0,0 +1,58 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_AREASTATS_H_INCLUDED
+#define LIBTAS_AREASTATS_H_INCLUDED
+
+#include <cstdint>
+
+/* Size of the name of an area in its statistics, including the null byte */
+#define AREA_STATS_NAME_SIZE 128
+
+/*
+ * Statistics of one memory area of the last savestate or loadstate, sent by
+ * the game so that it can be displayed in the UI.
+ */
+struct AreaStats {
+    /* Name of the area, which can be truncated */
+    char name[AREA_STATS_NAME_SIZE];
+
+    /* Location of the area. An address of 0 gathers the areas that did not
+     * fit in the statistics.
+     */
+    uint64_t addr;
+    uint64_t size;
+
+    /* Bytes of page content that were written or read */
+    uint64_t data_bytes;
+
+    /* Bytes of zero pages that were skipped when saving, or filled with
+     * zeros when loading
+     */
+    uint64_t zero_bytes;
+
+    /* Number of page entries read from /proc/self/pagemap */
+    uint64_t pages;
+
+    /* Time spent on the area, in microseconds */
+    int64_t time;
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_CHECKPOINTTIMINGS_H_INCLUDED
+#define LIBTAS_CHECKPOINTTIMINGS_H_INCLUDED
+
+#include <cstdint>
+
+/*
+ * Duration of each phase of the last savestate or loadstate, in microseconds,
+ * sent by the game so that it can be displayed in the UI.
+ */
+struct CheckpointTimings {
+    /* Was it a loadstate */
+    bool restore = false;
+
+    /* Sending the suspend signal to all threads */
+    int64_t signal = 0;
+
+    /* Waiting for all threads to be suspended */
+    int64_t suspend = 0;
+
+    /* Writing or reading the savestate */
+    int64_t state = 0;
+
+    /* Resuming all threads and waiting for them to be restored */
+    int64_t resume = 0;
+};
+
+#endif
@@ -0,0 +1,59 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIBTAS_MEMORYRULE_H_INCLUDED
+#define LIBTAS_MEMORYRULE_H_INCLUDED
+
+#include <cstdint>
+
+/* Maximum number of exclusion rules sent with MSGN_MEMORY_RULES */
+#define MEMORY_RULES_MAX 64
+
+/* Size of the name pattern of an exclusion rule, including the null byte */
+#define MEMORY_RULE_PATTERN_SIZE 256
+
+/*
+ * Rule defined by the user to exclude memory areas from savestates, such as
+ * audio buffers or shader caches that don't need to be restored. An area is
+ * matched if it satisfies all the criteria of the rule that are set.
+ */
+struct MemoryRule {
+    /* Is the rule applied. A disabled rule is still audited, which tells
+     * how much it would exclude.
+     */
+    bool enabled = true;
+
+    /* Glob pattern matched against the name of the area, which is the path
+     * of a mapped file or a name such as [heap]. Anonymous areas have an
+     * empty name. An empty pattern matches any area.
+     */
+    char pattern[MEMORY_RULE_PATTERN_SIZE] = "";
+
+    /* Address range that must contain the whole area. An end address of 0
+     * matches any area.
+     */
+    uint64_t start = 0;
+    uint64_t end = 0;
+
+    /* Minimum size of the area, in bytes */
+    uint64_t min_size = 0;
+};
+
+#endif
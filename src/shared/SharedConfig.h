@@ -149,6 +149,28 @@ struct SharedConfig {
 
     int ignore_sections = IGNORE_EXEC | IGNORE_SHARED | IGNORE_NON_ANONYMOUS_NON_WRITEABLE;
 
+    /* Savestate settings */
+    enum SavestateSettings {
+        SS_RAM = 0x01, /* Store savestates in memory instead of on disk */
+        SS_INCREMENTAL = 0x02, /* Only store the memory pages modified since a base savestate */
+        SS_FORK = 0x04, /* Write savestates in a forked process */
+        SS_LAZY = 0x08, /* Load memory pages of savestates when they are accessed */
+        SS_DEDUP = 0x10, /* Store identical memory pages of all savestates once */
+        SS_AUDIT_RULES = 0x20, /* Report the size of memory areas matched by exclusion rules */
+        SS_PERSISTENT = 0x40, /* Keep savestates when the game exits, and launch it without address randomization */
+    };
+
+    int savestate_settings = 0;
+
+    /* Compression of savestates */
+    enum SavestateCompression {
+        COMPRESSION_NONE = 0,
+        COMPRESSION_LZ4 = 1, /* Fast compression */
+        COMPRESSION_ZSTD = 2, /* Better compression ratio */
+    };
+
+    int savestate_compression = COMPRESSION_NONE;
+
     struct timespec initial_time = {0, 0};
 };
 
@@ -20,6 +20,17 @@
 #ifndef LIBTAS_MESSAGES_H_INCLUDED
 #define LIBTAS_MESSAGES_H_INCLUDED
 
+/* Savestate slots sent with MSGN_SAVESTATE_INDEX. Slot 0 holds the base
+ * savestate of incremental savestates, slots 1 to 9 are used by the savestate
+ * hotkeys, then come the keyframes that are taken automatically, and the
+ * remaining slots hold the states of the savestate tree.
+ */
+#define SAVESTATE_BASE_SLOT 0
+#define SAVESTATE_KEYFRAME_SLOT 10
+#define SAVESTATE_KEYFRAME_COUNT 64
+#define SAVESTATE_TREE_SLOT (SAVESTATE_KEYFRAME_SLOT + SAVESTATE_KEYFRAME_COUNT)
+#define SAVESTATE_MAX_SLOTS 256
+
 /* List of message identification values that is sent from/to the game */
 enum {
     /*
@@ -160,6 +171,76 @@ enum {
      * Arguments: 2 floats
      */
     MSGB_FPS,
+
+    /*
+     * Send the savestate slot before asking to save or load a savestate
+     * Argument: int
+     */
+    MSGN_SAVESTATE_INDEX,
+
+    /*
+     * Ask the game to copy an in-memory savestate into a file
+     * Arguments: int (slot), then size_t (string length) then char[len]
+     */
+    MSGN_EXPORT_SAVESTATE,
+
+    /*
+     * Send the path of the base savestate used by incremental savestates
+     * Arguments: size_t (string length) then char[len]
+     */
+    MSGN_BASE_SAVESTATE_PATH,
+
+    /*
+     * Send the path of the file storing pages shared by savestates
+     * Arguments: size_t (string length) then char[len]
+     */
+    MSGN_PAGE_POOL_PATH,
+
+    /*
+     * Ask the game to remove the savestate of a slot
+     * Arguments: int (slot), then size_t (string length) then char[len]
+     */
+    MSGN_DELETE_SAVESTATE,
+
+    /*
+     * Ask the game how much memory or disk space some savestates use
+     * Arguments: int (count), then for each savestate: int (slot) and
+     * size_t + char[] (path)
+     */
+    MSGN_SAVESTATE_STORAGE,
+
+    /*
+     * Send the number of bytes used by each asked savestate, including the
+     * pages that it added to the page pool
+     * Argument: uint64_t[count]
+     */
+    MSGB_SAVESTATE_STORAGE,
+
+    /*
+     * Send the duration of each phase of the last savestate or loadstate
+     * Argument: struct CheckpointTimings
+     */
+    MSGB_CHECKPOINT_TIMINGS,
+
+    /*
+     * Send the rules excluding memory areas from savestates
+     * Arguments: int (count), then struct MemoryRule[count]
+     */
+    MSGN_MEMORY_RULES,
+
+    /*
+     * Send the size of the memory areas matched by each exclusion rule during
+     * the last savestate
+     * Arguments: int (count), then uint64_t[count]
+     */
+    MSGB_MEMORY_RULES_AUDIT,
+
+    /*
+     * Send the statistics of each memory area of the last savestate or
+     * loadstate
+     * Arguments: bool (restore), int (count), then struct AreaStats[count]
+     */
+    MSGB_AREA_STATS,
 };
 
 #endif